@@ -0,0 +1,238 @@
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "AnimationClip.h"
+
+static const float quantizedMax = 65535.0f;
+
+AnimationClip::AnimationClip(int numCurves, float duration, bool looping)
+{
+	Curve empty = { 0, 0, 0, 0.0f, 0.0f, curveLinear };
+	curves.assign(numCurves > 0 ? numCurves : 0, empty);
+	this->duration = duration > 0.0f ? duration : 0.0f;
+	this->looping = looping;
+	timeScale = this->duration / quantizedMax;
+}
+
+bool AnimationClip::SetCurve(int index, const float *times, const float *values, int count, CurveInterpolation interpolation)
+{
+	if(index < 0 || index >= (int)curves.size() || count < 2 || count > maxCurveKeys || duration <= 0.0f)
+		return false;
+	if(times[0] != 0.0f || times[count-1] != duration)
+		return false;
+
+	// Quantized times must still be in order, or a segment would have no length
+	std::vector<uint16_t> quantizedTimes(count);
+	for(int k=0; k < count; k++)
+	{
+		quantizedTimes[k] = (uint16_t)lrintf(times[k] / duration * quantizedMax);
+		if(k > 0 && quantizedTimes[k] <= quantizedTimes[k-1])
+			return false;
+	}
+
+	const float valueMin = *std::min_element(values, values + count);
+	const float valueMax = *std::max_element(values, values + count);
+	const float valueScale = (valueMax - valueMin) / quantizedMax;
+
+	// Replace the curve's keys, moving those of the curves after it
+	Curve &curve = curves[index];
+	if(curve.numKeys > 0)
+	{
+		keyTimes.erase(keyTimes.begin() + curve.firstKey, keyTimes.begin() + curve.firstKey + curve.numKeys);
+		keyValues.erase(keyValues.begin() + curve.firstValue, keyValues.begin() + curve.firstValue + curve.numKeys + 2);
+		for(size_t c=0; c < curves.size(); c++)
+		{
+			if(curves[c].firstKey > curve.firstKey)
+			{
+				curves[c].firstKey -= curve.numKeys;
+				curves[c].firstValue -= curve.numKeys + 2;
+			}
+		}
+	}
+
+	std::vector<uint16_t> quantizedValues(count);
+	for(int k=0; k < count; k++)
+		quantizedValues[k] = valueScale > 0.0f ? (uint16_t)lrintf((values[k] - valueMin) / valueScale) : 0;
+
+	// The values have a key's more either side, the outer keys of the spline through
+	// the first and last segments. A looping curve's first and last keys are the same
+	// point so it wraps past them, other curves repeat their end keys.
+	curve.firstKey = (int)keyTimes.size();
+	curve.firstValue = (int)keyValues.size();
+	curve.numKeys = count;
+	curve.valueMin = valueMin;
+	curve.valueScale = valueScale;
+	curve.interpolation = interpolation;
+	keyTimes.insert(keyTimes.end(), quantizedTimes.begin(), quantizedTimes.end());
+	keyValues.push_back(looping ? quantizedValues[count-2] : quantizedValues[0]);
+	keyValues.insert(keyValues.end(), quantizedValues.begin(), quantizedValues.end());
+	keyValues.push_back(looping ? quantizedValues[1] : quantizedValues[count-1]);
+	return true;
+}
+
+float AnimationClip::WrapTime(float time) const
+{
+	// Playing forward wraps at most once, longer steps need the divide
+	if(looping && duration > 0.0f)
+	{
+		if(time >= duration && time < 2.0f*duration)
+			return time - duration;
+		if(time >= 0.0f && time < duration)
+			return time;
+		time -= duration*floorf(time / duration);
+		return time < duration ? time : 0.0f;
+	}
+	return std::min(std::max(time, 0.0f), duration);
+}
+
+AnimationClip::CurveKeys AnimationClip::GetKeys(const Curve &curve) const
+{
+	CurveKeys keys;
+	keys.times = keyTimes.data() + curve.firstKey;
+	keys.values = keyValues.data() + curve.firstValue + 1;
+	keys.numKeys = curve.numKeys;
+	keys.timeScale = timeScale;
+	keys.valueMin = curve.valueMin;
+	keys.valueScale = curve.valueScale;
+	keys.interpolation = curve.interpolation;
+	return keys;
+}
+
+// Playing forward the segment is the cursor's or one of the two after it, anything else
+// is a binary search
+int AnimationClip::CurveKeys::Seek(float time, int cursor) const
+{
+	const int lastSegment = numKeys - 2;
+	if(cursor <= lastSegment && time >= Time(cursor))
+	{
+		for(int step=0; step < 3; step++, cursor++)
+		{
+			if(cursor == lastSegment || time < Time(cursor + 1))
+				return cursor;
+		}
+	}
+
+	int low = 0;
+	int high = lastSegment;
+	while(low < high)
+	{
+		const int middle = (low + high + 1) / 2;
+		if(Time(middle) <= time)
+			low = middle;
+		else
+			high = middle - 1;
+	}
+	return low;
+}
+
+// Within segment key, the spline's outer keys are the ones either side of the segment
+float AnimationClip::CurveKeys::Evaluate(float time, int key) const
+{
+	const float t0 = Time(key);
+	const float t1 = Time(key + 1);
+	const float factor = std::min(std::max((time - t0) / (t1 - t0), 0.0f), 1.0f);
+	const float v1 = Value(key);
+	const float v2 = Value(key + 1);
+	if(interpolation == curveLinear)
+		return v1*(1.0f - factor) + v2*factor;
+
+	const float v0 = Value(key - 1);
+	const float v3 = Value(key + 2);
+
+	const float f2 = factor*factor;
+	const float f3 = f2*factor;
+	return 0.5f*(2.0f*v1 + (v2 - v0)*factor + (2.0f*v0 - 5.0f*v1 + 4.0f*v2 - v3)*f2 + (3.0f*v1 - v0 - 3.0f*v2 + v3)*f3);
+}
+
+float AnimationClip::Sample(int index, float time, unsigned char *cursor) const
+{
+	const Curve &curve = curves[index];
+	if(curve.numKeys == 0)
+		return 0.0f;
+
+	const CurveKeys keys = GetKeys(curve);
+	time = WrapTime(time);
+	const int key = keys.Seek(time, cursor ? *cursor : maxCurveKeys);
+	if(cursor)
+		*cursor = (unsigned char)key;
+	return keys.Evaluate(time, key);
+}
+
+void AnimationClip::SampleCurve(int index, const float *times, unsigned char *cursors, float *out, int count, float weight) const
+{
+	const Curve &curve = curves[index];
+	if(curve.numKeys == 0)
+		return;
+
+	const CurveKeys keys = GetKeys(curve);
+	for(int i=0; i < count; i++)
+	{
+		const int key = keys.Seek(times[i], cursors[i]);
+		cursors[i] = (unsigned char)key;
+		const float value = keys.Evaluate(times[i], key);
+		out[i] = weight < 1.0f ? out[i] + (value - out[i])*weight : value;
+	}
+}
+
+size_t AnimationClip::GetMemory() const
+{
+	return curves.capacity()*sizeof(Curve) + (keyTimes.capacity() + keyValues.capacity())*sizeof(uint16_t);
+}
+
+ClipPlayer::ClipPlayer()
+{
+	clip = NULL;
+	previous = NULL;
+	time = 0.0f;
+	previousTime = 0.0f;
+	fade = 0.0f;
+	fadeSeconds = 0.0f;
+}
+
+void ClipPlayer::Play(const AnimationClip *clip, float fadeSeconds)
+{
+	previous = NULL;
+	if(this->clip && fadeSeconds > 0.0f)
+	{
+		previous = this->clip;
+		previousTime = time;
+		previousCursors.swap(cursors);
+		fade = 0.0f;
+		this->fadeSeconds = fadeSeconds;
+	}
+
+	this->clip = clip;
+	time = 0.0f;
+	cursors.assign(clip ? clip->GetNumCurves() : 0, 0);
+}
+
+void ClipPlayer::Advance(float seconds)
+{
+	if(clip)
+		time = clip->WrapTime(time + seconds);
+	if(previous)
+	{
+		previousTime = previous->WrapTime(previousTime + seconds);
+		fade += seconds;
+		if(fade >= fadeSeconds)
+			previous = NULL;
+	}
+}
+
+void ClipPlayer::Sample(float *values)
+{
+	const float weight = previous ? fade / fadeSeconds : 1.0f;
+	const int numCurves = std::max(clip ? clip->GetNumCurves() : 0, previous ? previous->GetNumCurves() : 0);
+	for(int c=0; c < numCurves; c++)
+	{
+		const bool from = previous && c < previous->GetNumCurves() && previous->HasCurve(c);
+		const bool to = clip && c < clip->GetNumCurves() && clip->HasCurve(c);
+		if(!from && !to)
+			continue;
+
+		const float source = from ? previous->Sample(c, previousTime, &previousCursors[c]) : values[c];
+		const float target = to ? clip->Sample(c, time, &cursors[c]) : values[c];
+		values[c] = source + (target - source)*weight;
+	}
+}
@@ -0,0 +1,136 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	AnimationClip.h
+//	Keyframed animation: a clip is one curve per joint over a fixed duration, each
+//	curve a run of keys from time 0 to the clip's duration. Between keys a curve is
+//	linear, as VECTOR3D::lerp, or a Catmull-Rom spline through the keys either side.
+//	A looping clip wraps time. Its curves should end on the value they start with, or
+//	one a whole turn from it.
+//
+//	Keys are quantized to 16 bits, 4 bytes a key: times as a fraction of the duration
+//	and values as a fraction of the curve's range. Each curve has a value more either
+//	side for the spline to read past its ends.
+//
+//	Sampling keeps a cursor per curve, the key starting the segment last sampled, so
+//	playing forward only ever steps a key or two on and costs the same however long
+//	the curve is. SampleCurve does this for many robots at once with one time and one
+//	cursor each, and can blend into what is already in its output.
+//
+//	ClipPlayer plays one clip at a time and cross-fades from the clip before it.
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef ANIMATIONCLIP_H
+#define ANIMATIONCLIP_H
+
+#include <stdint.h>
+#include <vector>
+
+enum CurveInterpolation
+{
+	curveLinear,
+	curveSmooth			// Catmull-Rom through the keys either side
+};
+
+// Curves are at most this many keys, so a cursor fits a byte
+const int maxCurveKeys = 256;
+
+class AnimationClip
+{
+private:
+	struct Curve
+	{
+		int firstKey;
+		int firstValue;		// one before firstKey's, see SetCurve
+		int numKeys;		// 0 for curves the clip does not drive
+		float valueMin;
+		float valueScale;
+		CurveInterpolation interpolation;
+	};
+
+	// A curve's keys decoded as they are read, copied out of the clip so sampling loops
+	// keep it in registers
+	struct CurveKeys
+	{
+		const uint16_t *times;
+		const uint16_t *values;
+		int numKeys;
+		float timeScale;
+		float valueMin;
+		float valueScale;
+		CurveInterpolation interpolation;
+
+		float Time(int key) const { return times[key]*timeScale; }
+		float Value(int key) const { return valueMin + values[key]*valueScale; }
+
+		// Segment holding time, which is within [0, duration], searched from cursor
+		int Seek(float time, int cursor) const;
+		float Evaluate(float time, int key) const;
+	};
+
+	std::vector<Curve> curves;
+	std::vector<uint16_t> keyTimes;
+	std::vector<uint16_t> keyValues;
+
+	float duration;
+	float timeScale;
+	bool looping;
+
+	CurveKeys GetKeys(const Curve &curve) const;
+
+public:
+	AnimationClip(int numCurves, float duration, bool looping);
+
+	// count keys at times, in seconds, from 0 up to the duration. False, leaving the
+	// curve as it was, for keys out of order, not starting at 0 or not ending at the
+	// duration, fewer than 2 or more than maxCurveKeys.
+	bool SetCurve(int curve, const float *times, const float *values, int count, CurveInterpolation interpolation);
+
+	int GetNumCurves() const { return (int)curves.size(); }
+	bool HasCurve(int curve) const { return curves[curve].numKeys > 0; }
+	float GetDuration() const { return duration; }
+	bool IsLooping() const { return looping; }
+
+	// Into [0, duration]: wrapped when looping, clamped when not
+	float WrapTime(float time) const;
+
+	// Value of curve at time. cursor, if any, starts the search and is left at the
+	// segment found.
+	float Sample(int curve, float time, unsigned char *cursor = NULL) const;
+
+	// out[i] = curve at times[i] for count robots with a cursor each, times already
+	// wrapped. A weight below 1 blends towards the sample from what is in out.
+	void SampleCurve(int curve, const float *times, unsigned char *cursors, float *out, int count, float weight = 1.0f) const;
+
+	// Bytes of keys and curves
+	size_t GetMemory() const;
+};
+
+// One robot's clip, and the clip it is fading from for fadeSeconds after Play
+class ClipPlayer
+{
+private:
+	const AnimationClip *clip;
+	const AnimationClip *previous;
+	float time;
+	float previousTime;
+	float fade;
+	float fadeSeconds;
+	std::vector<unsigned char> cursors;
+	std::vector<unsigned char> previousCursors;
+
+public:
+	ClipPlayer();
+
+	// Starts clip from its beginning. A clip already playing is faded out over
+	// fadeSeconds, playing on while it fades.
+	void Play(const AnimationClip *clip, float fadeSeconds = 0.0f);
+	void Advance(float seconds);
+
+	const AnimationClip *GetClip() const { return clip; }
+	bool IsFading() const { return previous != NULL; }
+
+	// Sets values for the curves either clip drives, values being one per curve.
+	// Curves only one of the clips drives fade from or to what is already in values.
+	void Sample(float *values);
+};
+
+#endif	//ANIMATIONCLIP_H
@@ -0,0 +1,79 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	CompactVertex.h
+//	4 byte vertex for regular grids: 16-bit height above the flat grid and a 16-bit
+//	octahedral normal. The position along the grid follows from the vertex index, so
+//	a QuadMesh vertex shrinks from 24 bytes (MeshVertex) to 4.
+//
+//	Octahedral encoding projects the unit normal onto the octahedron |x|+|y|+|z| = 1,
+//	folds the lower half over the upper one and stores x and z as signed 8-bit values.
+//	The error stays below one degree everywhere on the sphere.
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef COMPACTVERTEX_H
+#define COMPACTVERTEX_H
+
+#include <stdint.h>
+
+struct CompactVertex
+{
+	uint16_t height;
+	uint16_t normal;
+};
+
+static inline float OctSign(float v)
+{
+	return v < 0.0f ? -1.0f : 1.0f;
+}
+
+static inline uint16_t EncodeOctNormal(VECTOR3D n)
+{
+	const float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	if(l1 <= 0.0f)
+		return (uint16_t)(127 << 8);	// straight up
+
+	float x = n.x / l1;
+	float z = n.z / l1;
+	if(n.y < 0.0f)
+	{
+		const float fx = (1.0f - fabsf(z))*OctSign(x);
+		z = (1.0f - fabsf(x))*OctSign(z);
+		x = fx;
+	}
+
+	// Signed 8-bit so 0 (a normal in the y plane) is exact
+	const int qx = (int)lrintf(x*127.0f);
+	const int qz = (int)lrintf(z*127.0f);
+	return (uint16_t)(((qx & 0xff) << 8) | (qz & 0xff));
+}
+
+static inline VECTOR3D DecodeOctNormal(uint16_t e)
+{
+	float x = (float)(int8_t)(e >> 8) * (1.0f/127.0f);
+	float z = (float)(int8_t)(e & 0xff) * (1.0f/127.0f);
+	x = x < -1.0f ? -1.0f : x;
+	z = z < -1.0f ? -1.0f : z;
+	const float y = 1.0f - fabsf(x) - fabsf(z);
+	if(y < 0.0f)
+	{
+		const float fx = (1.0f - fabsf(z))*OctSign(x);
+		z = (1.0f - fabsf(x))*OctSign(z);
+		x = fx;
+	}
+
+	const float inv = 1.0f / sqrtf(x*x + y*y + z*z);
+	return VECTOR3D(x*inv, y*inv, z*inv);
+}
+
+// Heights are stored as steps of heightStep above heightMin
+static inline uint16_t EncodeHeight(float height, float heightMin, float heightStep)
+{
+	const float q = (height - heightMin) / heightStep;
+	return (uint16_t)(q <= 0.0f ? 0 : (q >= 65535.0f ? 65535 : lrintf(q)));
+}
+
+static inline float DecodeHeight(uint16_t height, float heightMin, float heightStep)
+{
+	return heightMin + height*heightStep;
+}
+
+#endif	//COMPACTVERTEX_H
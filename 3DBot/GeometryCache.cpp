@@ -0,0 +1,394 @@
+#define GL_SILENCE_DEPRECATION
+#ifndef __APPLE__
+#define GL_GLEXT_PROTOTYPES   // glGenBuffers etc. are only prototyped in glext.h
+#endif
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#include <GLUT/glut.h>
+#else
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+#include <GL/glut.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "VECTOR3D.h"
+#include "QuadMesh.h"
+#include "Profiler.h"
+#include "GeometryCache.h"
+
+enum
+{
+	primitiveCube,
+	primitiveTorus,
+	primitiveCylinder,
+	primitiveDisk,
+	primitiveCone
+};
+
+bool GeometryCache::Key::operator<(const Key &rhs) const
+{
+	if(type != rhs.type)
+		return type < rhs.type;
+	for(int i=0; i < 3; i++)
+	{
+		if(size[i] != rhs.size[i])
+			return size[i] < rhs.size[i];
+	}
+	if(steps[0] != rhs.steps[0])
+		return steps[0] < rhs.steps[0];
+	return steps[1] < rhs.steps[1];
+}
+
+GeometryCache::GeometryCache()
+{
+	useVBO = false;
+	buffersDirty = true;
+	vertexBuffer = 0;
+	indexBuffer = 0;
+	bound = false;
+}
+
+GeometryCache::~GeometryCache()
+{
+	if(vertexBuffer)
+		glDeleteBuffers(1, &vertexBuffer);
+	if(indexBuffer)
+		glDeleteBuffers(1, &indexBuffer);
+}
+
+GeometryCache::Handle GeometryCache::Find(int type, float a, float b, float c, int steps0, int steps1)
+{
+	Key key = { type, { a, b, c }, { steps0, steps1 } };
+	std::map<Key, Handle>::const_iterator it = lookup.find(key);
+	return it == lookup.end() ? -1 : it->second;
+}
+
+// Register the triangles added since firstIndex as a new primitive
+GeometryCache::Handle GeometryCache::Add(int type, float a, float b, float c, int steps0, int steps1, int firstIndex)
+{
+	Key key = { type, { a, b, c }, { steps0, steps1 } };
+	Primitive primitive = { firstIndex, (int)indices.size() - firstIndex, (int)vertices.size(), 0 };
+	for(size_t i=firstIndex; i < indices.size(); i++)
+		primitive.firstVertex = std::min(primitive.firstVertex, (int)indices[i]);
+	primitive.numVertices = (int)vertices.size() - primitive.firstVertex;
+	primitives.push_back(primitive);
+	lookup[key] = (Handle)primitives.size()-1;
+	buffersDirty = true;
+	return (Handle)primitives.size()-1;
+}
+
+void GeometryCache::GetRange(Handle primitive, int &firstIndex, int &numIndices, int &firstVertex, int &numVertices) const
+{
+	const Primitive &p = primitives[primitive];
+	firstIndex = p.firstIndex;
+	numIndices = p.numIndices;
+	firstVertex = p.firstVertex;
+	numVertices = p.numVertices;
+}
+
+int GeometryCache::AddVertex(VECTOR3D position, VECTOR3D normal)
+{
+	Vertex v;
+	v.position = position;
+	v.normal = normal;
+	vertices.push_back(v);
+	return (int)vertices.size()-1;
+}
+
+void GeometryCache::AddTriangle(int a, int b, int c)
+{
+	indices.push_back((GLushort)a);
+	indices.push_back((GLushort)b);
+	indices.push_back((GLushort)c);
+}
+
+// Counterclockwise corners
+void GeometryCache::AddQuad(int a, int b, int c, int d)
+{
+	AddTriangle(a, b, c);
+	AddTriangle(a, c, d);
+}
+
+// Like glutSolidCube, centered on the origin
+GeometryCache::Handle GeometryCache::Cube(float size)
+{
+	Handle found = Find(primitiveCube, size, 0, 0, 0, 0);
+	if(found >= 0)
+		return found;
+
+	// Face normal and two edge directions whose cross product is the normal
+	static const float faces[6][3][3] =
+	{
+		{ { 1, 0, 0}, {0, 1, 0}, {0, 0, 1} },
+		{ {-1, 0, 0}, {0, 0, 1}, {0, 1, 0} },
+		{ { 0, 1, 0}, {0, 0, 1}, {1, 0, 0} },
+		{ { 0,-1, 0}, {1, 0, 0}, {0, 0, 1} },
+		{ { 0, 0, 1}, {1, 0, 0}, {0, 1, 0} },
+		{ { 0, 0,-1}, {0, 1, 0}, {1, 0, 0} },
+	};
+
+	const int firstIndex = (int)indices.size();
+	const float h = 0.5f*size;
+	for(int f=0; f < 6; f++)
+	{
+		VECTOR3D n(faces[f][0]);
+		VECTOR3D u(faces[f][1]);
+		VECTOR3D v(faces[f][2]);
+		int a = AddVertex((n - u - v)*h, n);
+		int b = AddVertex((n + u - v)*h, n);
+		int c = AddVertex((n + u + v)*h, n);
+		int d = AddVertex((n - u + v)*h, n);
+		AddQuad(a, b, c, d);
+	}
+	return Add(primitiveCube, size, 0, 0, 0, 0, firstIndex);
+}
+
+// Like glutSolidTorus: around the z axis, tube of innerRadius at outerRadius from it
+GeometryCache::Handle GeometryCache::Torus(float innerRadius, float outerRadius, int sides, int rings)
+{
+	Handle found = Find(primitiveTorus, innerRadius, outerRadius, 0, sides, rings);
+	if(found >= 0)
+		return found;
+	if(sides < 3 || rings < 3 || vertices.size() + rings*sides > 65536)
+		return -1;
+
+	const int firstIndex = (int)indices.size();
+	const int first = (int)vertices.size();
+	for(int i=0; i < rings; i++)
+	{
+		const float phi = 2.0f*M_PI*i / rings;
+		for(int j=0; j < sides; j++)
+		{
+			const float theta = 2.0f*M_PI*j / sides;
+			VECTOR3D n(cosf(phi)*cosf(theta), sinf(phi)*cosf(theta), sinf(theta));
+			const float r = outerRadius + innerRadius*cosf(theta);
+			AddVertex(VECTOR3D(cosf(phi)*r, sinf(phi)*r, innerRadius*sinf(theta)), n);
+		}
+	}
+	for(int i=0; i < rings; i++)
+	{
+		const int i1 = (i+1) % rings;
+		for(int j=0; j < sides; j++)
+		{
+			const int j1 = (j+1) % sides;
+			AddQuad(first + i*sides + j, first + i1*sides + j, first + i1*sides + j1, first + i*sides + j1);
+		}
+	}
+	return Add(primitiveTorus, innerRadius, outerRadius, 0, sides, rings, firstIndex);
+}
+
+// Like gluCylinder with smooth normals: along z from 0 to height, open at both ends
+GeometryCache::Handle GeometryCache::Cylinder(float baseRadius, float topRadius, float height, int slices, int stacks)
+{
+	Handle found = Find(primitiveCylinder, baseRadius, topRadius, height, slices, stacks);
+	if(found >= 0)
+		return found;
+	if(slices < 3 || stacks < 1 || vertices.size() + (slices+1)*(stacks+1) > 65536)
+		return -1;
+
+	// Normals lean towards the narrow end
+	const float length = sqrtf((baseRadius-topRadius)*(baseRadius-topRadius) + height*height);
+	const float normalZ = (baseRadius-topRadius) / length;
+	const float normalXY = height / length;
+
+	const int firstIndex = (int)indices.size();
+	const int first = (int)vertices.size();
+	for(int i=0; i <= slices; i++)
+	{
+		const float angle = 2.0f*M_PI*i / slices;
+		for(int k=0; k <= stacks; k++)
+		{
+			const float r = baseRadius + (topRadius-baseRadius)*k / stacks;
+			VECTOR3D n(sinf(angle)*normalXY, cosf(angle)*normalXY, normalZ);
+			AddVertex(VECTOR3D(sinf(angle)*r, cosf(angle)*r, height*k / stacks), n);
+		}
+	}
+	for(int i=0; i < slices; i++)
+	{
+		for(int k=0; k < stacks; k++)
+		{
+			const int a = first + i*(stacks+1) + k;
+			const int b = first + (i+1)*(stacks+1) + k;
+			AddQuad(a, a+1, b+1, b);
+		}
+	}
+	return Add(primitiveCylinder, baseRadius, topRadius, height, slices, stacks, firstIndex);
+}
+
+// Rings at z facing normalZ (+1 or -1), a fan at the center when innerRadius is 0
+void GeometryCache::AddDisk(float innerRadius, float outerRadius, float z, float normalZ, int slices, int loops)
+{
+	const VECTOR3D n(0.0f, 0.0f, normalZ);
+	const int firstLoop = innerRadius > 0.0f ? 0 : 1;
+	const int center = innerRadius > 0.0f ? -1 : AddVertex(VECTOR3D(0.0f, 0.0f, z), n);
+	const int ringFirst = (int)vertices.size();
+
+	for(int k=firstLoop; k <= loops; k++)
+	{
+		const float r = innerRadius + (outerRadius-innerRadius)*k / loops;
+		for(int i=0; i <= slices; i++)
+		{
+			const float angle = 2.0f*M_PI*i / slices;
+			AddVertex(VECTOR3D(sinf(angle)*r, cosf(angle)*r, z), n);
+		}
+	}
+
+	// Counterclockwise seen from +z, flipped for a disk facing -z
+	for(int k=0; k < loops+1-firstLoop; k++)
+	{
+		for(int i=0; i < slices; i++)
+		{
+			const int outer = ringFirst + k*(slices+1) + i;
+			if(k == 0 && center >= 0)
+			{
+				if(normalZ > 0)
+					AddTriangle(center, outer+1, outer);
+				else
+					AddTriangle(center, outer, outer+1);
+				continue;
+			}
+			const int inner = outer - (slices+1);
+			if(normalZ > 0)
+				AddQuad(inner, inner+1, outer+1, outer);
+			else
+				AddQuad(inner, outer, outer+1, inner+1);
+		}
+	}
+}
+
+// Like gluDisk: in the z = 0 plane facing +z
+GeometryCache::Handle GeometryCache::Disk(float innerRadius, float outerRadius, int slices, int loops)
+{
+	Handle found = Find(primitiveDisk, innerRadius, outerRadius, 0, slices, loops);
+	if(found >= 0)
+		return found;
+	if(slices < 3 || loops < 1 || vertices.size() + (slices+1)*(loops+1) + 1 > 65536)
+		return -1;
+
+	const int firstIndex = (int)indices.size();
+	AddDisk(innerRadius, outerRadius, 0.0f, 1.0f, slices, loops);
+	return Add(primitiveDisk, innerRadius, outerRadius, 0, slices, loops, firstIndex);
+}
+
+// Like glutSolidCone: base of radius base at z = 0 facing -z, apex at z = height
+GeometryCache::Handle GeometryCache::Cone(float base, float height, int slices, int stacks)
+{
+	Handle found = Find(primitiveCone, base, height, 0, slices, stacks);
+	if(found >= 0)
+		return found;
+	if(slices < 3 || stacks < 1 || vertices.size() + (slices+1)*(stacks+2) + 1 > 65536)
+		return -1;
+
+	const float length = sqrtf(height*height + base*base);
+	const float normalXY = height / length;
+	const float normalZ = base / length;
+
+	const int firstIndex = (int)indices.size();
+	AddDisk(0.0f, base, 0.0f, -1.0f, slices, 1);
+
+	// Side rings from the base up, the last one is the apex with one normal per slice
+	const int first = (int)vertices.size();
+	for(int k=0; k <= stacks; k++)
+	{
+		const float r = base*(stacks-k) / stacks;
+		for(int i=0; i <= slices; i++)
+		{
+			const float angle = 2.0f*M_PI*i / slices;
+			VECTOR3D n(cosf(angle)*normalXY, sinf(angle)*normalXY, normalZ);
+			AddVertex(VECTOR3D(cosf(angle)*r, sinf(angle)*r, height*k / stacks), n);
+		}
+	}
+	for(int k=0; k < stacks; k++)
+	{
+		for(int i=0; i < slices; i++)
+		{
+			const int a = first + k*(slices+1) + i;
+			const int d = a + slices+1;
+			if(k == stacks-1)
+				AddTriangle(a, a+1, d);
+			else
+				AddQuad(a, a+1, d+1, d);
+		}
+	}
+	return Add(primitiveCone, base, height, 0, slices, stacks, firstIndex);
+}
+
+void GeometryCache::UploadBuffers()
+{
+	if(vertexBuffer == 0 && indexBuffer == 0)
+	{
+		useVBO = QuadMesh::SupportsVBO();
+		if(useVBO)
+		{
+			glGenBuffers(1, &vertexBuffer);
+			glGenBuffers(1, &indexBuffer);
+		}
+	}
+
+	if(useVBO && !vertices.empty())
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(GLushort), &indices[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+
+	buffersDirty = false;
+}
+
+// Point the vertex and normal arrays at the shared buffers
+void GeometryCache::Bind()
+{
+	if(buffersDirty)
+	{
+		UploadBuffers();
+	}
+
+	const char *vertexBase = useVBO ? NULL : (const char *)vertices.data();
+	if(useVBO)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	}
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glVertexPointer(3, GL_FLOAT, sizeof(Vertex), vertexBase + offsetof(Vertex, position));
+	glNormalPointer(GL_FLOAT, sizeof(Vertex), vertexBase + offsetof(Vertex, normal));
+	bound = true;
+}
+
+void GeometryCache::Draw(Handle primitive)
+{
+	if(!bound || primitive < 0 || primitive >= (Handle)primitives.size())
+		return;
+
+	const Primitive &p = primitives[primitive];
+	const GLushort *indexBase = useVBO ? NULL : indices.data();
+	PROFILE_COUNT(counterDrawCalls, 1);
+	PROFILE_COUNT(counterVertices, p.numIndices);
+	glDrawElements(GL_TRIANGLES, p.numIndices, GL_UNSIGNED_SHORT, indexBase + p.firstIndex);
+}
+
+void GeometryCache::Unbind()
+{
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	if(useVBO)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+	bound = false;
+}
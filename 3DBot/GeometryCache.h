@@ -0,0 +1,94 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	GeometryCache.h
+//	Solid primitives tessellated once and drawn from one shared vertex and index
+//	buffer. Each primitive is stored once per parameter set, asking again for the same
+//	parameters returns the same handle. The shapes match the GLUT and GLU calls they
+//	replace: glutSolidCube, glutSolidTorus, glutSolidCone, gluCylinder and gluDisk.
+//
+//	Usage: look the handles up once, then between Bind and Unbind each Draw is a
+//	single glDrawElements with nothing allocated or computed.
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef GEOMETRYCACHE_H
+#define GEOMETRYCACHE_H
+
+#include <map>
+#include <vector>
+
+class GeometryCache
+{
+public:
+	typedef int Handle;
+
+	struct Vertex
+	{
+		VECTOR3D position;
+		VECTOR3D normal;
+	};
+
+private:
+	// Primitive type and parameters
+	struct Key
+	{
+		int type;
+		float size[3];
+		int steps[2];
+
+		bool operator<(const Key &rhs) const;
+	};
+
+	// Index range of a primitive, drawn as GL_TRIANGLES, and the vertices it uses
+	struct Primitive
+	{
+		int firstIndex;
+		int numIndices;
+		int firstVertex;
+		int numVertices;
+	};
+
+	std::vector<Vertex> vertices;
+	std::vector<GLushort> indices;
+	std::vector<Primitive> primitives;
+	std::map<Key, Handle> lookup;
+
+	// Uploaded on the first Bind after a primitive is added
+	bool useVBO;
+	bool buffersDirty;
+	GLuint vertexBuffer;
+	GLuint indexBuffer;
+	bool bound;
+
+private:
+	Handle Find(int type, float a, float b, float c, int steps0, int steps1);
+	Handle Add(int type, float a, float b, float c, int steps0, int steps1, int firstIndex);
+	int AddVertex(VECTOR3D position, VECTOR3D normal);
+	void AddTriangle(int a, int b, int c);
+	void AddQuad(int a, int b, int c, int d);
+	void AddDisk(float innerRadius, float outerRadius, float z, float normalZ, int slices, int loops);
+	void UploadBuffers();
+
+public:
+	GeometryCache();
+	~GeometryCache();
+
+	Handle Cube(float size);
+	Handle Torus(float innerRadius, float outerRadius, int sides, int rings);
+	Handle Cylinder(float baseRadius, float topRadius, float height, int slices, int stacks);
+	Handle Disk(float innerRadius, float outerRadius, int slices, int loops);
+	Handle Cone(float base, float height, int slices, int stacks);
+
+	void Bind();
+	void Draw(Handle primitive);
+	void Unbind();
+
+	int GetNumVertices() const { return (int)vertices.size(); }
+	int GetNumIndices() const { return (int)indices.size(); }
+
+	// The tessellation on the CPU, for drawing without GL. Indices of a primitive point
+	// into the whole vertex array, at firstVertex and up.
+	const Vertex *GetVertices() const { return &vertices[0]; }
+	const GLushort *GetIndices() const { return &indices[0]; }
+	void GetRange(Handle primitive, int &firstIndex, int &numIndices, int &firstVertex, int &numVertices) const;
+};
+
+#endif	//GEOMETRYCACHE_H
@@ -0,0 +1,322 @@
+#define GL_SILENCE_DEPRECATION
+#ifndef __APPLE__
+#define GL_GLEXT_PROTOTYPES   // glGenFramebuffers etc. are only prototyped in glext.h
+#endif
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#include <GLUT/glut.h>
+#else
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+#include <GL/glut.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+#include "Headless.h"
+
+// EGL with the surfaceless platform is a Mesa thing, only looked for on Linux
+#ifdef __linux__
+#define HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+HeadlessContext::HeadlessContext()
+{
+	width = 0;
+	height = 0;
+	display = NULL;
+	context = NULL;
+	framebuffer = 0;
+	colorBuffer = 0;
+	depthBuffer = 0;
+}
+
+HeadlessContext::~HeadlessContext()
+{
+#ifdef HEADLESS_EGL
+	if(context)
+	{
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteRenderbuffers(1, &colorBuffer);
+		glDeleteRenderbuffers(1, &depthBuffer);
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(display, context);
+	}
+	if(display)
+		eglTerminate(display);
+#endif
+}
+
+bool HeadlessContext::Create(int width, int height)
+{
+#ifdef HEADLESS_EGL
+	this->width = width;
+	this->height = height;
+
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if(!getPlatformDisplay)
+	{
+		fprintf(stderr, "Headless: EGL has no eglGetPlatformDisplayEXT\n");
+		return false;
+	}
+
+	EGLint major, minor;
+	display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	if(!display || !eglInitialize(display, &major, &minor))
+	{
+		fprintf(stderr, "Headless: no surfaceless EGL display\n");
+		display = NULL;
+		return false;
+	}
+
+	// Desktop GL, the fixed function pipeline is needed. The surfaceless platform has no
+	// window configs, and EGL_SURFACE_TYPE defaults to windows.
+	eglBindAPI(EGL_OPENGL_API);
+	const EGLint attributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if(!eglChooseConfig(display, attributes, &config, 1, &numConfigs) || numConfigs == 0)
+	{
+		fprintf(stderr, "Headless: no EGL config for desktop GL\n");
+		return false;
+	}
+
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+	if(context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+	{
+		fprintf(stderr, "Headless: could not make a GL context current\n");
+		context = NULL;
+		return false;
+	}
+
+	// The framebuffer object stands in for the window
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glGenRenderbuffers(1, &colorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		fprintf(stderr, "Headless: %d x %d framebuffer is not complete\n", width, height);
+		return false;
+	}
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glViewport(0, 0, width, height);
+	return true;
+#else
+	fprintf(stderr, "Headless: needs EGL, only built on Linux\n");
+	return false;
+#endif
+}
+
+void HeadlessContext::ReadPixels()
+{
+	const int rowSize = 3*width;
+	std::vector<unsigned char> flipped((size_t)rowSize*height);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &flipped[0]);
+
+	// GL's first row is the bottom one
+	pixels.resize(flipped.size());
+	for(int y=0; y < height; y++)
+		memcpy(&pixels[(size_t)y*rowSize], &flipped[(size_t)(height-1-y)*rowSize], rowSize);
+}
+
+bool WritePPM(const char *fileName, const unsigned char *rgb, int width, int height)
+{
+	FILE *file = fopen(fileName, "wb");
+	if(!file)
+		return false;
+
+	const size_t size = (size_t)3*width*height;
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+	const bool written = fwrite(rgb, 1, size, file) == size;
+	fclose(file);
+	return written;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//	PNG, without zlib: the image data goes in stored (uncompressed) deflate blocks.
+//	Bigger files than a real encoder makes, but nothing to link.
+//////////////////////////////////////////////////////////////////////////////////////////
+
+static unsigned int Crc32(unsigned int crc, const unsigned char *data, size_t size)
+{
+	static unsigned int table[256];
+	if(table[1] == 0)
+	{
+		for(unsigned int n=0; n < 256; n++)
+		{
+			unsigned int c = n;
+			for(int k=0; k < 8; k++)
+				c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+	}
+
+	crc = ~crc;
+	for(size_t i=0; i < size; i++)
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void PutBigEndian(std::vector<unsigned char> &out, unsigned int value)
+{
+	out.push_back((unsigned char)(value >> 24));
+	out.push_back((unsigned char)(value >> 16));
+	out.push_back((unsigned char)(value >> 8));
+	out.push_back((unsigned char)value);
+}
+
+static void PutChunk(std::vector<unsigned char> &out, const char *type, const std::vector<unsigned char> &data)
+{
+	PutBigEndian(out, (unsigned int)data.size());
+	const size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data.begin(), data.end());
+	PutBigEndian(out, Crc32(0, &out[start], out.size() - start));
+}
+
+bool WritePNG(const char *fileName, const unsigned char *rgb, int width, int height)
+{
+	std::vector<unsigned char> png;
+	const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	png.insert(png.end(), signature, signature + sizeof(signature));
+
+	// 8 bit RGB, no interlace
+	std::vector<unsigned char> header;
+	PutBigEndian(header, width);
+	PutBigEndian(header, height);
+	const unsigned char format[] = { 8, 2, 0, 0, 0 };
+	header.insert(header.end(), format, format + sizeof(format));
+	PutChunk(png, "IHDR", header);
+
+	// Every row starts with filter type 0
+	const size_t rowSize = 3*(size_t)width;
+	std::vector<unsigned char> raw;
+	raw.reserve((rowSize + 1)*height);
+	for(int y=0; y < height; y++)
+	{
+		raw.push_back(0);
+		raw.insert(raw.end(), rgb + y*rowSize, rgb + (y+1)*rowSize);
+	}
+
+	// zlib stream of stored blocks of at most 65535 bytes
+	std::vector<unsigned char> zlib;
+	zlib.push_back(0x78);
+	zlib.push_back(0x01);
+	unsigned int a = 1, b = 0;
+	for(size_t offset=0; offset < raw.size() || offset == 0; )
+	{
+		const size_t size = std::min(raw.size() - offset, (size_t)65535);
+		const bool last = offset + size == raw.size();
+		zlib.push_back(last ? 1 : 0);
+		zlib.push_back((unsigned char)size);
+		zlib.push_back((unsigned char)(size >> 8));
+		zlib.push_back((unsigned char)~size);
+		zlib.push_back((unsigned char)(~size >> 8));
+		zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+
+		for(size_t i=offset; i < offset + size; i++)
+		{
+			a = (a + raw[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+		offset += size;
+		if(last)
+			break;
+	}
+	PutBigEndian(zlib, (b << 16) | a);
+	PutChunk(png, "IDAT", zlib);
+	PutChunk(png, "IEND", std::vector<unsigned char>());
+
+	FILE *file = fopen(fileName, "wb");
+	if(!file)
+		return false;
+	const bool written = fwrite(&png[0], 1, png.size(), file) == png.size();
+	fclose(file);
+	return written;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//	Animation script
+//////////////////////////////////////////////////////////////////////////////////////////
+
+static bool ParseKey(const char *name, ScriptKey &key)
+{
+	static const struct { const char *name; int special; } specials[] = {
+		{ "up", GLUT_KEY_UP }, { "down", GLUT_KEY_DOWN }, { "left", GLUT_KEY_LEFT }, { "right", GLUT_KEY_RIGHT },
+		{ "f1", GLUT_KEY_F1 }, { "f2", GLUT_KEY_F2 }, { "f3", GLUT_KEY_F3 }, { "f4", GLUT_KEY_F4 },
+		{ "f5", GLUT_KEY_F5 }, { "f6", GLUT_KEY_F6 }, { "f7", GLUT_KEY_F7 }, { "f8", GLUT_KEY_F8 },
+		{ "f9", GLUT_KEY_F9 }, { "f10", GLUT_KEY_F10 }, { "f11", GLUT_KEY_F11 }, { "f12", GLUT_KEY_F12 }
+	};
+
+	key.key = 0;
+	key.special = -1;
+	if(strlen(name) == 1)
+	{
+		key.key = (unsigned char)name[0];
+		return true;
+	}
+	for(size_t i=0; i < sizeof(specials)/sizeof(specials[0]); i++)
+	{
+		if(strcmp(name, specials[i].name) == 0)
+		{
+			key.special = specials[i].special;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool AnimationScript::Load(const char *fileName)
+{
+	FILE *file = fopen(fileName, "r");
+	if(!file)
+	{
+		fprintf(stderr, "Script: cannot open %s\n", fileName);
+		return false;
+	}
+
+	keys.clear();
+	char line[256];
+	int lineNumber = 0;
+	bool ok = true;
+	while(fgets(line, sizeof(line), file))
+	{
+		lineNumber++;
+		char *comment = strchr(line, '#');
+		if(comment)
+			*comment = '\0';
+
+		char name[32];
+		ScriptKey key;
+		const int fields = sscanf(line, "%d %31s", &key.frame, name);
+		if(fields <= 0)
+			continue;
+		if(fields != 2 || key.frame < 0 || !ParseKey(name, key))
+		{
+			fprintf(stderr, "Script: %s:%d: expected a frame and a key\n", fileName, lineNumber);
+			ok = false;
+			break;
+		}
+		keys.push_back(key);
+	}
+	fclose(file);
+
+	std::stable_sort(keys.begin(), keys.end(), [](const ScriptKey &a, const ScriptKey &b) { return a.frame < b.frame; });
+	return ok;
+}
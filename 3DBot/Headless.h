@@ -0,0 +1,83 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	Headless.h
+//	Rendering without a window, for machines with no display. HeadlessContext makes
+//	a GL context on EGL's surfaceless platform, which Mesa's llvmpipe runs on the CPU,
+//	and binds a framebuffer object of the requested size in place of a window. Frames
+//	are read back and written as binary PPM or as PNG, WritePPM and WritePNG also take
+//	frames from elsewhere (SoftwareRenderer).
+//
+//	AnimationScript is a text file of key presses, one per line: the frame to press
+//	the key before, then the key. Keys are single characters or the arrow and function
+//	key names GLUT has (up, down, left, right, f1 ... f12). # starts a comment.
+//
+//		0 c
+//		0 w
+//		90 W
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <vector>
+
+class HeadlessContext
+{
+private:
+	int width;
+	int height;
+
+	// EGLDisplay and EGLContext, kept opaque so users need no EGL headers
+	void *display;
+	void *context;
+
+	GLuint framebuffer;
+	GLuint colorBuffer;
+	GLuint depthBuffer;
+
+	// Last frame read back, top row first, RGB
+	std::vector<unsigned char> pixels;
+
+public:
+	HeadlessContext();
+	~HeadlessContext();
+
+	// Makes a context current with a width by height framebuffer bound. Prints why and
+	// returns false where there is no EGL.
+	bool Create(int width, int height);
+
+	int GetWidth() const { return width; }
+	int GetHeight() const { return height; }
+
+	// Reads back the frame drawn since the last call
+	void ReadPixels();
+
+	const unsigned char *GetPixels() const { return &pixels[0]; }
+};
+
+// RGB bytes, top row first
+bool WritePPM(const char *fileName, const unsigned char *rgb, int width, int height);
+bool WritePNG(const char *fileName, const unsigned char *rgb, int width, int height);
+
+struct ScriptKey
+{
+	int frame;
+	unsigned char key;
+
+	// GLUT_KEY_ value for keys that go to the special key callback, otherwise -1
+	int special;
+};
+
+class AnimationScript
+{
+private:
+	std::vector<ScriptKey> keys;
+
+public:
+	// Keys come back in frame order
+	bool Load(const char *fileName);
+
+	int GetNumKeys() const { return (int)keys.size(); }
+	const ScriptKey &GetKey(int i) const { return keys[i]; }
+};
+
+#endif	//HEADLESS_H
@@ -0,0 +1,188 @@
+#include <stdlib.h>
+#include <algorithm>
+#include "JobSystem.h"
+
+// Which JobSystem thread this is, the thread that made the JobSystem is 0
+static thread_local const JobSystem *currentSystem = NULL;
+static thread_local int currentWorker = -1;
+
+JobSystem::JobSystem(int threads)
+{
+	if(threads <= 0)
+		threads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	queued = 0;
+	quit = false;
+	for(int i=0; i < threads; i++)
+		workers.push_back(new Worker());
+
+	currentSystem = this;
+	currentWorker = 0;
+	for(int i=1; i < threads; i++)
+		this->threads.push_back(std::thread(&JobSystem::WorkerLoop, this, i));
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		quit = true;
+	}
+	wake.notify_all();
+	for(size_t i=0; i < threads.size(); i++)
+		threads[i].join();
+	for(size_t i=0; i < workers.size(); i++)
+		delete workers[i];
+
+	if(currentSystem == this)
+	{
+		currentSystem = NULL;
+		currentWorker = -1;
+	}
+}
+
+int JobSystem::CurrentWorker() const
+{
+	return currentSystem == this ? currentWorker : -1;
+}
+
+// Onto the back of the calling thread's deque, other threads use the first one
+void JobSystem::Push(const Job &job)
+{
+	const int self = CurrentWorker();
+	Worker *worker = workers[self >= 0 ? self : 0];
+	{
+		std::lock_guard<std::mutex> guard(worker->lock);
+		worker->jobs.push_back(job);
+	}
+	queued++;
+
+	// Taking the lock orders this with a thread about to sleep, so the wake is not lost
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+	}
+	wake.notify_one();
+}
+
+bool JobSystem::Pop(int self, Job &job)
+{
+	Worker *worker = workers[self];
+	std::lock_guard<std::mutex> guard(worker->lock);
+	if(worker->jobs.empty())
+		return false;
+
+	job = worker->jobs.back();
+	worker->jobs.pop_back();
+	queued--;
+	return true;
+}
+
+bool JobSystem::Steal(int self, Job &job)
+{
+	const int numWorkers = (int)workers.size();
+	for(int i=1; i <= numWorkers; i++)
+	{
+		const int victim = (self + i + numWorkers) % numWorkers;
+		if(victim == self)
+			continue;
+
+		Worker *worker = workers[victim];
+		std::lock_guard<std::mutex> guard(worker->lock);
+		if(!worker->jobs.empty())
+		{
+			job = worker->jobs.front();
+			worker->jobs.pop_front();
+			queued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool JobSystem::RunOne(int self)
+{
+	Job job;
+	if((self >= 0 && Pop(self, job)) || Steal(self, job))
+	{
+		job.function();
+		Finish(job.group);
+		return true;
+	}
+	return false;
+}
+
+// The last job of a group releases the jobs that were waiting for it. The group is
+// not touched after the lock is released, Wait takes the lock before returning so the
+// group can go away as soon as it does.
+void JobSystem::Finish(JobGroup *group)
+{
+	std::vector<Job> released;
+	{
+		std::lock_guard<std::mutex> guard(group->lock);
+		if(group->pending.fetch_sub(1) == 1)
+			released.swap(group->dependents);
+	}
+	for(size_t i=0; i < released.size(); i++)
+		Push(released[i]);
+}
+
+void JobSystem::WorkerLoop(int self)
+{
+	currentSystem = this;
+	currentWorker = self;
+
+	for(;;)
+	{
+		if(RunOne(self))
+			continue;
+
+		std::unique_lock<std::mutex> guard(sleepLock);
+		wake.wait(guard, [this] { return quit || queued.load() > 0; });
+		if(quit && queued.load() == 0)
+			break;
+	}
+}
+
+void JobSystem::Submit(const std::function<void()> &function, JobGroup *group, JobGroup *after)
+{
+	group->pending++;
+	Job job = { function, group };
+
+	if(after)
+	{
+		// Checked under the lock Finish holds while it counts down, so the job is either
+		// queued on after or after has already released its dependents
+		std::lock_guard<std::mutex> guard(after->lock);
+		if(after->pending.load() > 0)
+		{
+			after->dependents.push_back(job);
+			return;
+		}
+	}
+	Push(job);
+}
+
+void JobSystem::ParallelFor(int count, int grain, const std::function<void(int, int)> &body, JobGroup *group, JobGroup *after)
+{
+	if(grain <= 0)
+		grain = count;
+
+	for(int first=0; first < count; first += grain)
+	{
+		const int n = std::min(grain, count - first);
+		Submit([body, first, n] { body(first, n); }, group, after);
+	}
+}
+
+void JobSystem::Wait(JobGroup *group)
+{
+	const int self = CurrentWorker();
+	while(!group->IsDone())
+	{
+		if(!RunOne(self))
+			std::this_thread::yield();
+	}
+
+	// Until the last Finish has let go of the group
+	std::lock_guard<std::mutex> guard(group->lock);
+}
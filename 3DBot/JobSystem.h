@@ -0,0 +1,93 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	JobSystem.h
+//	Work-stealing thread pool. Every thread has its own deque of jobs: it pushes and
+//	pops at the back, so it keeps working on what it split off last, and idle
+//	threads steal from the front of someone else's deque, taking the oldest and
+//	usually largest piece of work.
+//
+//	Jobs belong to a JobGroup, which counts the jobs not yet finished. A job can be
+//	held back until another group has finished, which is how the stages of a frame
+//	depend on each other. The thread calling Wait runs jobs too, so a JobSystem with
+//	one thread runs everything on the caller.
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobGroup;
+
+struct Job
+{
+	std::function<void()> function;
+	JobGroup *group;
+};
+
+class JobGroup
+{
+private:
+	friend class JobSystem;
+
+	std::atomic<int> pending;
+
+	// Jobs waiting for this group to finish
+	std::mutex lock;
+	std::vector<Job> dependents;
+
+public:
+	JobGroup() : pending(0) {}
+
+	bool IsDone() const { return pending.load() == 0; }
+};
+
+class JobSystem
+{
+private:
+	struct Worker
+	{
+		std::mutex lock;
+		std::deque<Job> jobs;
+	};
+
+	std::vector<Worker *> workers;
+	std::vector<std::thread> threads;
+
+	// Jobs sitting in any deque, idle threads sleep while it is 0
+	std::atomic<int> queued;
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	bool quit;
+
+	void Push(const Job &job);
+	bool Pop(int self, Job &job);
+	bool Steal(int self, Job &job);
+	bool RunOne(int self);
+	void Finish(JobGroup *group);
+	void WorkerLoop(int self);
+	int CurrentWorker() const;
+
+public:
+	// threads counts the caller, 0 for one per core
+	JobSystem(int threads = 0);
+	~JobSystem();
+
+	int GetNumThreads() const { return (int)workers.size(); }
+
+	// Queues function as part of group. With after, it is held until after is done.
+	void Submit(const std::function<void()> &function, JobGroup *group, JobGroup *after = NULL);
+
+	// body(first, count) over [0, count) in chunks of grain, one job each
+	void ParallelFor(int count, int grain, const std::function<void(int, int)> &body, JobGroup *group, JobGroup *after = NULL);
+
+	// Runs jobs until every job of group has finished
+	void Wait(JobGroup *group);
+};
+
+#endif	//JOBSYSTEM_H
@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <new>
+#include "MeshArena.h"
+
+static size_t RoundUp(size_t size)
+{
+	return (size + meshAlignment-1) & ~(meshAlignment-1);
+}
+
+// malloc only guarantees 16 bytes, so over-allocate and keep the malloc pointer just
+// in front of the aligned block
+static void *AlignedAlloc(size_t size)
+{
+	void *raw = malloc(size + meshAlignment + sizeof(void *));
+	if(!raw)
+	{
+		throw std::bad_alloc();
+	}
+	uintptr_t aligned = ((uintptr_t)raw + sizeof(void *) + meshAlignment-1) & ~(uintptr_t)(meshAlignment-1);
+	((void **)aligned)[-1] = raw;
+	return (void *)aligned;
+}
+
+static void AlignedFree(void *block)
+{
+	if(block)
+		free(((void **)block)[-1]);
+}
+
+class HeapMeshAllocator : public MeshAllocator
+{
+public:
+	void *Allocate(size_t size) { return AlignedAlloc(size); }
+	void Free(void *block, size_t) { AlignedFree(block); }
+};
+
+MeshAllocator *DefaultMeshAllocator()
+{
+	static HeapMeshAllocator allocator;
+	return &allocator;
+}
+
+
+MeshArena::MeshArena(size_t pageSize)
+{
+	this->pageSize = RoundUp(pageSize > 0 ? pageSize : meshAlignment);
+	cursor = NULL;
+	remaining = 0;
+	bytesInUse = 0;
+	bytesReserved = 0;
+}
+
+MeshArena::~MeshArena()
+{
+	for(size_t i=0; i < pages.size(); i++)
+		AlignedFree(pages[i]);
+}
+
+void *MeshArena::Allocate(size_t size)
+{
+	size = RoundUp(size > 0 ? size : 1);
+	std::lock_guard<std::mutex> guard(lock);
+
+	// Reuse a freed block of the same size first
+	std::map<size_t, std::vector<void *> >::iterator it = freeBlocks.find(size);
+	if(it != freeBlocks.end() && !it->second.empty())
+	{
+		void *block = it->second.back();
+		it->second.pop_back();
+		bytesInUse += size;
+		return block;
+	}
+
+	// Blocks larger than a page get a page of their own, the current page stays open
+	if(size > pageSize)
+	{
+		void *block = AlignedAlloc(size);
+		pages.push_back(block);
+		bytesReserved += size;
+		bytesInUse += size;
+		return block;
+	}
+
+	if(size > remaining)
+	{
+		cursor = (char *)AlignedAlloc(pageSize);
+		pages.push_back(cursor);
+		remaining = pageSize;
+		bytesReserved += pageSize;
+	}
+
+	void *block = cursor;
+	cursor += size;
+	remaining -= size;
+	bytesInUse += size;
+	return block;
+}
+
+void MeshArena::Free(void *block, size_t size)
+{
+	if(!block)
+		return;
+
+	size = RoundUp(size > 0 ? size : 1);
+	std::lock_guard<std::mutex> guard(lock);
+	freeBlocks[size].push_back(block);
+	bytesInUse -= size;
+}
@@ -0,0 +1,66 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	MeshArena.h
+//	Storage for QuadMesh arrays. Every block is 64-byte aligned so SIMD loads never
+//	straddle a cache line at the start of an array.
+//
+//	MeshAllocator is the interface a mesh allocates through. Without one, meshes use
+//	the aligned heap allocator below. A MeshArena can be shared by many meshes: it
+//	carves blocks out of large pages and keeps freed blocks on per-size free lists,
+//	so meshes rebuilt or resized to a size seen before do not touch the heap at all.
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MESHARENA_H
+#define MESHARENA_H
+
+#include <stddef.h>
+#include <map>
+#include <mutex>
+#include <vector>
+
+static const size_t meshAlignment = 64;
+
+class MeshAllocator
+{
+public:
+	virtual ~MeshAllocator() {}
+
+	// size bytes, 64-byte aligned. Throws std::bad_alloc like new.
+	virtual void *Allocate(size_t size) = 0;
+
+	// size must be the size the block was allocated with
+	virtual void Free(void *block, size_t size) = 0;
+};
+
+// Aligned blocks straight from the heap, shared by every mesh without an arena
+MeshAllocator *DefaultMeshAllocator();
+
+class MeshArena : public MeshAllocator
+{
+private:
+	size_t pageSize;
+	std::vector<void *> pages;
+	char *cursor;
+	size_t remaining;
+
+	// Freed blocks by size, rounded up to the alignment
+	std::map<size_t, std::vector<void *> > freeBlocks;
+
+	size_t bytesInUse;
+	size_t bytesReserved;
+
+	// Meshes sharing the arena may be built on different threads
+	std::mutex lock;
+
+public:
+	MeshArena(size_t pageSize = 4 << 20);
+	~MeshArena();
+
+	void *Allocate(size_t size);
+	void Free(void *block, size_t size);
+
+	// Bytes handed out and not freed, and bytes taken from the heap
+	size_t GetBytesInUse() const { return bytesInUse; }
+	size_t GetBytesReserved() const { return bytesReserved; }
+};
+
+#endif	//MESHARENA_H
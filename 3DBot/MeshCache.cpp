@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "MeshCache.h"
+
+#if defined(__APPLE__) || defined(__unix__)
+#define MESH_CACHE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Header fields and their byte offsets
+//	0	magic "QMSH"
+//	4	version
+//	8	parameter checksum
+//	16	meshSize
+//	20	numVertices
+//	24	vertexStride
+//	28	numIndices
+//	32	indexSize
+//	40	vertex block offset
+//	48	index block offset
+//	56	total file size
+static const size_t headerSize = 64;
+static const size_t blockAlignment = 64;
+
+uint64_t MeshCacheHash(uint64_t hash, const void *data, size_t size)
+{
+	const unsigned char *bytes = (const unsigned char *)data;
+	for(size_t i=0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// Vertex and index blocks are stored as raw host data, so only little-endian hosts
+// can use the cache
+static bool HostIsLittleEndian()
+{
+	const uint16_t one = 1;
+	return *(const unsigned char *)&one == 1;
+}
+
+static void PutU32(unsigned char *p, uint32_t v)
+{
+	for(int i=0; i < 4; i++)
+		p[i] = (unsigned char)(v >> (8*i));
+}
+
+static void PutU64(unsigned char *p, uint64_t v)
+{
+	for(int i=0; i < 8; i++)
+		p[i] = (unsigned char)(v >> (8*i));
+}
+
+static uint32_t GetU32(const unsigned char *p)
+{
+	uint32_t v = 0;
+	for(int i=3; i >= 0; i--)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+static uint64_t GetU64(const unsigned char *p)
+{
+	uint64_t v = 0;
+	for(int i=7; i >= 0; i--)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+static size_t AlignUp(size_t offset)
+{
+	return (offset + blockAlignment-1) & ~(blockAlignment-1);
+}
+
+#ifdef MESH_CACHE_MMAP
+
+bool MapMeshCache(const char *path, uint64_t paramsHash, int vertexStride, int indexSize, MeshCacheView &view)
+{
+	memset(&view, 0, sizeof(view));
+	if(!path || !HostIsLittleEndian())
+		return false;
+
+	int fd = open(path, O_RDONLY);
+	if(fd < 0)
+		return false;
+
+	struct stat st;
+	if(fstat(fd, &st) != 0 || (size_t)st.st_size < headerSize)
+	{
+		close(fd);
+		return false;
+	}
+
+	const size_t size = (size_t)st.st_size;
+	void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(base == MAP_FAILED)
+		return false;
+
+	const unsigned char *header = (const unsigned char *)base;
+	const uint32_t numVertices = GetU32(header+20);
+	const uint32_t numIndices = GetU32(header+28);
+	const uint64_t vertexOffset = GetU64(header+40);
+	const uint64_t indexOffset = GetU64(header+48);
+
+	bool valid = memcmp(header, "QMSH", 4) == 0
+		&& GetU32(header+4) == meshCacheVersion
+		&& GetU64(header+8) == paramsHash
+		&& GetU32(header+24) == (uint32_t)vertexStride
+		&& GetU32(header+32) == (uint32_t)indexSize
+		&& GetU64(header+56) == size
+		&& vertexOffset >= headerSize && vertexOffset + (uint64_t)numVertices*vertexStride <= indexOffset
+		&& indexOffset + (uint64_t)numIndices*indexSize <= size;
+	if(!valid)
+	{
+		munmap(base, size);
+		return false;
+	}
+
+	view.base = base;
+	view.size = size;
+	view.vertices = (unsigned char *)base + vertexOffset;
+	view.indices = (unsigned char *)base + indexOffset;
+	view.meshSize = (int)GetU32(header+16);
+	view.numVertices = (int)numVertices;
+	view.numIndices = (int)numIndices;
+	return true;
+}
+
+void UnmapMeshCache(MeshCacheView &view)
+{
+	if(view.base)
+		munmap(view.base, view.size);
+	memset(&view, 0, sizeof(view));
+}
+
+#else
+
+bool MapMeshCache(const char *path, uint64_t paramsHash, int vertexStride, int indexSize, MeshCacheView &view)
+{
+	memset(&view, 0, sizeof(view));
+	return false;
+}
+
+void UnmapMeshCache(MeshCacheView &view)
+{
+	memset(&view, 0, sizeof(view));
+}
+
+#endif
+
+bool WriteMeshCache(const char *path, uint64_t paramsHash, int meshSize,
+	const void *vertices, int numVertices, int vertexStride,
+	const void *indices, int numIndices, int indexSize)
+{
+	if(!path || !HostIsLittleEndian())
+		return false;
+
+	const size_t vertexOffset = AlignUp(headerSize);
+	const size_t indexOffset = AlignUp(vertexOffset + (size_t)numVertices*vertexStride);
+	const size_t size = indexOffset + (size_t)numIndices*indexSize;
+
+	unsigned char header[headerSize];
+	memset(header, 0, sizeof(header));
+	memcpy(header, "QMSH", 4);
+	PutU32(header+4, meshCacheVersion);
+	PutU64(header+8, paramsHash);
+	PutU32(header+16, (uint32_t)meshSize);
+	PutU32(header+20, (uint32_t)numVertices);
+	PutU32(header+24, (uint32_t)vertexStride);
+	PutU32(header+28, (uint32_t)numIndices);
+	PutU32(header+32, (uint32_t)indexSize);
+	PutU64(header+40, vertexOffset);
+	PutU64(header+48, indexOffset);
+	PutU64(header+56, size);
+
+	char tempPath[1024];
+	if(snprintf(tempPath, sizeof(tempPath), "%s.tmp", path) >= (int)sizeof(tempPath))
+		return false;
+
+	FILE *file = fopen(tempPath, "wb");
+	if(!file)
+		return false;
+
+	static const unsigned char padding[blockAlignment] = { 0 };
+	bool ok = fwrite(header, 1, headerSize, file) == headerSize
+		&& fwrite(padding, 1, vertexOffset - headerSize, file) == vertexOffset - headerSize
+		&& fwrite(vertices, vertexStride, numVertices, file) == (size_t)numVertices
+		&& fwrite(padding, 1, indexOffset - vertexOffset - (size_t)numVertices*vertexStride, file) == indexOffset - vertexOffset - (size_t)numVertices*vertexStride
+		&& fwrite(indices, indexSize, numIndices, file) == (size_t)numIndices;
+	ok = (fclose(file) == 0) && ok;
+
+	if(!ok || rename(tempPath, path) != 0)
+	{
+		remove(tempPath);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,47 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	MeshCache.h
+//	Binary cache file for generated meshes, mapped into memory so a mesh can be drawn
+//	straight from the file instead of being regenerated on every launch.
+//
+//	Layout, all fields little-endian:
+//		header		64 bytes, see MeshCacheHeader in MeshCache.cpp
+//		vertices	numVertices * vertexStride bytes, 64-byte aligned
+//		indices		numIndices * indexSize bytes, 64-byte aligned
+//	The header holds a checksum of the generation parameters. A file whose checksum,
+//	version or layout does not match is ignored and rewritten.
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+static const uint32_t meshCacheVersion = 1;
+
+// Mapped cache file. The mapping is private copy-on-write, so the vertices may be
+// edited in place without touching the file.
+struct MeshCacheView
+{
+	void *base;
+	size_t size;
+	void *vertices;
+	void *indices;
+	int meshSize;
+	int numVertices;
+	int numIndices;
+};
+
+// FNV-1a, chain calls to hash several parameters
+uint64_t MeshCacheHash(uint64_t hash, const void *data, size_t size);
+static const uint64_t meshCacheHashSeed = 14695981039346656037ULL;
+
+bool MapMeshCache(const char *path, uint64_t paramsHash, int vertexStride, int indexSize, MeshCacheView &view);
+void UnmapMeshCache(MeshCacheView &view);
+
+// Written to a temporary file and renamed over path so readers never see half a file
+bool WriteMeshCache(const char *path, uint64_t paramsHash, int meshSize,
+	const void *vertices, int numVertices, int vertexStride,
+	const void *indices, int numIndices, int indexSize);
+
+#endif	//MESHCACHE_H
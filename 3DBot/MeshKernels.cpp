@@ -0,0 +1,320 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "MeshKernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MESH_KERNELS_SSE
+#include <immintrin.h>
+#endif
+
+// AVX2 code is compiled per function with a target attribute so the rest of the
+// program still runs on CPUs without it
+#if defined(MESH_KERNELS_SSE) && (defined(__GNUC__) || defined(__clang__))
+#define MESH_KERNELS_AVX2
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+//------------------------------------------------------------------------------------------------------
+// Scalar reference
+
+static void GridRowScalar(float ox, float oy, float oz, float dx, float dy, float dz, int count,
+	float *x, float *y, float *z)
+{
+	for(int j=0; j < count; j++)
+	{
+		x[j] = ox + j*dx;
+		y[j] = oy + j*dy;
+		z[j] = oz + j*dz;
+	}
+}
+
+// Half the cross product of the quad diagonals (p11-p00) x (p10-p01) for quads
+// [kBegin, kEnd) of quad row j
+static void FaceRowScalar(const GridSoA &grid, int j, int kBegin, int kEnd)
+{
+	const int v0 = j*grid.VertexPitch();
+	const int v1 = v0 + grid.VertexPitch();
+	const int f = (j+1)*grid.FacePitch() + 1;
+
+	for(int k=kBegin; k < kEnd; k++)
+	{
+		float d0x = grid.px[v1+k+1] - grid.px[v0+k];
+		float d0y = grid.py[v1+k+1] - grid.py[v0+k];
+		float d0z = grid.pz[v1+k+1] - grid.pz[v0+k];
+		float d1x = grid.px[v1+k] - grid.px[v0+k+1];
+		float d1y = grid.py[v1+k] - grid.py[v0+k+1];
+		float d1z = grid.pz[v1+k] - grid.pz[v0+k+1];
+
+		grid.fx[f+k] = 0.5f*(d0y*d1z - d0z*d1y);
+		grid.fy[f+k] = 0.5f*(d0z*d1x - d0x*d1z);
+		grid.fz[f+k] = 0.5f*(d0x*d1y - d0y*d1x);
+	}
+}
+
+// Vertex (j,k) sums padded faces (j,k), (j,k+1), (j+1,k) and (j+1,k+1)
+static void GatherRowScalar(const GridSoA &grid, int j, int kBegin, int kEnd)
+{
+	const int f0 = j*grid.FacePitch();
+	const int f1 = f0 + grid.FacePitch();
+	const int v = j*grid.VertexPitch();
+
+	for(int k=kBegin; k < kEnd; k++)
+	{
+		float x = grid.fx[f0+k] + grid.fx[f0+k+1] + grid.fx[f1+k] + grid.fx[f1+k+1];
+		float y = grid.fy[f0+k] + grid.fy[f0+k+1] + grid.fy[f1+k] + grid.fy[f1+k+1];
+		float z = grid.fz[f0+k] + grid.fz[f0+k+1] + grid.fz[f1+k] + grid.fz[f1+k+1];
+
+		const float norm = sqrtf(x*x + y*y + z*z);
+		if(norm > 0)
+		{
+			x /= norm; y /= norm; z /= norm;
+		}
+		grid.nx[v+k] = x;
+		grid.ny[v+k] = y;
+		grid.nz[v+k] = z;
+	}
+}
+
+static void FaceNormalsScalar(const GridSoA &grid, int rowBegin, int rowEnd, int colBegin, int colEnd)
+{
+	for(int j=rowBegin; j < rowEnd; j++)
+		FaceRowScalar(grid, j, colBegin, colEnd);
+}
+
+static void GatherNormalsScalar(const GridSoA &grid, int rowBegin, int rowEnd, int colBegin, int colEnd)
+{
+	for(int j=rowBegin; j < rowEnd; j++)
+		GatherRowScalar(grid, j, colBegin, colEnd);
+}
+
+static const MeshKernels scalarKernels = { "scalar", GridRowScalar, FaceNormalsScalar, GatherNormalsScalar };
+
+//------------------------------------------------------------------------------------------------------
+// SSE, 4 vertices per iteration
+
+#ifdef MESH_KERNELS_SSE
+
+// 1/sqrt(len2) from the ~12 bit estimate refined by one Newton-Raphson step,
+// zero length vectors get a zero factor
+static inline __m128 ReciprocalLengthSSE(__m128 len2)
+{
+	const __m128 nonZero = _mm_cmpgt_ps(len2, _mm_setzero_ps());
+	__m128 r = _mm_rsqrt_ps(_mm_max_ps(len2, _mm_set1_ps(1e-30f)));
+	r = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), r), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_mul_ps(len2, _mm_mul_ps(r, r))));
+	return _mm_and_ps(r, nonZero);
+}
+
+static void GridRowSSE(float ox, float oy, float oz, float dx, float dy, float dz, int count,
+	float *x, float *y, float *z)
+{
+	const __m128 vox = _mm_set1_ps(ox), voy = _mm_set1_ps(oy), voz = _mm_set1_ps(oz);
+	const __m128 vdx = _mm_set1_ps(dx), vdy = _mm_set1_ps(dy), vdz = _mm_set1_ps(dz);
+	__m128 jv = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+
+	int j=0;
+	for(; j+4 <= count; j+=4)
+	{
+		_mm_storeu_ps(x+j, _mm_add_ps(vox, _mm_mul_ps(jv, vdx)));
+		_mm_storeu_ps(y+j, _mm_add_ps(voy, _mm_mul_ps(jv, vdy)));
+		_mm_storeu_ps(z+j, _mm_add_ps(voz, _mm_mul_ps(jv, vdz)));
+		jv = _mm_add_ps(jv, _mm_set1_ps(4.0f));
+	}
+	GridRowScalar(ox + j*dx, oy + j*dy, oz + j*dz, dx, dy, dz, count-j, x+j, y+j, z+j);
+}
+
+static void FaceNormalsSSE(const GridSoA &grid, int rowBegin, int rowEnd, int colBegin, int colEnd)
+{
+	const __m128 half = _mm_set1_ps(0.5f);
+
+	for(int j=rowBegin; j < rowEnd; j++)
+	{
+		const int v0 = j*grid.VertexPitch();
+		const int v1 = v0 + grid.VertexPitch();
+		const int f = (j+1)*grid.FacePitch() + 1;
+
+		int k=colBegin;
+		for(; k+4 <= colEnd; k+=4)
+		{
+			__m128 d0x = _mm_sub_ps(_mm_loadu_ps(grid.px+v1+k+1), _mm_loadu_ps(grid.px+v0+k));
+			__m128 d0y = _mm_sub_ps(_mm_loadu_ps(grid.py+v1+k+1), _mm_loadu_ps(grid.py+v0+k));
+			__m128 d0z = _mm_sub_ps(_mm_loadu_ps(grid.pz+v1+k+1), _mm_loadu_ps(grid.pz+v0+k));
+			__m128 d1x = _mm_sub_ps(_mm_loadu_ps(grid.px+v1+k), _mm_loadu_ps(grid.px+v0+k+1));
+			__m128 d1y = _mm_sub_ps(_mm_loadu_ps(grid.py+v1+k), _mm_loadu_ps(grid.py+v0+k+1));
+			__m128 d1z = _mm_sub_ps(_mm_loadu_ps(grid.pz+v1+k), _mm_loadu_ps(grid.pz+v0+k+1));
+
+			_mm_storeu_ps(grid.fx+f+k, _mm_mul_ps(half, _mm_sub_ps(_mm_mul_ps(d0y, d1z), _mm_mul_ps(d0z, d1y))));
+			_mm_storeu_ps(grid.fy+f+k, _mm_mul_ps(half, _mm_sub_ps(_mm_mul_ps(d0z, d1x), _mm_mul_ps(d0x, d1z))));
+			_mm_storeu_ps(grid.fz+f+k, _mm_mul_ps(half, _mm_sub_ps(_mm_mul_ps(d0x, d1y), _mm_mul_ps(d0y, d1x))));
+		}
+		FaceRowScalar(grid, j, k, colEnd);
+	}
+}
+
+static void GatherNormalsSSE(const GridSoA &grid, int rowBegin, int rowEnd, int colBegin, int colEnd)
+{
+	for(int j=rowBegin; j < rowEnd; j++)
+	{
+		const int f0 = j*grid.FacePitch();
+		const int f1 = f0 + grid.FacePitch();
+		const int v = j*grid.VertexPitch();
+
+		int k=colBegin;
+		for(; k+4 <= colEnd; k+=4)
+		{
+			__m128 x = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(grid.fx+f0+k), _mm_loadu_ps(grid.fx+f0+k+1)),
+				_mm_add_ps(_mm_loadu_ps(grid.fx+f1+k), _mm_loadu_ps(grid.fx+f1+k+1)));
+			__m128 y = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(grid.fy+f0+k), _mm_loadu_ps(grid.fy+f0+k+1)),
+				_mm_add_ps(_mm_loadu_ps(grid.fy+f1+k), _mm_loadu_ps(grid.fy+f1+k+1)));
+			__m128 z = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(grid.fz+f0+k), _mm_loadu_ps(grid.fz+f0+k+1)),
+				_mm_add_ps(_mm_loadu_ps(grid.fz+f1+k), _mm_loadu_ps(grid.fz+f1+k+1)));
+
+			__m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+			__m128 r = ReciprocalLengthSSE(len2);
+			_mm_storeu_ps(grid.nx+v+k, _mm_mul_ps(x, r));
+			_mm_storeu_ps(grid.ny+v+k, _mm_mul_ps(y, r));
+			_mm_storeu_ps(grid.nz+v+k, _mm_mul_ps(z, r));
+		}
+		GatherRowScalar(grid, j, k, colEnd);
+	}
+}
+
+static const MeshKernels sseKernels = { "sse", GridRowSSE, FaceNormalsSSE, GatherNormalsSSE };
+
+#endif
+
+//------------------------------------------------------------------------------------------------------
+// AVX2, 8 vertices per iteration. GCC leaves the upper halves of the ymm registers
+// dirty on leaving the normal kernels, which slows every SSE instruction after them
+// (libm's included) until the next vzeroupper, so they clear them themselves.
+
+#ifdef MESH_KERNELS_AVX2
+
+TARGET_AVX2 static inline __m256 ReciprocalLengthAVX2(__m256 len2)
+{
+	const __m256 nonZero = _mm256_cmp_ps(len2, _mm256_setzero_ps(), _CMP_GT_OQ);
+	__m256 r = _mm256_rsqrt_ps(_mm256_max_ps(len2, _mm256_set1_ps(1e-30f)));
+	r = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), r), _mm256_sub_ps(_mm256_set1_ps(3.0f), _mm256_mul_ps(len2, _mm256_mul_ps(r, r))));
+	return _mm256_and_ps(r, nonZero);
+}
+
+TARGET_AVX2 static void GridRowAVX2(float ox, float oy, float oz, float dx, float dy, float dz, int count,
+	float *x, float *y, float *z)
+{
+	const __m256 vox = _mm256_set1_ps(ox), voy = _mm256_set1_ps(oy), voz = _mm256_set1_ps(oz);
+	const __m256 vdx = _mm256_set1_ps(dx), vdy = _mm256_set1_ps(dy), vdz = _mm256_set1_ps(dz);
+	__m256 jv = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+
+	int j=0;
+	for(; j+8 <= count; j+=8)
+	{
+		_mm256_storeu_ps(x+j, _mm256_add_ps(vox, _mm256_mul_ps(jv, vdx)));
+		_mm256_storeu_ps(y+j, _mm256_add_ps(voy, _mm256_mul_ps(jv, vdy)));
+		_mm256_storeu_ps(z+j, _mm256_add_ps(voz, _mm256_mul_ps(jv, vdz)));
+		jv = _mm256_add_ps(jv, _mm256_set1_ps(8.0f));
+	}
+	GridRowScalar(ox + j*dx, oy + j*dy, oz + j*dz, dx, dy, dz, count-j, x+j, y+j, z+j);
+}
+
+TARGET_AVX2 static void FaceNormalsAVX2(const GridSoA &grid, int rowBegin, int rowEnd, int colBegin, int colEnd)
+{
+	const __m256 half = _mm256_set1_ps(0.5f);
+
+	for(int j=rowBegin; j < rowEnd; j++)
+	{
+		const int v0 = j*grid.VertexPitch();
+		const int v1 = v0 + grid.VertexPitch();
+		const int f = (j+1)*grid.FacePitch() + 1;
+
+		int k=colBegin;
+		for(; k+8 <= colEnd; k+=8)
+		{
+			__m256 d0x = _mm256_sub_ps(_mm256_loadu_ps(grid.px+v1+k+1), _mm256_loadu_ps(grid.px+v0+k));
+			__m256 d0y = _mm256_sub_ps(_mm256_loadu_ps(grid.py+v1+k+1), _mm256_loadu_ps(grid.py+v0+k));
+			__m256 d0z = _mm256_sub_ps(_mm256_loadu_ps(grid.pz+v1+k+1), _mm256_loadu_ps(grid.pz+v0+k));
+			__m256 d1x = _mm256_sub_ps(_mm256_loadu_ps(grid.px+v1+k), _mm256_loadu_ps(grid.px+v0+k+1));
+			__m256 d1y = _mm256_sub_ps(_mm256_loadu_ps(grid.py+v1+k), _mm256_loadu_ps(grid.py+v0+k+1));
+			__m256 d1z = _mm256_sub_ps(_mm256_loadu_ps(grid.pz+v1+k), _mm256_loadu_ps(grid.pz+v0+k+1));
+
+			_mm256_storeu_ps(grid.fx+f+k, _mm256_mul_ps(half, _mm256_sub_ps(_mm256_mul_ps(d0y, d1z), _mm256_mul_ps(d0z, d1y))));
+			_mm256_storeu_ps(grid.fy+f+k, _mm256_mul_ps(half, _mm256_sub_ps(_mm256_mul_ps(d0z, d1x), _mm256_mul_ps(d0x, d1z))));
+			_mm256_storeu_ps(grid.fz+f+k, _mm256_mul_ps(half, _mm256_sub_ps(_mm256_mul_ps(d0x, d1y), _mm256_mul_ps(d0y, d1x))));
+		}
+		_mm256_zeroupper();
+		FaceRowScalar(grid, j, k, colEnd);
+	}
+}
+
+TARGET_AVX2 static void GatherNormalsAVX2(const GridSoA &grid, int rowBegin, int rowEnd, int colBegin, int colEnd)
+{
+	for(int j=rowBegin; j < rowEnd; j++)
+	{
+		const int f0 = j*grid.FacePitch();
+		const int f1 = f0 + grid.FacePitch();
+		const int v = j*grid.VertexPitch();
+
+		int k=colBegin;
+		for(; k+8 <= colEnd; k+=8)
+		{
+			__m256 x = _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(grid.fx+f0+k), _mm256_loadu_ps(grid.fx+f0+k+1)),
+				_mm256_add_ps(_mm256_loadu_ps(grid.fx+f1+k), _mm256_loadu_ps(grid.fx+f1+k+1)));
+			__m256 y = _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(grid.fy+f0+k), _mm256_loadu_ps(grid.fy+f0+k+1)),
+				_mm256_add_ps(_mm256_loadu_ps(grid.fy+f1+k), _mm256_loadu_ps(grid.fy+f1+k+1)));
+			__m256 z = _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(grid.fz+f0+k), _mm256_loadu_ps(grid.fz+f0+k+1)),
+				_mm256_add_ps(_mm256_loadu_ps(grid.fz+f1+k), _mm256_loadu_ps(grid.fz+f1+k+1)));
+
+			__m256 len2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+			__m256 r = ReciprocalLengthAVX2(len2);
+			_mm256_storeu_ps(grid.nx+v+k, _mm256_mul_ps(x, r));
+			_mm256_storeu_ps(grid.ny+v+k, _mm256_mul_ps(y, r));
+			_mm256_storeu_ps(grid.nz+v+k, _mm256_mul_ps(z, r));
+		}
+		_mm256_zeroupper();
+		GatherRowScalar(grid, j, k, colEnd);
+	}
+}
+
+static const MeshKernels avx2Kernels = { "avx2", GridRowAVX2, FaceNormalsAVX2, GatherNormalsAVX2 };
+
+static bool CpuHasAVX2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+//------------------------------------------------------------------------------------------------------
+
+const MeshKernels *FindMeshKernels(const char *name)
+{
+	if(strcmp(name, scalarKernels.name) == 0)
+		return &scalarKernels;
+#ifdef MESH_KERNELS_SSE
+	if(strcmp(name, sseKernels.name) == 0)
+		return &sseKernels;
+#endif
+#ifdef MESH_KERNELS_AVX2
+	if(strcmp(name, avx2Kernels.name) == 0 && CpuHasAVX2())
+		return &avx2Kernels;
+#endif
+	return NULL;
+}
+
+static const MeshKernels *DetectMeshKernels()
+{
+	const char *preferred[] = { "avx2", "sse" };
+	for(int i=0; i < 2; i++)
+	{
+		const MeshKernels *kernels = FindMeshKernels(preferred[i]);
+		if(kernels)
+			return kernels;
+	}
+	return &scalarKernels;
+}
+
+const MeshKernels *SelectMeshKernels()
+{
+	static const MeshKernels *selected = DetectMeshKernels();
+	return selected;
+}
@@ -0,0 +1,49 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	MeshKernels.h
+//	Inner loops of QuadMesh grid generation and normal computation, working on a
+//	structure-of-arrays copy of the grid. A scalar reference implementation is always
+//	available, SSE and AVX2 versions are picked at runtime when the CPU supports them.
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MESHKERNELS_H
+#define MESHKERNELS_H
+
+// Structure-of-arrays view of a (size+1)*(size+1) vertex grid
+struct GridSoA
+{
+	int size;		// quads per side
+
+	// vertex positions and normals, rows of size+1
+	float *px, *py, *pz;
+	float *nx, *ny, *nz;
+
+	// area weighted face normals, rows of size+2 with a zero border so every
+	// vertex can sum its four surrounding faces without bounds checks
+	float *fx, *fy, *fz;
+
+	int VertexPitch() const { return size+1; }
+	int FacePitch() const { return size+2; }
+};
+
+struct MeshKernels
+{
+	const char *name;
+
+	// x[j] = ox + j*dx (and y, z) for j in [0, count)
+	void (*GridRow)(float ox, float oy, float oz, float dx, float dy, float dz, int count,
+		float *x, float *y, float *z);
+
+	// Face normals for quads in rows [rowBegin, rowEnd), columns [colBegin, colEnd)
+	void (*FaceNormals)(const GridSoA &grid, int rowBegin, int rowEnd, int colBegin, int colEnd);
+
+	// Normalized vertex normals for vertices in rows [rowBegin, rowEnd), columns [colBegin, colEnd)
+	void (*GatherNormals)(const GridSoA &grid, int rowBegin, int rowEnd, int colBegin, int colEnd);
+};
+
+// Kernels by name ("scalar", "sse", "avx2"), NULL if not supported on this CPU
+const MeshKernels *FindMeshKernels(const char *name);
+
+// Fastest kernels supported on this CPU
+const MeshKernels *SelectMeshKernels();
+
+#endif	//MESHKERNELS_H
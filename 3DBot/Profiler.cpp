@@ -0,0 +1,279 @@
+#define GL_SILENCE_DEPRECATION
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#include <GLUT/glut.h>
+#else
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+#include <GL/glut.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include "Profiler.h"
+
+std::atomic<long long> Profiler::counters[numProfileCounters];
+
+static const char *counterNames[numProfileCounters] = { "draw calls", "vertices", "material changes" };
+
+struct ProfileEvent
+{
+	const char *name;
+	long long start;
+	long long end;
+};
+
+// Written only by its thread. written is published after the event, EndFrame reads up
+// to it. A thread recording more than capacity events in a frame loses the oldest.
+struct ThreadEvents
+{
+	static const int capacity = 1 << 14;
+
+	int thread;
+	ProfileEvent events[capacity];
+	std::atomic<long long> written;
+
+	// Up to where EndFrame has summed, only touched by the thread calling EndFrame
+	long long consumed;
+};
+
+// Rolling window of one value per frame
+struct FrameHistory
+{
+	const char *name;
+	double values[Profiler::windowFrames];
+
+	void Get(int frames, ProfileStat &stat) const
+	{
+		const int count = std::min(frames, (int)Profiler::windowFrames);
+		std::vector<double> sorted(values, values + count);
+		std::sort(sorted.begin(), sorted.end());
+
+		double sum = 0.0;
+		for(int i=0; i < count; i++)
+			sum += sorted[i];
+		stat.name = name;
+		stat.average = count > 0 ? sum / count : 0.0;
+		// Nearest rank, the largest value below 100 frames
+		stat.p99 = count > 0 ? sorted[(count*99 + 99)/100 - 1] : 0.0;
+	}
+};
+
+// Counter totals of a past frame, for the trace
+struct CounterFrame
+{
+	long long time;
+	long long values[numProfileCounters];
+};
+
+static std::mutex threadsLock;
+static std::vector<ThreadEvents *> threads;
+static thread_local ThreadEvents *threadEvents = NULL;
+
+static int frames = 0;
+static std::vector<FrameHistory> zoneHistory;
+static FrameHistory counterHistory[numProfileCounters];
+static std::vector<double> frameZoneTimes;
+static std::vector<CounterFrame> counterFrames;
+static const int maxCounterFrames = 4096;
+static long long epoch = Profiler::Now();
+
+long long Profiler::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::Record(const char *name, long long start, long long end)
+{
+	if(!threadEvents)
+	{
+		threadEvents = new ThreadEvents();
+		threadEvents->written = 0;
+		threadEvents->consumed = 0;
+
+		std::lock_guard<std::mutex> guard(threadsLock);
+		threadEvents->thread = (int)threads.size();
+		threads.push_back(threadEvents);
+	}
+
+	const long long n = threadEvents->written.load(std::memory_order_relaxed);
+	ProfileEvent &event = threadEvents->events[n % ThreadEvents::capacity];
+	event.name = name;
+	event.start = start;
+	event.end = end;
+	threadEvents->written.store(n + 1, std::memory_order_release);
+}
+
+static int FindZone(const char *name)
+{
+	for(size_t i=0; i < zoneHistory.size(); i++)
+	{
+		if(zoneHistory[i].name == name || strcmp(zoneHistory[i].name, name) == 0)
+			return (int)i;
+	}
+
+	FrameHistory history;
+	history.name = name;
+	memset(history.values, 0, sizeof(history.values));
+	zoneHistory.push_back(history);
+	frameZoneTimes.push_back(0.0);
+	return (int)zoneHistory.size()-1;
+}
+
+void Profiler::EndFrame()
+{
+	std::vector<ThreadEvents *> snapshot;
+	{
+		std::lock_guard<std::mutex> guard(threadsLock);
+		snapshot = threads;
+	}
+
+	std::fill(frameZoneTimes.begin(), frameZoneTimes.end(), 0.0);
+	for(size_t t=0; t < snapshot.size(); t++)
+	{
+		ThreadEvents *thread = snapshot[t];
+		const long long written = thread->written.load(std::memory_order_acquire);
+		for(long long n=std::max(thread->consumed, written - ThreadEvents::capacity); n < written; n++)
+		{
+			const ProfileEvent &event = thread->events[n % ThreadEvents::capacity];
+			const int zone = FindZone(event.name);
+			frameZoneTimes[zone] += (event.end - event.start) / 1.0e6;
+		}
+		thread->consumed = written;
+	}
+
+	const int slot = frames % windowFrames;
+	for(size_t z=0; z < zoneHistory.size(); z++)
+		zoneHistory[z].values[slot] = frameZoneTimes[z];
+
+	CounterFrame counterFrame;
+	counterFrame.time = Now();
+	for(int c=0; c < numProfileCounters; c++)
+	{
+		counterFrame.values[c] = counters[c].exchange(0, std::memory_order_relaxed);
+		counterHistory[c].name = counterNames[c];
+		counterHistory[c].values[slot] = (double)counterFrame.values[c];
+	}
+	if((int)counterFrames.size() == maxCounterFrames)
+		counterFrames.erase(counterFrames.begin());
+	counterFrames.push_back(counterFrame);
+
+	frames++;
+}
+
+int Profiler::GetFrames()
+{
+	return frames;
+}
+
+void Profiler::GetZoneStats(std::vector<ProfileStat> &stats)
+{
+	stats.resize(zoneHistory.size());
+	for(size_t z=0; z < zoneHistory.size(); z++)
+		zoneHistory[z].Get(frames, stats[z]);
+}
+
+void Profiler::GetCounterStats(std::vector<ProfileStat> &stats)
+{
+	stats.resize(numProfileCounters);
+	for(int c=0; c < numProfileCounters; c++)
+	{
+		counterHistory[c].name = counterNames[c];
+		counterHistory[c].Get(frames, stats[c]);
+	}
+}
+
+static void DrawText(int x, int y, const char *text)
+{
+	glRasterPos2i(x, y);
+	for(const char *c=text; *c; c++)
+		glutBitmapCharacter(GLUT_BITMAP_8_BY_13, *c);
+}
+
+void Profiler::DrawOverlay(int width, int height)
+{
+	std::vector<ProfileStat> zones, counts;
+	GetZoneStats(zones);
+	GetCounterStats(counts);
+
+	glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_DEPTH_TEST);
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glOrtho(0.0, width, 0.0, height, -1.0, 1.0);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	char line[128];
+	int y = height - 16;
+	glColor3f(1.0f, 1.0f, 1.0f);
+	snprintf(line, sizeof(line), "%-24s %9s %9s", PROFILER_ENABLED ? "zone (ms)" : "profiling compiled out", "avg", "p99");
+	DrawText(8, y, line);
+	for(size_t i=0; i < zones.size(); i++)
+	{
+		y -= 14;
+		snprintf(line, sizeof(line), "%-24.24s %9.3f %9.3f", zones[i].name, zones[i].average, zones[i].p99);
+		DrawText(8, y, line);
+	}
+	y -= 6;
+	for(size_t i=0; i < counts.size(); i++)
+	{
+		y -= 14;
+		snprintf(line, sizeof(line), "%-24.24s %9.0f %9.0f", counts[i].name, counts[i].average, counts[i].p99);
+		DrawText(8, y, line);
+	}
+
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopAttrib();
+}
+
+// Complete events ("X") per zone and a counter event ("C") per frame, in microseconds
+bool Profiler::WriteChromeTrace(const char *fileName)
+{
+	FILE *file = fopen(fileName, "w");
+	if(!file)
+		return false;
+
+	std::vector<ThreadEvents *> snapshot;
+	{
+		std::lock_guard<std::mutex> guard(threadsLock);
+		snapshot = threads;
+	}
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	bool first = true;
+	for(size_t t=0; t < snapshot.size(); t++)
+	{
+		const ThreadEvents *thread = snapshot[t];
+		const long long written = thread->written.load(std::memory_order_acquire);
+		for(long long n=std::max(0LL, written - ThreadEvents::capacity); n < written; n++)
+		{
+			const ProfileEvent &event = thread->events[n % ThreadEvents::capacity];
+			fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", first ? "" : ",\n",
+				event.name, thread->thread, (event.start - epoch) / 1000.0, (event.end - event.start) / 1000.0);
+			first = false;
+		}
+	}
+	for(size_t f=0; f < counterFrames.size(); f++)
+	{
+		for(int c=0; c < numProfileCounters; c++)
+		{
+			fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"value\":%lld}}", first ? "" : ",\n",
+				counterNames[c], (counterFrames[f].time - epoch) / 1000.0, counterFrames[f].values[c]);
+			first = false;
+		}
+	}
+	fprintf(file, "\n]}\n");
+	return fclose(file) == 0;
+}
@@ -0,0 +1,90 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	Profiler.h
+//	Frame profiling. PROFILE_ZONE("name") times the rest of the enclosing scope and
+//	writes the zone, with nanosecond timestamps, to a ring buffer owned by the calling
+//	thread, so worker threads record without locking. PROFILE_COUNT adds to one of the
+//	frame counters.
+//
+//	Profiler::EndFrame closes a frame: it sums each zone's time and takes the counters,
+//	keeping the last windowFrames frames for averages and 99th percentiles. These are
+//	shown by DrawOverlay and the events still in the ring buffers can be written as
+//	Chrome trace JSON (chrome://tracing or ui.perfetto.dev).
+//
+//	Building with PROFILER_ENABLED 0 compiles the zones and counters out. The Profiler
+//	functions stay and report nothing.
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+#include <atomic>
+#include <vector>
+
+enum ProfileCounter
+{
+	counterDrawCalls,			// glDrawElements calls and glBegin/glEnd pairs
+	counterVertices,			// vertices those calls sent
+	counterMaterialChanges,		// glMaterialfv sets of a whole material
+	numProfileCounters
+};
+
+// Average and 99th percentile over the window, milliseconds for zones
+struct ProfileStat
+{
+	const char *name;
+	double average;
+	double p99;
+};
+
+class Profiler
+{
+public:
+	static const int windowFrames = 240;
+
+	static std::atomic<long long> counters[numProfileCounters];
+
+	// Nanoseconds on a steady clock
+	static long long Now();
+
+	static void Record(const char *name, long long start, long long end);
+	static void Count(ProfileCounter counter, long long amount) { counters[counter].fetch_add(amount, std::memory_order_relaxed); }
+
+	static void EndFrame();
+	static int GetFrames();
+
+	// Zones in the order they were first seen, and the counters in enum order
+	static void GetZoneStats(std::vector<ProfileStat> &stats);
+	static void GetCounterStats(std::vector<ProfileStat> &stats);
+
+	// Text in the top left corner of a width by height window, through GLUT bitmap fonts
+	static void DrawOverlay(int width, int height);
+
+	static bool WriteChromeTrace(const char *fileName);
+};
+
+class ProfileZone
+{
+private:
+	const char *name;
+	long long start;
+
+public:
+	ProfileZone(const char *name) : name(name), start(Profiler::Now()) {}
+	~ProfileZone() { Profiler::Record(name, start, Profiler::Now()); }
+};
+
+#if PROFILER_ENABLED
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_JOIN(profileZone, __LINE__)(name)
+#define PROFILE_COUNT(counter, amount) Profiler::Count(counter, amount)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_COUNT(counter, amount) ((void)0)
+#endif
+
+#endif	//PROFILER_H
@@ -3,12 +3,17 @@
 //#include <gl/glu.h>
 //#include <gl/glut.h>
 #define GL_SILENCE_DEPRECATION
+#ifndef __APPLE__
+#define GL_GLEXT_PROTOTYPES   // glGenBuffers etc. are only prototyped in glext.h
+#endif
 #ifdef __APPLE__
 #include <OpenGL/gl.h>
 #include <GLUT/glut.h>
 #else
-#include <GL/gl.h>
+#ifdef _WIN32
 #include <windows.h>
+#endif
+#include <GL/gl.h>
 #include <GL/glut.h>
 #endif
 #include <stdlib.h>
@@ -18,19 +23,67 @@
 #include <math.h>
 #include <utility>
 #include <vector>
+#include <stddef.h>
+#include <thread>
+#include <new>
 #include "VECTOR3D.h"
+#include "MeshArena.h"
+#include "MeshKernels.h"
+#include "VertexCache.h"
+#include "Profiler.h"
+#include "JobSystem.h"
 
 #include "QuadMesh.h"
 
 
-QuadMesh::QuadMesh(int maxMeshSize, float meshDim)
+QuadMesh::QuadMesh(int maxMeshSize, float meshDim, MeshAllocator *allocator)
 {
 	minMeshSize =1;
+	this->allocator = allocator ? allocator : DefaultMeshAllocator();
+	vertexBytes = 0;
+	gridBytes = 0;
+	indexBytes = 0;
+	compactBytes = 0;
+	meshLength = 0;
+	meshWidth = 0;
 	numVertices = 0;
 	vertices = NULL;
+	gridSize = 0;
 	numQuads = 0;
-	quads = NULL;
+	numIndices = 0;
+	indices = NULL;
+	indexType = GL_UNSIGNED_INT;
+	indexSize = sizeof(GLuint);
+	quadIndices = true;
+	memset(&grid, 0, sizeof(grid));
+	kernels = SelectMeshKernels();
+	tilesPerSide = 0;
+	hasDirtyTiles = false;
+	uploadBegin = 0;
+	uploadEnd = 0;
+	cachePath = NULL;
+	memset(&cacheView, 0, sizeof(cacheView));
+	ownedVertices = NULL;
+	ownedIndices = NULL;
+	gridStale = false;
+	compactVertices = NULL;
+	heightMin = 0.0f;
+	heightStep = 1.0f;
+	jobs = NULL;
 	numFacesDrawn = 0;
+
+	retained = true;
+	useVBO = false;
+	buffersDirty = true;
+	vertexBuffer = 0;
+	indexBuffer = 0;
+	optimizedOrder = true;
+	useStrips = false;
+	orderBuilt = false;
+	orderedMode = GL_TRIANGLES;
+	restartIndex = 0;
+	numOrderedIndices = 0;
+	orderedBuffer = 0;
 	
 	this->maxMeshSize = maxMeshSize < minMeshSize ? minMeshSize : maxMeshSize;
 	this->meshDim = meshDim;
@@ -70,21 +123,118 @@ void QuadMesh::SetMaterial(VECTOR3D ambient, VECTOR3D diffuse, VECTOR3D specular
 	mat_shininess[0] = shininess;
 }
 
-bool QuadMesh::CreateMemory()
+// Arrays of objects constructed in place in allocator memory
+template <typename T>
+static T *AllocateArray(MeshAllocator *allocator, size_t count, size_t &bytes)
+{
+	bytes = count*sizeof(T);
+	T *array = (T *)allocator->Allocate(bytes);
+	for(size_t i=0; i < count; i++)
+		new (array+i) T();
+	return array;
+}
+
+// Round a float count up to whole 64-byte blocks so each SoA array starts aligned
+static int AlignedFloats(int count)
+{
+	const int perBlock = (int)(meshAlignment/sizeof(float));
+	return (count + perBlock-1) / perBlock * perBlock;
+}
+
+void QuadMesh::CreateMemory()
 {
-	vertices = new MeshVertex[(maxMeshSize+1)*(maxMeshSize+1)];
-	if(!vertices)
+	CreateVertexMemory();
+
+	// Pick the narrowest index type able to address the reserved grid
+	if((maxMeshSize+1)*(maxMeshSize+1) <= 65536)
 	{
-		return false;
+		indexType = GL_UNSIGNED_SHORT;
+		indexSize = sizeof(GLushort);
 	}
-
-	quads = new MeshQuad[maxMeshSize*maxMeshSize];
-	if(!quads)
+	else
 	{
-		return false;
+		indexType = GL_UNSIGNED_INT;
+		indexSize = sizeof(GLuint);
 	}
 
-	return true;
+	if(quadIndices)
+		CreateIndexMemory();
+}
+
+void QuadMesh::CreateIndexMemory()
+{
+	indexBytes = 4*maxMeshSize*maxMeshSize*indexSize;
+	indices = allocator->Allocate(indexBytes);
+	ownedIndices = indices;
+}
+
+void QuadMesh::FreeIndexMemory()
+{
+	if(ownedIndices)
+		allocator->Free(ownedIndices, indexBytes);
+	indices=NULL;
+	ownedIndices=NULL;
+	indexBytes=0;
+	numIndices=0;
+}
+
+void QuadMesh::SetQuadIndices(bool quadIndices)
+{
+	if(quadIndices == this->quadIndices)
+		return;
+
+	this->quadIndices = quadIndices;
+	FreeBuffers();
+	if(quadIndices)
+		CreateIndexMemory();
+	else
+		FreeIndexMemory();
+}
+
+// Interleaved vertices and the SoA grid, everything SetCompact frees
+void QuadMesh::CreateVertexMemory()
+{
+	vertices = AllocateArray<MeshVertex>(allocator, (maxMeshSize+1)*(maxMeshSize+1), vertexBytes);
+	ownedVertices = vertices;
+
+	// One block for the SoA arrays: positions and normals, then padded face normals
+	const int vertexCount = AlignedFloats((maxMeshSize+1)*(maxMeshSize+1));
+	const int faceCount = AlignedFloats((maxMeshSize+2)*(maxMeshSize+2));
+	gridBytes = (6*vertexCount + 3*faceCount)*sizeof(float);
+	float *soa = (float *)allocator->Allocate(gridBytes);
+	memset(soa, 0, gridBytes);
+	grid.px = soa;
+	grid.py = grid.px + vertexCount;
+	grid.pz = grid.py + vertexCount;
+	grid.nx = grid.pz + vertexCount;
+	grid.ny = grid.nx + vertexCount;
+	grid.nz = grid.ny + vertexCount;
+	grid.fx = grid.nz + vertexCount;
+	grid.fy = grid.fx + faceCount;
+	grid.fz = grid.fy + faceCount;
+	grid.size = gridSize;
+}
+
+void QuadMesh::FreeVertexMemory()
+{
+	ReleaseCache();
+
+	if(vertices)
+		allocator->Free(vertices, vertexBytes);
+	vertices=NULL;
+	ownedVertices=NULL;
+
+	if(grid.px)
+		allocator->Free(grid.px, gridBytes);
+	memset(&grid, 0, sizeof(grid));
+}
+
+void QuadMesh::FreeCompactMemory()
+{
+	if(compactVertices)
+		allocator->Free(compactVertices, compactBytes);
+	compactVertices=NULL;
+	clientVertices.clear();
 }
 		
 
@@ -96,6 +246,11 @@ bool QuadMesh::InitMesh(int meshSize,VECTOR3D origin,double meshLength,double me
 	double sf1,sf2; 
     
 	VECTOR3D v1,v2;
+
+	if(meshSize < minMeshSize || meshSize > maxMeshSize)
+	{
+		return false;
+	}
 	
 	v1.x = dir1.x;
 	v1.y = dir1.y;
@@ -110,101 +265,457 @@ bool QuadMesh::InitMesh(int meshSize,VECTOR3D origin,double meshLength,double me
 	sf2 = meshWidth/meshSize;
 	v2 *= sf2;
     
-	VECTOR3D meshpt;
-	
+	// A compact mesh is regenerated in the full layout
+	if(compactVertices)
+	{
+		FreeCompactMemory();
+		CreateVertexMemory();
+	}
+
+	this->meshLength = meshLength;
+	this->meshWidth = meshWidth;
+	meshDir1 = dir1;
+	meshDir2 = dir2;
+
 	// VERTICES
 	numVertices=(meshSize+1)*(meshSize+1);
+	gridSize=meshSize;
+	grid.size=meshSize;
+
+	meshOrigin = origin;
+	colStep = v1;
+	rowStep = v2;
+	meshUp = v1.CrossProduct(v2);
+	meshUp.Normalize();
+
+	numQuads=(meshSize)*(meshSize);
+	numIndices=quadIndices ? 4*numQuads : 0;
+
+	tilesPerSide = (meshSize + tileSize-1) / tileSize;
+	dirtyTiles.assign(tilesPerSide*tilesPerSide, 0);
+	hasDirtyTiles = false;
+	buffersDirty = true;
+	orderBuilt = false;
+
+	// Face normal border stays zero, the kernels only write the interior
+	const int faceCount = grid.FacePitch()*grid.FacePitch();
+	memset(grid.fx, 0, faceCount*sizeof(float));
+	memset(grid.fy, 0, faceCount*sizeof(float));
+	memset(grid.fz, 0, faceCount*sizeof(float));
+
+	// Draw straight from the cache file when it was generated with these parameters
+	ReleaseCache();
+	const uint64_t cacheKey = CacheKey(meshSize, origin, meshLength, meshWidth, dir1, dir2);
+	if(cachePath && MapMeshCache(cachePath, cacheKey, sizeof(MeshVertex), indexSize, cacheView))
+	{
+		if(cacheView.meshSize == meshSize && cacheView.numVertices == numVertices && cacheView.numIndices == numIndices)
+		{
+			vertices = (MeshVertex *)cacheView.vertices;
+			indices = cacheView.indices;
+			gridStale = true;
+
+			// ReleaseCache goes back to the owned indices, which InitMesh builds no more
+			if(ownedIndices)
+				memcpy(ownedIndices, cacheView.indices, (size_t)numIndices*indexSize);
+			return true;
+		}
+		UnmapMeshCache(cacheView);
+	}
+	gridStale = false;
 	
 	// Starts at front left corner of mesh 
 	o.Set(origin.x,origin.y,origin.z);
 
 	for(int i=0; i< meshSize+1; i++)
 	{
+		// compute vertex positions along mesh row (along x direction)
+		const int row = i*grid.VertexPitch();
+		kernels->GridRow(o.x, o.y, o.z, v1.x, v1.y, v1.z, meshSize+1, grid.px+row, grid.py+row, grid.pz+row);
+
 		for(int j=0; j< meshSize+1; j++)
 		{
-			// compute vertex position along mesh row (along x direction)
-			meshpt.x = o.x + j * v1.x;
-			meshpt.y = o.y + j * v1.y;
-			meshpt.z = o.z + j * v1.z;
-            
-			vertices[currentVertex].position.Set(meshpt.x,meshpt.y,meshpt.z);
+			vertices[currentVertex].position.Set(grid.px[row+j], grid.py[row+j], grid.pz[row+j]);
 			currentVertex++;
 		}
 		// go to next row in mesh (negative z direction)
 		o += v2;
 	}
-	
-	// Build Quad Polygons
-	numQuads=(meshSize)*(meshSize);
-	int currentQuad=0;
 
-	for(int j=0; j < meshSize; j++)
+	// Build Quad Polygons
+	if(numIndices == 0)
 	{
-		for(int k=0; k < meshSize; k++)
-		{
-			// Counterclockwise order
-			quads[currentQuad].vertices[0]=&vertices[j*    (meshSize+1)+k];
-			quads[currentQuad].vertices[1]=&vertices[j*    (meshSize+1)+k+1];
-			quads[currentQuad].vertices[2]=&vertices[(j+1)*(meshSize+1)+k+1];
-			quads[currentQuad].vertices[3]=&vertices[(j+1)*(meshSize+1)+k];
-			currentQuad++;
-		}
+		// Vertices only, see SetQuadIndices
 	}
+	else if(indexType == GL_UNSIGNED_SHORT)
+		BuildGridQuads((GLushort *)indices, meshSize);
+	else
+		BuildGridQuads((GLuint *)indices, meshSize);
 
     this->ComputeNormals();
 
+	if(cachePath)
+	{
+		WriteMeshCache(cachePath, cacheKey, meshSize, vertices, numVertices, sizeof(MeshVertex), indices, numIndices, indexSize);
+	}
+
 	return true;
 }
 
-void QuadMesh::DrawMesh(int meshSize)
+void QuadMesh::SetCacheFile(const char *path)
 {
-	int currentQuad=0;
+	free(cachePath);
+	cachePath = path ? strdup(path) : NULL;
+}
+
+// Checksum of everything InitMesh output depends on
+uint64_t QuadMesh::CacheKey(int meshSize, VECTOR3D origin, double meshLength, double meshWidth, VECTOR3D dir1, VECTOR3D dir2)
+{
+	const int layout[3] = { meshSize, (int)sizeof(MeshVertex), indexSize };
+	const float vectors[9] = { origin.x, origin.y, origin.z, dir1.x, dir1.y, dir1.z, dir2.x, dir2.y, dir2.z };
+	const double lengths[2] = { meshLength, meshWidth };
+
+	uint64_t hash = meshCacheHashSeed;
+	hash = MeshCacheHash(hash, layout, sizeof(layout));
+	hash = MeshCacheHash(hash, vectors, sizeof(vectors));
+	hash = MeshCacheHash(hash, lengths, sizeof(lengths));
+	return hash;
+}
+
+// Go back to the arrays allocated by CreateMemory
+void QuadMesh::ReleaseCache()
+{
+	if(cacheView.base)
+	{
+		UnmapMeshCache(cacheView);
+		vertices = ownedVertices;
+		indices = ownedIndices;
+		buffersDirty = true;
+	}
+	gridStale = false;
+}
+
+// A mesh mapped from the cache only has its interleaved vertices. Copy the positions
+// into the SoA grid, and the face normals too when only part of the mesh is redone.
+void QuadMesh::SyncGrid(bool faces)
+{
+	if(compactVertices)
+		SetCompact(false);
+	if(!gridStale)
+		return;
 
+	for(int i=0; i < numVertices; i++)
+	{
+		grid.px[i] = vertices[i].position.x;
+		grid.py[i] = vertices[i].position.y;
+		grid.pz[i] = vertices[i].position.z;
+	}
+	if(faces)
+	{
+		kernels->FaceNormals(grid, 0, gridSize, 0, gridSize);
+	}
+	gridStale = false;
+}
+
+void QuadMesh::SetRetained(bool retained)
+{
+	this->retained = retained;
+	buffersDirty = true;
+}
+
+void QuadMesh::ApplyMaterial()
+{
+	PROFILE_COUNT(counterMaterialChanges, 1);
 	glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient);
 	glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
 	glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
 	glMaterialfv(GL_FRONT, GL_SHININESS, mat_shininess);
+}
+
+void QuadMesh::DrawMesh(int meshSize)
+{
+	PROFILE_ZONE("QuadMesh::DrawMesh");
+	if(numIndices == 0)
+		return;
+	ApplyMaterial();
+
+	if(retained)
+		DrawRetained(meshSize);
+	else
+		DrawImmediate(meshSize);
+}
+
+static bool GLVersionAtLeast(int wantMajor, int wantMinor)
+{
+	const char *version = (const char *)glGetString(GL_VERSION);
+	int major = 0, minor = 0;
+	if(!version || sscanf(version, "%d.%d", &major, &minor) != 2)
+	{
+		return false;
+	}
+	return major > wantMajor || (major == wantMajor && minor >= wantMinor);
+}
+
+// Buffer objects are core since GL 1.5, older contexts use client vertex arrays
+bool QuadMesh::SupportsVBO()
+{
+	return GLVersionAtLeast(1, 5);
+}
+
+// Core since GL 3.1, legacy contexts such as the macOS 2.1 one draw triangle lists
+bool QuadMesh::SupportsPrimitiveRestart()
+{
+#ifdef GL_PRIMITIVE_RESTART
+	return GLVersionAtLeast(3, 1);
+#else
+	return false;
+#endif
+}
+
+template <typename IndexType>
+static int BuildOrdered(std::vector<unsigned char> &out, int meshSize, bool strips, IndexType restartIndex)
+{
+	const int bandWidth = GridBandWidth(defaultVertexCacheSize);
+	const int count = strips ? GridStripIndexCount(meshSize, bandWidth) : GridTriangleIndexCount(meshSize);
+	out.resize(count*sizeof(IndexType));
+	if(strips)
+		BuildGridStrips((IndexType *)&out[0], meshSize, bandWidth, restartIndex);
+	else
+		BuildGridTriangles((IndexType *)&out[0], meshSize, bandWidth);
+	return count;
+}
+
+void QuadMesh::BuildOrderedIndices()
+{
+	restartIndex = indexType == GL_UNSIGNED_SHORT ? 0xffff : 0xffffffff;
+
+	// The restart index must not be a vertex, a full 65536 vertex grid gets triangles
+	const bool strips = useStrips && SupportsPrimitiveRestart() && (GLuint)(numVertices-1) < restartIndex;
+	orderedMode = strips ? GL_TRIANGLE_STRIP : GL_TRIANGLES;
+
+	if(gridSize == 0)
+		numOrderedIndices = 0;
+	else if(indexType == GL_UNSIGNED_SHORT)
+		numOrderedIndices = BuildOrdered(orderedIndices, gridSize, strips, (GLushort)restartIndex);
+	else
+		numOrderedIndices = BuildOrdered(orderedIndices, gridSize, strips, (GLuint)restartIndex);
+
+	if(useVBO && numOrderedIndices > 0)
+	{
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, orderedBuffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, orderedIndices.size(), &orderedIndices[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+		// Only client arrays need them in system memory
+		std::vector<unsigned char>().swap(orderedIndices);
+	}
+	orderBuilt = true;
+}
+
+void QuadMesh::UploadBuffers()
+{
+	if(vertexBuffer == 0 && indexBuffer == 0)
+	{
+		useVBO = SupportsVBO();
+		if(useVBO)
+		{
+			glGenBuffers(1, &vertexBuffer);
+			if(numIndices > 0)
+			{
+				glGenBuffers(1, &indexBuffer);
+				glGenBuffers(1, &orderedBuffer);
+			}
+		}
+	}
+
+	if(useVBO && compactVertices)
+	{
+		// Expand a batch at a time straight into the buffer, the full layout is never
+		// held in system memory
+		const int batchSize = 1024;
+		MeshVertex batch[batchSize];
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, numVertices*sizeof(MeshVertex), NULL, GL_STATIC_DRAW);
+		for(int first=0; first < numVertices; first += batchSize)
+		{
+			const int count = numVertices-first < batchSize ? numVertices-first : batchSize;
+			for(int i=0; i < count; i++)
+				DecodeVertex(first+i, batch[i]);
+			glBufferSubData(GL_ARRAY_BUFFER, first*sizeof(MeshVertex), count*sizeof(MeshVertex), batch);
+		}
+		if(indexBuffer)
+		{
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices*indexSize, indices, GL_STATIC_DRAW);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+	else if(useVBO)
+	{
+		// MeshVertex is already interleaved position/normal, upload as is
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, numVertices*sizeof(MeshVertex), vertices, GL_STATIC_DRAW);
+		if(indexBuffer)
+		{
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices*indexSize, indices, GL_STATIC_DRAW);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+	else if(compactVertices)
+	{
+		// Client arrays need the full layout in memory, only pre-1.5 contexts get here
+		clientVertices.resize(numVertices);
+		for(int i=0; i < numVertices; i++)
+			DecodeVertex(i, clientVertices[i]);
+	}
+
+	buffersDirty = false;
+	uploadBegin = uploadEnd = 0;
+}
+
+void QuadMesh::FreeBuffers()
+{
+	if(vertexBuffer)
+		glDeleteBuffers(1, &vertexBuffer);
+	vertexBuffer=0;
+
+	if(indexBuffer)
+		glDeleteBuffers(1, &indexBuffer);
+	indexBuffer=0;
+
+	if(orderedBuffer)
+		glDeleteBuffers(1, &orderedBuffer);
+	orderedBuffer=0;
+
+	buffersDirty = true;
+	orderBuilt = false;
+}
+
+// Upload pending changes and point the vertex and normal arrays at the mesh vertices.
+// Callers may then draw with their own index lists, as Terrain does for its LODs.
+void QuadMesh::BindVertexArrays()
+{
+	if(buffersDirty)
+	{
+		UploadBuffers();
+	}
+	else if(uploadEnd > uploadBegin)
+	{
+		// Only the vertex rows touched by UpdateMesh
+		if(useVBO)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+			glBufferSubData(GL_ARRAY_BUFFER, uploadBegin*sizeof(MeshVertex), (uploadEnd-uploadBegin)*sizeof(MeshVertex), vertices+uploadBegin);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+		uploadBegin = uploadEnd = 0;
+	}
+
+	const GLvoid *vertexBase = compactVertices ? clientVertices.data() : vertices;
+	if(useVBO)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		vertexBase = NULL;
+	}
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex), (const char *)vertexBase + offsetof(MeshVertex, position));
+	glNormalPointer(GL_FLOAT, sizeof(MeshVertex), (const char *)vertexBase + offsetof(MeshVertex, normal));
+
+	if(useVBO)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+}
 
-	for(int j=0; j< meshSize; j++)
+void QuadMesh::UnbindVertexArrays()
+{
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+void QuadMesh::DrawRetained(int meshSize)
+{
+	BindVertexArrays();
+
+	// Only meshes drawn on their own need the ordered indices, not Terrain chunks
+	if(optimizedOrder && !orderBuilt)
+	{
+		BuildOrderedIndices();
+	}
+
+	// Quads are stored row by row, so the first meshSize*meshSize of them are drawn
+	int count = 4*meshSize*meshSize;
+	if(count > numIndices)
+	{
+		count = numIndices;
+	}
+
+	// The whole grid goes in cache friendly order, a part of it as quads row by row
+	const bool ordered = optimizedOrder && count == numIndices && numOrderedIndices > 0;
+
+	const GLvoid *indexBase = ordered ? (const GLvoid *)orderedIndices.data() : indices;
+	if(useVBO)
+	{
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ordered ? orderedBuffer : indexBuffer);
+		indexBase = NULL;
+	}
+
+	PROFILE_COUNT(counterDrawCalls, 1);
+	PROFILE_COUNT(counterVertices, ordered ? numOrderedIndices : count);
+	if(!ordered)
+	{
+		glDrawElements(GL_QUADS, count, indexType, indexBase);
+	}
+	else if(orderedMode == GL_TRIANGLE_STRIP)
 	{
-		for(int k=0; k< meshSize; k++)
+#ifdef GL_PRIMITIVE_RESTART
+		glEnable(GL_PRIMITIVE_RESTART);
+		glPrimitiveRestartIndex(restartIndex);
+		glDrawElements(GL_TRIANGLE_STRIP, numOrderedIndices, indexType, indexBase);
+		glDisable(GL_PRIMITIVE_RESTART);
+#endif
+	}
+	else
+	{
+		glDrawElements(GL_TRIANGLES, numOrderedIndices, indexType, indexBase);
+	}
+
+	if(useVBO)
+	{
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+
+	UnbindVertexArrays();
+
+	numFacesDrawn = count/4;
+}
+
+// Reference path, one glBegin/glEnd per quad
+void QuadMesh::DrawImmediate(int meshSize)
+{
+	int currentQuad=0;
+	int maxQuads = meshSize*meshSize < numQuads ? meshSize*meshSize : numQuads;
+
+	for(; currentQuad < maxQuads; currentQuad++)
+	{
+		glBegin(GL_QUADS);
+		for(int c=0; c < 4; c++)
 		{
-			glBegin(GL_QUADS);
-			
-			glNormal3f(quads[currentQuad].vertices[0]->normal.x,
-				       quads[currentQuad].vertices[0]->normal.y,
-					   quads[currentQuad].vertices[0]->normal.z);
-			glVertex3f(quads[currentQuad].vertices[0]->position.x,
-				       quads[currentQuad].vertices[0]->position.y,
-					   quads[currentQuad].vertices[0]->position.z);
-			
-			glNormal3f(quads[currentQuad].vertices[1]->normal.x,
-				       quads[currentQuad].vertices[1]->normal.y,
-					   quads[currentQuad].vertices[1]->normal.z);
-			
-			glVertex3f(quads[currentQuad].vertices[1]->position.x,
-				       quads[currentQuad].vertices[1]->position.y,
-					   quads[currentQuad].vertices[1]->position.z);
-			
-			glNormal3f(quads[currentQuad].vertices[2]->normal.x,
-				       quads[currentQuad].vertices[2]->normal.y,
-					   quads[currentQuad].vertices[2]->normal.z);
-			
-			glVertex3f(quads[currentQuad].vertices[2]->position.x,
-				       quads[currentQuad].vertices[2]->position.y,
-					   quads[currentQuad].vertices[2]->position.z);
-			
-			glNormal3f(quads[currentQuad].vertices[3]->normal.x,
-				       quads[currentQuad].vertices[3]->normal.y,
-					   quads[currentQuad].vertices[3]->normal.z);
-			
-			glVertex3f(quads[currentQuad].vertices[3]->position.x,
-				       quads[currentQuad].vertices[3]->position.y,
-					   quads[currentQuad].vertices[3]->position.z);
-			glEnd();
-			currentQuad++;
+			MeshVertex v;
+			DecodeVertex(GetIndex(4*currentQuad+c), v);
+			glNormal3f(v.normal.x, v.normal.y, v.normal.z);
+			glVertex3f(v.position.x, v.position.y, v.position.z);
 		}
+		glEnd();
 	}
+
+	PROFILE_COUNT(counterDrawCalls, currentQuad);
+	PROFILE_COUNT(counterVertices, 4*currentQuad);
+	numFacesDrawn = currentQuad;
 }
 
 
@@ -213,64 +724,417 @@ void QuadMesh::DrawMesh(int meshSize)
 
 
 
+// Vertex i in the full layout whether the mesh is compact or not
+void QuadMesh::DecodeVertex(int i, MeshVertex &v) const
+{
+	if(!compactVertices)
+	{
+		v = vertices[i];
+		return;
+	}
+
+	const int row = i / (gridSize+1);
+	const int col = i - row*(gridSize+1);
+	const float height = DecodeHeight(compactVertices[i].height, heightMin, heightStep);
+	v.position = meshOrigin + rowStep*(float)row + colStep*(float)col + meshUp*height;
+	v.normal = DecodeOctNormal(compactVertices[i].normal);
+}
+
+MeshVertex QuadMesh::GetVertex(int row, int col) const
+{
+	MeshVertex v;
+	DecodeVertex(row*(gridSize+1)+col, v);
+	return v;
+}
+
+// Height above the flat grid along the mesh up direction
+float QuadMesh::GetHeight(int row, int col) const
+{
+	const int i = row*(gridSize+1)+col;
+	if(compactVertices)
+	{
+		return DecodeHeight(compactVertices[i].height, heightMin, heightStep);
+	}
+	VECTOR3D flat = meshOrigin + rowStep*(float)row + colStep*(float)col;
+	return (vertices[i].position - flat).DotProduct(meshUp);
+}
+
+float QuadMesh::SampleHeight(VECTOR3D point) const
+{
+	if(gridSize == 0)
+		return 0.0f;
+
+	// Grid coordinates as ApplyBrush, assumes the mesh directions are orthogonal
+	VECTOR3D offset = point - meshOrigin;
+	const float col = offset.DotProduct(colStep) / colStep.DotProduct(colStep);
+	const float row = offset.DotProduct(rowStep) / rowStep.DotProduct(rowStep);
+	if(!(row >= 0.0f && row <= gridSize && col >= 0.0f && col <= gridSize))
+		return 0.0f;
+
+	const int row0 = (int)row < gridSize ? (int)row : gridSize-1;
+	const int col0 = (int)col < gridSize ? (int)col : gridSize-1;
+	const float fr = row - row0;
+	const float fc = col - col0;
+	const float h00 = GetHeight(row0, col0), h01 = GetHeight(row0, col0+1);
+	const float h10 = GetHeight(row0+1, col0), h11 = GetHeight(row0+1, col0+1);
+	const float front = h00 + (h01 - h00)*fc;
+	const float back = h10 + (h11 - h10)*fc;
+	return front + (back - front)*fr;
+}
+
+size_t QuadMesh::GetVertexMemory() const
+{
+	if(compactVertices)
+	{
+		return numVertices*sizeof(CompactVertex) + clientVertices.size()*sizeof(MeshVertex);
+	}
+
+	// Storage is reserved for the largest grid, not just the current one
+	const size_t vertexCount = (maxMeshSize+1)*(maxMeshSize+1);
+	const size_t faceCount = (maxMeshSize+2)*(maxMeshSize+2);
+	return vertexCount*sizeof(MeshVertex) + (6*vertexCount + 3*faceCount)*sizeof(float);
+}
+
+size_t QuadMesh::GetIndexMemory() const
+{
+	return (ownedIndices ? indexBytes : 0) + orderedIndices.size();
+}
+
+// Switch between the full layout and the 4 byte CompactVertex layout. Heights are
+// quantized to 16 bits over the range the mesh currently spans, so going back to the
+// full layout gives slightly different positions and normals.
+bool QuadMesh::SetCompact(bool compact)
+{
+	if(compact == (compactVertices != NULL))
+		return true;
+
+	if(compact)
+	{
+		if(gridSize == 0)
+			return false;
+
+		// Pending deformations go into the normals before they are encoded
+		UpdateMesh();
+
+		float lo = 1e30f, hi = -1e30f;
+		for(int row=0; row <= gridSize; row++)
+		{
+			for(int col=0; col <= gridSize; col++)
+			{
+				const float height = GetHeight(row, col);
+				if(height < lo) lo = height;
+				if(height > hi) hi = height;
+			}
+		}
+		heightMin = lo;
+		heightStep = hi > lo ? (hi - lo) / 65535.0f : 1.0f;
+
+		CompactVertex *compact = AllocateArray<CompactVertex>(allocator, numVertices, compactBytes);
+		for(int row=0; row <= gridSize; row++)
+		{
+			for(int col=0; col <= gridSize; col++)
+			{
+				const int i = row*(gridSize+1)+col;
+				compact[i].height = EncodeHeight(GetHeight(row, col), heightMin, heightStep);
+				compact[i].normal = EncodeOctNormal(vertices[i].normal);
+			}
+		}
+
+		FreeVertexMemory();
+		compactVertices = compact;
+	}
+	else
+	{
+		CreateVertexMemory();
+		for(int i=0; i < numVertices; i++)
+			DecodeVertex(i, vertices[i]);
+
+		FreeCompactMemory();
+
+		// The SoA grid is filled the next time it is needed
+		gridStale = true;
+	}
+
+	buffersDirty = true;
+	return true;
+}
+
 void QuadMesh::FreeMemory()
 {
-	if(vertices)
-		delete [] vertices;
-	vertices=NULL;
+	FreeVertexMemory();
+	FreeCompactMemory();
 	numVertices=0;
 
-	if(quads)
-		delete [] quads;
-	quads=NULL;
 	numQuads=0;
+	gridSize=0;
+	grid.size=0;
+
+	if(indices)
+		allocator->Free(indices, indexBytes);
+	indices=NULL;
+	ownedIndices=NULL;
+	numIndices=0;
+
+	dirtyTiles.clear();
+	tilesPerSide=0;
+	hasDirtyTiles=false;
+	uploadBegin=uploadEnd=0;
+	buffersDirty=true;
+	orderBuilt=false;
+}
+
+bool QuadMesh::Resize(int meshSize)
+{
+	if(meshLength == 0 && meshWidth == 0)
+	{
+		return false;
+	}
+	return InitMesh(meshSize, meshOrigin, meshLength, meshWidth, meshDir1, meshDir2);
+}
+
+// Make room for grids of up to maxMeshSize quads per side. Growing drops the current
+// grid, call InitMesh or Resize again.
+void QuadMesh::Reserve(int maxMeshSize)
+{
+	if(maxMeshSize <= this->maxMeshSize)
+		return;
+
+	FreeMemory();
+	this->maxMeshSize = maxMeshSize;
+	CreateMemory();
+}
+
+// Rows per band below which splitting ComputeNormals costs more than it saves
+static const int minRowsPerThread = 64;
+
+// Run fn(rowBegin, rowEnd) over [0, rows) split into contiguous bands, one per thread
+// of jobs, and wait for them. The calling thread runs bands too.
+static void ParallelRows(JobSystem *jobs, int rows, const std::function<void(int, int)> &fn)
+{
+	int threads = jobs ? jobs->GetNumThreads() : 1;
+	if(threads > rows / minRowsPerThread)
+		threads = rows / minRowsPerThread;
+	if(threads <= 1)
+	{
+		fn(0, rows);
+		return;
+	}
+
+	JobGroup group;
+	jobs->ParallelFor(rows, (rows + threads-1) / threads, [&fn](int first, int count)
+	{
+		fn(first, first + count);
+	}, &group);
+	jobs->Wait(&group);
+}
+
+// Vector area of each quad, half the cross product of its diagonals. Its length is
+// the quad area so larger quads weigh more in the vertex normals.
+void QuadMesh::ComputeFaceNormals(int rowBegin, int rowEnd)
+{
+	kernels->FaceNormals(grid, rowBegin, rowEnd, 0, gridSize);
+}
+
+// Each vertex sums the face normals of the up to four quads around it. Vertices
+// only write their own normal so any split into vertex rows is race free.
+void QuadMesh::GatherVertexNormals(int rowBegin, int rowEnd, int colBegin, int colEnd)
+{
+	kernels->GatherNormals(grid, rowBegin, rowEnd, colBegin, colEnd);
+
+	for(int j=rowBegin; j < rowEnd; j++)
+	{
+		for(int i=j*grid.VertexPitch()+colBegin; i < j*grid.VertexPitch()+colEnd; i++)
+		{
+			vertices[i].normal.Set(grid.nx[i], grid.ny[i], grid.nz[i]);
+		}
+	}
 }
 
 void QuadMesh::ComputeNormals() 
 {
-	int currentQuad=0;
+	SyncGrid(false);
+
+	// Face pass over quad rows, then gather pass over vertex rows
+	ParallelRows(jobs, gridSize, [this](int rowBegin, int rowEnd) { ComputeFaceNormals(rowBegin, rowEnd); });
+	ParallelRows(jobs, gridSize+1, [this](int rowBegin, int rowEnd) { GatherVertexNormals(rowBegin, rowEnd, 0, gridSize+1); });
+
+	// Vertex data changed, re-upload on next retained draw
+	buffersDirty = true;
 
-	for(int j=0; j< this->maxMeshSize; j++)
+	// Everything is up to date, pending deformations included
+	dirtyTiles.assign(dirtyTiles.size(), 0);
+	hasDirtyTiles = false;
+}
+
+void QuadMesh::DisplaceVertex(int row, int col, float height)
+{
+	const int i = row*grid.VertexPitch() + col;
+	grid.px[i] += height*meshUp.x;
+	grid.py[i] += height*meshUp.y;
+	grid.pz[i] += height*meshUp.z;
+	vertices[i].position.Set(grid.px[i], grid.py[i], grid.pz[i]);
+}
+
+// Flag the tiles holding every quad that touches a vertex in rows [rowBegin, rowEnd)
+// and columns [colBegin, colEnd)
+void QuadMesh::MarkDirty(int rowBegin, int colBegin, int rowEnd, int colEnd)
+{
+	int quadRowBegin = rowBegin > 0 ? rowBegin-1 : 0;
+	int quadColBegin = colBegin > 0 ? colBegin-1 : 0;
+	int quadRowEnd = rowEnd < gridSize ? rowEnd : gridSize;
+	int quadColEnd = colEnd < gridSize ? colEnd : gridSize;
+	if(quadRowBegin >= quadRowEnd || quadColBegin >= quadColEnd)
+		return;
+
+	for(int tr=quadRowBegin/tileSize; tr <= (quadRowEnd-1)/tileSize; tr++)
 	{
-		for(int k=0; k< this->maxMeshSize; k++)
+		for(int tc=quadColBegin/tileSize; tc <= (quadColEnd-1)/tileSize; tc++)
 		{
-			VECTOR3D n0,n1,n2,n3,e0,e1,e2,e3,ne0,ne1,ne2,ne3;
-			
-			quads[currentQuad].vertices[0]->normal.LoadZero();
-			quads[currentQuad].vertices[1]->normal.LoadZero();
-			quads[currentQuad].vertices[2]->normal.LoadZero();
-			quads[currentQuad].vertices[3]->normal.LoadZero();
-			e0 = quads[currentQuad].vertices[1]->position - quads[currentQuad].vertices[0]->position; 
-			e1 = quads[currentQuad].vertices[2]->position - quads[currentQuad].vertices[1]->position; 
-			e2 = quads[currentQuad].vertices[3]->position - quads[currentQuad].vertices[2]->position; 
-			e3 = quads[currentQuad].vertices[0]->position - quads[currentQuad].vertices[3]->position; 
-			e0.Normalize();
-			e1.Normalize();
-			e2.Normalize();
-			e3.Normalize();
-			
-			n0 = e0.CrossProduct(-e3);
-			n0.Normalize();
-			quads[currentQuad].vertices[0]->normal += n0;
-			
-			n1 = e1.CrossProduct(-e0);
-			n1.Normalize();
-			quads[currentQuad].vertices[1]->normal += n1;
-
-			n2 = e2.CrossProduct(-e1);
-			n2.Normalize();
-			quads[currentQuad].vertices[2]->normal += n2;
-
-			n3 = e3.CrossProduct(-e2);
-			n3.Normalize();
-			quads[currentQuad].vertices[3]->normal += n3;
-			
-			quads[currentQuad].vertices[0]->normal.Normalize();
-			quads[currentQuad].vertices[1]->normal.Normalize();
-			quads[currentQuad].vertices[2]->normal.Normalize();
-			quads[currentQuad].vertices[3]->normal.Normalize();
-			
-			currentQuad++;
+			dirtyTiles[tr*tilesPerSide+tc] = 1;
 		}
 	}
+	hasDirtyTiles = true;
+}
+
+// Raise (or lower, for negative height) the vertices in rows [rowBegin, rowEnd) and
+// columns [colBegin, colEnd). Normals catch up on the next UpdateMesh.
+void QuadMesh::DisplaceRegion(int rowBegin, int colBegin, int rowEnd, int colEnd, float height)
+{
+	SyncGrid(true);
+	if(rowBegin < 0) rowBegin = 0;
+	if(colBegin < 0) colBegin = 0;
+	if(rowEnd > gridSize+1) rowEnd = gridSize+1;
+	if(colEnd > gridSize+1) colEnd = gridSize+1;
+	if(rowBegin >= rowEnd || colBegin >= colEnd)
+		return;
+
+	for(int j=rowBegin; j < rowEnd; j++)
+	{
+		for(int k=colBegin; k < colEnd; k++)
+		{
+			DisplaceVertex(j, k, height);
+		}
+	}
+	MarkDirty(rowBegin, colBegin, rowEnd, colEnd);
+}
+
+// Smooth round brush, full height at center falling off to zero at radius.
+// center is in mesh space, negative height digs a crater.
+void QuadMesh::ApplyBrush(VECTOR3D center, float radius, float height)
+{
+	if(gridSize == 0 || radius <= 0)
+		return;
+	SyncGrid(true);
+
+	// Grid coordinates of the brush center, assumes the mesh directions are orthogonal
+	const float colLength = colStep.GetLength();
+	const float rowLength = rowStep.GetLength();
+	VECTOR3D offset = center - meshOrigin;
+	const float col = offset.DotProduct(colStep) / (colLength*colLength);
+	const float row = offset.DotProduct(rowStep) / (rowLength*rowLength);
+
+	int rowBegin = (int)floor(row - radius/rowLength);
+	int rowEnd = (int)ceil(row + radius/rowLength) + 1;
+	int colBegin = (int)floor(col - radius/colLength);
+	int colEnd = (int)ceil(col + radius/colLength) + 1;
+	if(rowBegin < 0) rowBegin = 0;
+	if(colBegin < 0) colBegin = 0;
+	if(rowEnd > gridSize+1) rowEnd = gridSize+1;
+	if(colEnd > gridSize+1) colEnd = gridSize+1;
+	if(rowBegin >= rowEnd || colBegin >= colEnd)
+		return;
+
+	for(int j=rowBegin; j < rowEnd; j++)
+	{
+		for(int k=colBegin; k < colEnd; k++)
+		{
+			const float dr = (j - row)*rowLength;
+			const float dc = (k - col)*colLength;
+			const float t = 1.0f - (dr*dr + dc*dc)/(radius*radius);
+			if(t > 0)
+			{
+				DisplaceVertex(j, k, height*t*t);
+			}
+		}
+	}
+	MarkDirty(rowBegin, colBegin, rowEnd, colEnd);
+}
+
+// Place every vertex at height heights[row*rowStride + col] above the flat grid and
+// recompute all normals
+void QuadMesh::SetHeights(const float *heights, int rowStride)
+{
+	// Every position is rewritten below
+	if(compactVertices)
+		SetCompact(false);
+	gridStale = false;
+
+	for(int j=0; j <= gridSize; j++)
+	{
+		for(int k=0; k <= gridSize; k++)
+		{
+			const int i = j*grid.VertexPitch() + k;
+			VECTOR3D p = meshOrigin;
+			p.MulAdd(rowStep, (float)j).MulAdd(colStep, (float)k).MulAdd(meshUp, heights[j*rowStride+k]);
+			grid.px[i] = p.x;
+			grid.py[i] = p.y;
+			grid.pz[i] = p.z;
+			vertices[i].position = p;
+		}
+	}
+	ComputeNormals();
+}
+
+// Recompute normals for deformed tiles only. Faces are redone for every quad in a
+// dirty tile, then normals for the tile's vertices including the one vertex border
+// shared with its neighbours. Only the changed vertex rows are re-uploaded.
+void QuadMesh::UpdateMesh()
+{
+	if(!hasDirtyTiles)
+		return;
+
+	for(int tr=0; tr < tilesPerSide; tr++)
+	{
+		for(int tc=0; tc < tilesPerSide; tc++)
+		{
+			if(!dirtyTiles[tr*tilesPerSide+tc])
+				continue;
+			const int rowEnd = (tr+1)*tileSize < gridSize ? (tr+1)*tileSize : gridSize;
+			const int colEnd = (tc+1)*tileSize < gridSize ? (tc+1)*tileSize : gridSize;
+			kernels->FaceNormals(grid, tr*tileSize, rowEnd, tc*tileSize, colEnd);
+		}
+	}
+
+	int firstRow = gridSize+1;
+	int lastRow = -1;
+	for(int tr=0; tr < tilesPerSide; tr++)
+	{
+		for(int tc=0; tc < tilesPerSide; tc++)
+		{
+			if(!dirtyTiles[tr*tilesPerSide+tc])
+				continue;
+			const int rowEnd = (tr+1)*tileSize < gridSize ? (tr+1)*tileSize : gridSize;
+			const int colEnd = (tc+1)*tileSize < gridSize ? (tc+1)*tileSize : gridSize;
+			GatherVertexNormals(tr*tileSize, rowEnd+1, tc*tileSize, colEnd+1);
+
+			if(tr*tileSize < firstRow) firstRow = tr*tileSize;
+			if(rowEnd > lastRow) lastRow = rowEnd;
+			dirtyTiles[tr*tilesPerSide+tc] = 0;
+		}
+	}
+	hasDirtyTiles = false;
+
+	// Grow the pending upload range over the changed rows
+	const int begin = firstRow*grid.VertexPitch();
+	const int end = (lastRow+1)*grid.VertexPitch();
+	if(uploadEnd > uploadBegin)
+	{
+		if(begin < uploadBegin) uploadBegin = begin;
+		if(end > uploadEnd) uploadEnd = end;
+	}
+	else
+	{
+		uploadBegin = begin;
+		uploadEnd = end;
+	}
 }
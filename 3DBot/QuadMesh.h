@@ -1,3 +1,11 @@
+#include "MeshArena.h"
+#include "MeshKernels.h"
+#include "MeshCache.h"
+#include "CompactVertex.h"
+#include "VertexCache.h"
+
+class JobSystem;
+
 struct MeshVertex
 {
 	VECTOR3D	position;
@@ -6,12 +14,6 @@ struct MeshVertex
 
 
 
-struct MeshQuad
-{
-	// pointers to vertices of each quad
-	MeshVertex *vertices[4];	
-};
-
 class QuadMesh
 {
 private:
@@ -20,13 +22,107 @@ private:
 	int minMeshSize;
 	float meshDim;
 
+	// Every array below comes from here, sized for maxMeshSize so InitMesh and Resize
+	// can change the grid size in place
+	MeshAllocator *allocator;
+	size_t vertexBytes;
+	size_t gridBytes;
+	size_t indexBytes;
+	size_t compactBytes;
+
 	int numVertices;
 	MeshVertex *vertices;
 
+	// Size of the grid set up by InitMesh, vertices are stored row by row
+	// with gridSize+1 per row so quad topology follows from grid coordinates
+	int gridSize;
 	int numQuads;
-	MeshQuad *quads;
+
+	// Quad index list, 4 indices per quad (counterclockwise). 16-bit indices
+	// are used whenever the reserved grid has at most 65536 vertices
+	int numIndices;
+	void *indices;
+	GLenum indexType;
+	int indexSize;
+
+	// False for meshes only drawn through another index list, which then have no
+	// quad list and no index buffer
+	bool quadIndices;
+
+	// Structure-of-arrays copy of the grid the mesh kernels work on. Positions
+	// are generated here and normals computed here, then interleaved into vertices
+	GridSoA grid;
+	const MeshKernels *kernels;
+
+	// Grid placement from InitMesh: vertex (row, col) starts at
+	// meshOrigin + row*rowStep + col*colStep and is displaced along meshUp
+	VECTOR3D meshOrigin;
+	VECTOR3D rowStep;
+	VECTOR3D colStep;
+	VECTOR3D meshUp;
+
+	// InitMesh arguments, for Resize
+	double meshLength;
+	double meshWidth;
+	VECTOR3D meshDir1;
+	VECTOR3D meshDir2;
+
+	// Deformed tiles of tileSize*tileSize quads waiting for UpdateMesh
+	static const int tileSize = 16;
+	int tilesPerSide;
+	std::vector<unsigned char> dirtyTiles;
+	bool hasDirtyTiles;
+
+	// Vertex range [uploadBegin, uploadEnd) changed since the last upload
+	int uploadBegin;
+	int uploadEnd;
+
+	// Optional cache file. When the InitMesh parameters match the file, vertices and
+	// indices point into the mapped file instead of the arrays allocated here, and the
+	// SoA grid is only filled from them once something needs it
+	char *cachePath;
+	MeshCacheView cacheView;
+	MeshVertex *ownedVertices;
+	void *ownedIndices;
+	bool gridStale;
+
+	// Compact layout from SetCompact: vertices and the SoA grid are freed and each
+	// vertex keeps only its height above the flat grid and its oct-encoded normal.
+	// Anything that deforms the mesh expands it back first.
+	CompactVertex *compactVertices;
+	float heightMin;
+	float heightStep;
+
+	// Expanded vertices for client arrays when a compact mesh is drawn without VBOs
+	std::vector<MeshVertex> clientVertices;
+
+	// Splits ComputeNormals into bands of rows, NULL runs it on the caller
+	JobSystem *jobs;
 
 	int numFacesDrawn;
+
+	// Retained mode: vertices and indices are uploaded once to buffer objects
+	// (or drawn from client vertex arrays when VBOs are unavailable) and drawn
+	// with a single glDrawElements call
+	bool retained;
+	bool useVBO;
+	bool buffersDirty;
+	GLuint vertexBuffer;
+	GLuint indexBuffer;
+
+	// Vertex cache friendly order for retained draws of the whole grid, built at the
+	// first such draw once the context is known: triangles down column bands, or the
+	// same order as triangle strips with primitive restart. Strips need half the
+	// indices but llvmpipe splits the draw at every restart, where the triangle list
+	// measured about a third faster than quads.
+	bool optimizedOrder;
+	bool useStrips;
+	bool orderBuilt;
+	GLenum orderedMode;
+	GLuint restartIndex;
+	int numOrderedIndices;
+	std::vector<unsigned char> orderedIndices;
+	GLuint orderedBuffer;
 	
 	GLfloat mat_ambient[4];
     GLfloat mat_specular[4];
@@ -35,30 +131,118 @@ private:
 
 	
 private:
-	bool CreateMemory();
+	void CreateMemory();
 	void FreeMemory();
+	void CreateVertexMemory();
+	void FreeVertexMemory();
+	void CreateIndexMemory();
+	void FreeIndexMemory();
+	void FreeCompactMemory();
+	void DecodeVertex(int i, MeshVertex &v) const;
+	void UploadBuffers();
+	void FreeBuffers();
+	void BuildOrderedIndices();
+	void DrawImmediate(int meshSize);
+	void DrawRetained(int meshSize);
+	void ComputeFaceNormals(int rowBegin, int rowEnd);
+	void GatherVertexNormals(int rowBegin, int rowEnd, int colBegin, int colEnd);
+	void DisplaceVertex(int row, int col, float height);
+	void MarkDirty(int rowBegin, int colBegin, int rowEnd, int colEnd);
+	void SyncGrid(bool faces);
+	void ReleaseCache();
+	uint64_t CacheKey(int meshSize, VECTOR3D origin, double meshLength, double meshWidth, VECTOR3D dir1, VECTOR3D dir2);
+
+	MeshVertex &GridVertex(int row, int col)
+	{
+		return vertices[row*(gridSize+1)+col];
+	}
 
 public:
 
 	typedef std::pair<int, int> MaxMeshDim;
 
-	QuadMesh(int maxMeshSize = 40, float meshDim = 1.0f);
+	// allocator may be shared by many meshes, NULL uses the aligned heap
+	QuadMesh(int maxMeshSize = 40, float meshDim = 1.0f, MeshAllocator *allocator = NULL);
 	
 	~QuadMesh()
 	{
+		FreeBuffers();
 		FreeMemory();
+		SetCacheFile(NULL);
 	}
 
+	static bool SupportsVBO();
+	static bool SupportsPrimitiveRestart();
+
 	MaxMeshDim GetMaxMeshDimentions()
 	{
 		return MaxMeshDim(minMeshSize, maxMeshSize);
 	}
+
+	int GetNumVertices() const { return numVertices; }
+	int GetGridSize() const { return gridSize; }
+
+	// NULL while the mesh is compact, use GetVertex then
+	const MeshVertex *GetVertices() const { return vertices; }
+	MeshVertex GetVertex(int row, int col) const;
+	float GetHeight(int row, int col) const;
+
+	// Quad index list, 4 a quad
+	int GetNumIndices() const { return numIndices; }
+	GLuint GetIndex(int i) const
+	{
+		return indexType == GL_UNSIGNED_SHORT ? ((const GLushort *)indices)[i] : ((const GLuint *)indices)[i];
+	}
+
+	// Height at a point's projection onto the grid, bilinear between the vertices
+	// around it, 0 off the mesh
+	float SampleHeight(VECTOR3D point) const;
+
+	// Bytes of vertex data held in system memory (interleaved, SoA and face arrays,
+	// or the compact vertices)
+	size_t GetVertexMemory() const;
+
+	// Bytes of the quad index list and the cache ordered indices in system memory
+	size_t GetIndexMemory() const;
+
+	// Without quad indices the mesh only holds vertices, for callers drawing it with
+	// their own index lists after BindVertexArrays. DrawMesh then draws nothing. Takes
+	// effect from the next InitMesh.
+	void SetQuadIndices(bool quadIndices);
+
+	bool SetCompact(bool compact);
+	bool IsCompact() const { return compactVertices != NULL; }
 	
+	void SetCacheFile(const char *path);
+	bool IsMappedFromCache() const { return cacheView.base != NULL; }
 	bool InitMesh(int meshSize, VECTOR3D origin, double meshLength, double meshWidth,VECTOR3D dir1, VECTOR3D dir2);
+
+	// Regenerate the last InitMesh grid, flat, with meshSize quads per side without
+	// allocating. Fails above the reserved size, Reserve grows it.
+	bool Resize(int meshSize);
+	void Reserve(int maxMeshSize);
 	void DrawMesh(int meshSize);
+	void ApplyMaterial();
+	void BindVertexArrays();
+	void UnbindVertexArrays();
+	void SetRetained(bool retained);
+	bool IsRetained() const { return retained; }
+	void SetOptimizedOrder(bool optimized) { optimizedOrder = optimized; }
+	bool IsOptimizedOrder() const { return optimizedOrder; }
+	void SetUseStrips(bool strips) { useStrips = strips; orderBuilt = false; }
+	void DisplaceRegion(int rowBegin, int colBegin, int rowEnd, int colEnd, float height);
+	void ApplyBrush(VECTOR3D center, float radius, float height);
+	void SetHeights(const float *heights, int rowStride);
 	void UpdateMesh();
 	void SetMaterial(VECTOR3D ambient, VECTOR3D diffuse, VECTOR3D specular, double shininess);
+	const GLfloat *GetAmbient() const { return mat_ambient; }
+	const GLfloat *GetSpecular() const { return mat_specular; }
+	const GLfloat *GetDiffuse() const { return mat_diffuse; }
+	const GLfloat *GetShininess() const { return mat_shininess; }
 	void ComputeNormals();
+	void SetJobSystem(JobSystem *jobs) { this->jobs = jobs; }
+	void SetKernels(const MeshKernels *kernels) { this->kernels = kernels ? kernels : SelectMeshKernels(); }
+	const MeshKernels *GetKernels() const { return kernels; }
 	
 	
 };
@@ -0,0 +1,131 @@
+#define GL_SILENCE_DEPRECATION
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#include <GLUT/glut.h>
+#else
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+#include <GL/glut.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include "VECTOR3D.h"
+#include "GeometryCache.h"
+#include "Profiler.h"
+#include "RenderQueue.h"
+
+MaterialTracker::MaterialTracker()
+{
+	current = -1;
+	stateChanges = 0;
+}
+
+void MaterialTracker::Apply(int id, const RenderMaterial &material)
+{
+	if(id == current)
+		return;
+
+	glMaterialfv(GL_FRONT, GL_AMBIENT, material.ambient);
+	glMaterialfv(GL_FRONT, GL_SPECULAR, material.specular);
+	glMaterialfv(GL_FRONT, GL_DIFFUSE, material.diffuse);
+	glMaterialfv(GL_FRONT, GL_SHININESS, material.shininess);
+	PROFILE_COUNT(counterMaterialChanges, 1);
+	current = id;
+	stateChanges++;
+}
+
+
+RenderQueue::RenderQueue()
+{
+	itemsDrawn = 0;
+	stateChanges = 0;
+	submittedStateChanges = 0;
+}
+
+int RenderQueue::AddMaterial(const GLfloat *ambient, const GLfloat *specular, const GLfloat *diffuse, const GLfloat *shininess)
+{
+	RenderMaterial material = { ambient, specular, diffuse, shininess };
+	materials.push_back(material);
+	return (int)materials.size()-1;
+}
+
+uint64_t RenderQueue::MakeKey(int material, GeometryCache::Handle primitive, float depth)
+{
+	// Non-negative floats sort like their bit patterns
+	uint32_t depthBits = 0;
+	if(depth > 0.0f)
+		memcpy(&depthBits, &depth, sizeof(depthBits));
+
+	return ((uint64_t)(material & 0xffff) << 48) | ((uint64_t)(primitive & 0xffff) << 32) | depthBits;
+}
+
+void RenderQueue::Submit(int material, GeometryCache::Handle primitive, const GLfloat *model)
+{
+	if(material < 0 || material >= (int)materials.size() || primitive < 0)
+		return;
+
+	Item item;
+	item.material = material;
+	item.primitive = primitive;
+	memcpy(item.model, model, sizeof(item.model));
+	items.push_back(item);
+}
+
+void RenderQueue::Flush(GeometryCache *geometry)
+{
+	PROFILE_ZONE("RenderQueue::Flush");
+	submittedStateChanges = 0;
+	for(size_t i=0; i < items.size(); i++)
+	{
+		if(i == 0 || items[i].material != items[i-1].material)
+			submittedStateChanges++;
+	}
+
+	GLfloat view[16];
+	glMatrixMode(GL_MODELVIEW);
+	glGetFloatv(GL_MODELVIEW_MATRIX, view);
+
+	// Keyed by the distance in front of the eye of each part's origin
+	for(size_t i=0; i < items.size(); i++)
+	{
+		const GLfloat *origin = &items[i].model[12];
+		const float eyeZ = view[2]*origin[0] + view[6]*origin[1] + view[10]*origin[2] + view[14];
+		SortEntry entry = { MakeKey(items[i].material, items[i].primitive, -eyeZ), (int)i };
+		sortEntries.push_back(entry);
+	}
+	std::sort(sortEntries.begin(), sortEntries.end());
+
+	// Materials may have been changed by whatever was drawn since the last Flush
+	tracker.Invalidate();
+	tracker.ResetStateChanges();
+
+	geometry->Bind();
+	for(size_t i=0; i < sortEntries.size(); i++)
+	{
+		const Item &item = items[sortEntries[i].item];
+		tracker.Apply(item.material, materials[item.material]);
+		glLoadMatrixf(view);
+		glMultMatrixf(item.model);
+		geometry->Draw(item.primitive);
+	}
+	geometry->Unbind();
+	glLoadMatrixf(view);
+
+	itemsDrawn = (int)items.size();
+	stateChanges = tracker.GetStateChanges();
+
+	Clear();
+}
+
+// clear keeps the capacity, later frames do not allocate
+void RenderQueue::Clear()
+{
+	items.clear();
+	sortEntries.clear();
+}
@@ -0,0 +1,96 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	RenderQueue.h
+//	Draws recorded during a frame and replayed sorted by a 64-bit key: material in the
+//	top 16 bits, primitive in the next 16 and eye-space depth (front to back) in the
+//	low 32. Each material is then set once per frame, not once per draw function.
+//	Items carry their model matrix, the view is whatever modelview is current at Flush.
+//
+//	MaterialTracker remembers the material last sent to GL and skips the glMaterialfv
+//	calls when asked for it again. Anything else that sets materials (QuadMesh,
+//	Terrain) must be followed by Invalidate.
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <stdint.h>
+#include <vector>
+
+// The glMaterialfv arrays of a material, not copied
+struct RenderMaterial
+{
+	const GLfloat *ambient;
+	const GLfloat *specular;
+	const GLfloat *diffuse;
+	const GLfloat *shininess;
+};
+
+class MaterialTracker
+{
+private:
+	int current;
+	int stateChanges;
+
+public:
+	MaterialTracker();
+
+	void Invalidate() { current = -1; }
+	void Apply(int id, const RenderMaterial &material);
+
+	// Materials actually sent to GL since the last reset
+	int GetStateChanges() const { return stateChanges; }
+	void ResetStateChanges() { stateChanges = 0; }
+};
+
+class RenderQueue
+{
+private:
+	struct SortEntry
+	{
+		uint64_t key;
+		int item;
+
+		bool operator<(const SortEntry &rhs) const { return key < rhs.key; }
+	};
+
+	struct Item
+	{
+		int material;
+		GeometryCache::Handle primitive;
+		GLfloat model[16];
+	};
+
+	std::vector<RenderMaterial> materials;
+	std::vector<Item> items;
+	std::vector<SortEntry> sortEntries;
+	MaterialTracker tracker;
+
+	// Statistics of the last Flush
+	int itemsDrawn;
+	int stateChanges;
+	int submittedStateChanges;
+
+	static uint64_t MakeKey(int material, GeometryCache::Handle primitive, float depth);
+
+public:
+	RenderQueue();
+
+	int AddMaterial(const GLfloat *ambient, const GLfloat *specular, const GLfloat *diffuse, const GLfloat *shininess);
+	const RenderMaterial &GetMaterial(int material) const { return materials[material]; }
+
+	// Records a draw of primitive with a column-major model matrix
+	void Submit(int material, GeometryCache::Handle primitive, const GLfloat *model);
+
+	// Sorts and draws everything submitted since the last Flush, then empties the queue
+	void Flush(GeometryCache *geometry);
+
+	// Drops everything submitted since the last Flush without drawing it
+	void Clear();
+
+	int GetItemsDrawn() const { return itemsDrawn; }
+	int GetStateChanges() const { return stateChanges; }
+	// Material changes the same draws would have needed in submission order
+	int GetSubmittedStateChanges() const { return submittedStateChanges; }
+};
+
+#endif	//RENDERQUEUE_H
@@ -3,8 +3,10 @@
 #include <OpenGL/gl.h>
 #include <GLUT/glut.h>
 #else
-#include <GL/gl.h>
+#ifdef _WIN32
 #include <windows.h>
+#endif
+#include <GL/gl.h>
 #include <GL/glut.h>
 #endif
 //
@@ -12,24 +14,31 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <chrono>
 #include <utility>
 #include <vector>
 #include "VECTOR3D.h"
 #include "QuadMesh.h"
+#include "Terrain.h"
+#include "GeometryCache.h"
+#include "RenderQueue.h"
+#include "TransformGraph.h"
+#include "AnimationClip.h"
+#include "RobotRig.h"
+#include "JobSystem.h"
+#include "RobotCrowd.h"
+#include "SimulationClock.h"
+#include "Headless.h"
+#include "SoftwareRenderer.h"
+#include "Profiler.h"
 
 //------------------------------------------------------------------------------------------------------
 
 const int vWidth  = 650;    // Viewport width in pixels
 const int vHeight = 500;    // Viewport height in pixels
 
-float robotBodyWidth = 8.0;
-float robotBodyLength = 9.0;
-float robotBodyDepth = 6.0;
-float upperArmLength = robotBodyLength;
-float upperArmWidth = 0.125*robotBodyWidth;
-float gunLength = upperArmLength / 4.0;
-float gunWidth = upperArmWidth;
-float gunDepth = upperArmWidth;
+int windowWidth = vWidth;
+int windowHeight = vHeight;
 
 // Control Robot body rotation on base
 float robotAngle = 30.0;
@@ -100,6 +109,70 @@ typedef struct BoundingBox {
 // Default Mesh Size
 int meshSize = 16;
 
+// Large chunked ground, built the first time it is switched on with 'g'
+Terrain *terrain = NULL;
+bool drawTerrain = false;
+int terrainSize = 1024;
+
+// Robot parts, tessellated once in initOpenGL and drawn from shared buffers
+GeometryCache *robotGeometry = NULL;
+
+// Robot draws are queued and drawn sorted by material at the end of drawRobot
+RenderQueue *robotQueue = NULL;
+int bodyMaterial, rubberMaterial, chromeMaterial;
+
+// Robot joints and parts, world matrices cached between frames
+RobotRig *robotRig = NULL;
+
+// Crowd of robots sharing the rig, switched on with 'm'
+RobotCrowd *crowd = NULL;
+bool drawCrowd = false;
+int crowdSize = 1000;
+float crowdSpacing = 24.0;
+
+// Crowd stepped on all cores once per displayed frame
+JobSystem *jobs = NULL;
+
+// Animations are systems on one fixed step clock, which is ticked once per frame while
+// any of them is active. 10 ms steps keep the speed the old 10 ms timers had.
+const double simulationStep = 0.01;
+const int frameInterval = 16;
+SimulationClock *simulation = NULL;
+bool clockRunning = false;
+int walkSystem, cannonSystem, crowdSystem;
+
+// The single robot's clips. 'w' fades from standing into the walk cycle and 'W' back,
+// the walk system stopping once standing; 'c' and 'C' play and pause the cannon.
+AnimationClip *walkClip = NULL;
+AnimationClip *standClip = NULL;
+AnimationClip *cannonClip = NULL;
+ClipPlayer walkPlayer;
+ClipPlayer cannonPlayer;
+const float walkFadeSeconds = 0.3f;
+
+// Robot pose before and after the last step, drawRobot interpolates between them
+float stepStartAngles[numRobotJoints];
+float stepEndAngles[numRobotJoints];
+
+// Simulated crowd time, and the time the crowd was last drawn at
+double crowdTime = 0.0;
+double crowdShownTime = 0.0;
+
+// Set by --headless: frames go to an offscreen framebuffer and the clock follows frame
+// numbers instead of real time, see runHeadless
+bool headless = false;
+double headlessTime = 0.0;
+
+// CPU renderer for --software, drawing the single robot and the ground patch
+SoftwareRenderer *software = NULL;
+int softwareGroundMaterial;
+
+// Zone timings and draw counters over the last frames, toggled with 'p'
+bool showProfile = false;
+
+// Set by --mesh-cache: the ground mesh is mapped from this file, written on first use
+const char *meshCacheFile = NULL;
+
 // Prototypes for functions in this module
 void initOpenGL(int w, int h);
 void display(void);
@@ -109,24 +182,44 @@ void mouseMotionHandler(int xMouse, int yMouse);
 void keyboard(unsigned char key, int x, int y);
 void functionKeys(int key, int x, int y);
 void animationHandler(int param);
-void walkAnimation(int param);
-void undoWalk(int param);
-void cannonAnimation(int param);
+void walkStep(float step);
+void cannonStep(float step);
+void crowdStep(float step);
+void saveStepStart();
+void saveStepEnd();
+void startClock();
+void clockTick(int param);
+bool advanceClock();
+double clockNow();
+int runHeadless(int argc, char **argv);
+void initSoftware(int w, int h);
+void drawSoftware();
+void setCamera();
+void poseRobot();
+void fireCannons();
+void toggleTerrain();
+void getRobotAngles(float *angles);
 void drawRobot();
-void drawBody();
-void drawLowerBody();
-void drawLeftArm();
-void drawUpperRightLeg();
-void drawlowerRightLeg();
-void drawUpperLeftLeg();
-void drawlowerLeftLeg();
-void drawRightCannon();
-void drawLeftCannon();
+void toggleCrowd();
+void setProjection();
 
 //------------------------------------------------------------------------------------------------------
 
 int main(int argc, char **argv)
 {
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--mesh-cache") == 0 && i + 1 < argc)
+			meshCacheFile = argv[++i];
+	}
+
+	// Batch rendering without a window
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--headless") == 0)
+			return runHeadless(argc, argv);
+	}
+
 	// Initialize GLUT
 	glutInit(&argc, argv);
 	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
@@ -188,6 +281,7 @@ void initOpenGL(int w, int h)
 	VECTOR3D dir1v = VECTOR3D(1.0f, 0.0f, 0.0f);
 	VECTOR3D dir2v = VECTOR3D(0.0f, 0.0f, -1.0f);
 	groundMesh = new QuadMesh(meshSize, 32.0);
+	groundMesh->SetCacheFile(meshCacheFile);
 	groundMesh->InitMesh(meshSize, origin, 32.0, 32.0, dir1v, dir2v);
 
 	VECTOR3D ambient = VECTOR3D(0.0f, 0.05f, 0.0f);
@@ -196,6 +290,31 @@ void initOpenGL(int w, int h)
 	float shininess = 0.2;
 	groundMesh->SetMaterial(ambient, diffuse, specular, shininess);
 
+	robotGeometry = new GeometryCache();
+	robotQueue = new RenderQueue();
+	bodyMaterial = robotQueue->AddMaterial(robotBody_mat_ambient, robotBody_mat_specular, robotBody_mat_diffuse, robotBody_mat_shininess);
+	rubberMaterial = robotQueue->AddMaterial(robotArm_mat_ambient, robotArm_mat_specular, robotArm_mat_diffuse, robotArm_mat_shininess);
+	chromeMaterial = robotQueue->AddMaterial(gun_mat_ambient, gun_mat_specular, gun_mat_diffuse, gun_mat_shininess);
+
+	float angles[numRobotJoints];
+	getRobotAngles(angles);
+	robotRig = new RobotRig();
+	robotRig->Build(robotGeometry, bodyMaterial, rubberMaterial, chromeMaterial, angles);
+
+	walkClip = new AnimationClip(MakeWalkClip());
+	standClip = new AnimationClip(MakeStandClip());
+	cannonClip = new AnimationClip(MakeCannonClip());
+	walkPlayer.Play(standClip);
+	cannonPlayer.Play(cannonClip);
+
+	simulation = new SimulationClock(simulationStep);
+	simulation->SetBeforeStep(saveStepStart);
+	simulation->SetAfterStep(saveStepEnd);
+	walkSystem = simulation->AddSystem(walkStep);
+	cannonSystem = simulation->AddSystem(cannonStep);
+	crowdSystem = simulation->AddSystem(crowdStep);
+	saveStepStart();
+	saveStepEnd();
 }
 
 
@@ -203,397 +322,120 @@ void initOpenGL(int w, int h)
 // or glutPostRedisplay() has been called.
 void display(void)
 {
+	// A window frame runs from one display to the next, headless frames are closed by
+	// runHeadless once read back
+	if (!headless)
+		Profiler::EndFrame();
+	PROFILE_ZONE("display");
+
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	glLoadIdentity();
-	// Create Viewing Matrix V
-	// Set up the camera at position (0, 6, 22) looking at the origin, up along positive y axis
-	gluLookAt(0.0, 6.0, 26.0, 0.0, -3.0, 0.0, 0.0, 1.0, 0.0);
+	setCamera();
 
 	// Draw Robot
 
 	// Apply modelling transformations M to move robot
 	// Current transformation matrix is set to IV, where I is identity matrix
 	// CTM = IV
-	drawRobot();
+	if (drawCrowd)
+	{
+		// Animate to the interpolated time, cull against this camera and pose the crowd,
+		// then draw what is in view
+		Matrix4 projection, view;
+		glGetFloatv(GL_PROJECTION_MATRIX, projection.m);
+		glGetFloatv(GL_MODELVIEW_MATRIX, view.m);
+		double shownTime = crowdTime + simulation->GetAlpha() * simulation->GetStep();
+		if (shownTime < crowdShownTime)
+			shownTime = crowdShownTime;
+		crowd->Step((float)(shownTime - crowdShownTime), projection * view, jobs);
+		crowdShownTime = shownTime;
+		crowd->Draw(robotGeometry, *robotQueue);
+	}
+	else
+		drawRobot();
 
 	// Draw ground
 	glPushMatrix();
 	glTranslatef(0.0, -20.0, 0.0);
-	groundMesh->DrawMesh(meshSize);
+	if (drawTerrain)
+		terrain->Draw();
+	else
+		groundMesh->DrawMesh(meshSize);
 	glPopMatrix();
 
-	glutSwapBuffers();   // Double buffering, swap buffers
-}
+	if (showProfile && !headless)
+		Profiler::DrawOverlay(windowWidth, windowHeight);
 
-void drawRobot()
-{
-	glPushMatrix();
-    // spin robot on base.
-    glRotatef(robotAngle, 0.0, 1.0, 0.0);
-     
-    //  Rotate torso and cannons at hip
-     glPushMatrix();
-     glRotatef(bodyJointAngle, 1.0, 0.0, 0.0);
-	 drawBody();
-     drawLeftCannon();
-     drawRightCannon();
-     glPopMatrix();
-
-//    Rotate hip at body
-    glPushMatrix();
-    glTranslatef(-(-0.5*robotBodyWidth - 0.5*upperArmWidth), -0.3*robotBodyLength, -0.7*robotBodyDepth);
-    glRotatef(hipJointAngle, 1.0, 0.0, 0.0);
-    glTranslatef(-0.5*robotBodyWidth - 0.5*upperArmWidth, 0.3*robotBodyLength, 0.7*robotBodyDepth);
-     drawUpperLeftLeg();
-     drawlowerLeftLeg();
-    glPopMatrix();
-	 drawUpperRightLeg();
-     drawlowerRightLeg();
-
-
-	glPopMatrix();
-}
-
-void drawBody()
-{
-	glMaterialfv(GL_FRONT, GL_AMBIENT, robotBody_mat_ambient);
-	glMaterialfv(GL_FRONT, GL_SPECULAR, robotBody_mat_specular);
-	glMaterialfv(GL_FRONT, GL_DIFFUSE, robotBody_mat_diffuse);
-	glMaterialfv(GL_FRONT, GL_SHININESS, robotBody_mat_shininess);
-    
-	glPushMatrix();
-	glScalef(robotBodyWidth, robotBodyLength, 2*robotBodyDepth);
-	glutSolidCube(1.0);
-	glPopMatrix();
-}
-
-//LEFT LEG
-void drawUpperLeftLeg()
-{
-    glMaterialfv(GL_FRONT, GL_AMBIENT, gun_mat_ambient);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, gun_mat_specular);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, gun_mat_diffuse);
-    glMaterialfv(GL_FRONT, GL_SHININESS, gun_mat_shininess);
-
-    glPushMatrix();  // 1
-    // --------------------------
-
-    // hip joint --------------------------
-    // Position hip joint with respect to parent body
-    glTranslatef(-0.5*robotBodyWidth - 0.5*upperArmWidth, -0.3*robotBodyLength, -0.7*robotBodyDepth); // this will be done last
-    
-    // build hip joint
-    glPushMatrix();
-    glScalef(1.0, 2.0, 2.0);
-    glutSolidCube(1.0);
-    glPopMatrix();
-    
-    // upper leg --------------------------
-    
-    glPushMatrix();
-
-    // Rotate leg at hip
-    glRotatef(-30.0, 0.0, 0.0, 1.0);
-    // Position whole leg with respect to parent hip joint
-    glTranslatef(0.0, -1.5, 0.0);
-
-    // build upper leg
-    glScalef(1.0, 2.0, 1.0);
-    glutSolidCube(2.0);
-
-    glPopMatrix();
-    
-    // --------------------------
-//    drawlowerLeftLeg();
-    glPopMatrix();  // 1
-}
-
-
-void drawlowerLeftLeg()
-{
-    glMaterialfv(GL_FRONT, GL_AMBIENT, robotArm_mat_ambient);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, robotArm_mat_specular);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, robotArm_mat_diffuse);
-    glMaterialfv(GL_FRONT, GL_SHININESS, robotArm_mat_shininess);
-
-    glPushMatrix();
-    // Rotate leg at knee
-    glTranslatef(-7.0, -5, -7);
-    glRotatef(kneeJointAngle, 1.0, 0.0, 0.0);
-    glTranslatef(7.0, 5, 7);
-
-    // Position leg with respect to parent upper leg
-    glTranslatef(-7.0, -11, -5);
-
-    // build leg
-    glPushMatrix();
-    glScalef(1.0, 4.0, 1.0);
-    glutSolidCube(3.0);
-    glPopMatrix();
-
-    //  foot-----------------------------------------------------
-    glMaterialfv(GL_FRONT, GL_AMBIENT, gun_mat_ambient);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, gun_mat_specular);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, gun_mat_diffuse);
-    glMaterialfv(GL_FRONT, GL_SHININESS, gun_mat_shininess);
-
-    glPushMatrix();
-    // Position foot with respect to parent leg
-    glTranslatef(0, -(0.5*upperArmLength + 0.5*gunLength), 0.0);
-
-    // build foot
-    glScalef(4.0, -2.0, -2.0);
-    glutSolidCube(1.0);
-    glPopMatrix();
-    //  foot-----------------------------------------------------
-
-    glPopMatrix();
+	if (!headless)
+	{
+		PROFILE_ZONE("glutSwapBuffers");
+		glutSwapBuffers();   // Double buffering, swap buffers
+	}
 }
 
-//RIGHT LEG
-void drawUpperRightLeg()
+// Create Viewing Matrix V
+void setCamera()
 {
-    // upper leg ------------------------------------------------------------
-    glMaterialfv(GL_FRONT, GL_AMBIENT, gun_mat_ambient);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, gun_mat_specular);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, gun_mat_diffuse);
-    glMaterialfv(GL_FRONT, GL_SHININESS, gun_mat_shininess);
-
-    glPushMatrix();  // 1
-    // Position hip joint with respect to parent body
-    glTranslatef(0.5*robotBodyWidth + 0.5*upperArmWidth, -0.3*robotBodyLength, -0.7*robotBodyDepth); // this will be done last
-
-    // build hip joint
-    glPushMatrix();
-    glScalef(1.0, 2.0, 2.0);
-    glutSolidCube(1.0);
-    glPopMatrix();
-
-    // Rotate leg at hip
-//    glRotatef(30.0, 1.0, 0.0, 0.0);
-    glRotatef(30.0, 0.0, 0.0, 1.0);
-
-    // Position whole leg with respect to parent hip joint
-    glTranslatef(0.0, -1.5, 0.0);
-
-    // build upper leg
-    glPushMatrix();
-    glScalef(1.0, 2.0, 1.0);
-    glutSolidCube(2.0);
-    glPopMatrix();
-
-    glPopMatrix();  // 1
+	// Set up the camera at position (0, 6, 22) looking at the origin, up along positive y axis
+	if (drawCrowd)
+		gluLookAt(0.0, 120.0, 260.0, 0.0, -20.0, 0.0, 0.0, 1.0, 0.0);
+	else
+		gluLookAt(0.0, 6.0, 26.0, 0.0, -3.0, 0.0, 0.0, 1.0, 0.0);
 }
 
-
-void drawlowerRightLeg()
+// Joint angles of the single robot, in RobotJoint order
+void getRobotAngles(float *angles)
 {
-    glMaterialfv(GL_FRONT, GL_AMBIENT, robotArm_mat_ambient);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, robotArm_mat_specular);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, robotArm_mat_diffuse);
-    glMaterialfv(GL_FRONT, GL_SHININESS, robotArm_mat_shininess);
-
-    glPushMatrix();
-    // Rotate leg at knee
-    glTranslatef((0.5*robotBodyWidth + 0.5*upperArmWidth), 0.5*upperArmLength, 0.0);
-    glRotatef(shoulderAngle, 1.0, 0.0, 0.0);
-    glTranslatef((0.5*robotBodyWidth + 0.5*upperArmWidth), -0.5*upperArmLength, 0.0);
-
-    // Position leg with respect to parent upper leg
-    glTranslatef(-2.0, -5.0, -11.0);
-
-    // build leg
-    glPushMatrix();
-    glScalef(1.0, 4.0, 1.0);
-    glutSolidCube(3.0);
-    glPopMatrix();
-
-    //  foot-----------------------------------------------------
-    glMaterialfv(GL_FRONT, GL_AMBIENT, gun_mat_ambient);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, gun_mat_specular);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, gun_mat_diffuse);
-    glMaterialfv(GL_FRONT, GL_SHININESS, gun_mat_shininess);
-
-    glPushMatrix();
-    // Position foot with respect to parent leg
-    glTranslatef(0, -(0.5*upperArmLength + 0.5*gunLength), 0.0);
-
-    // build foot
-    glScalef(4.0, -2.0, -2.0);
-    glutSolidCube(1.0);
-    glPopMatrix();
-    //  foot-----------------------------------------------------
-
-    glPopMatrix();
+    angles[jointSpin] = robotAngle;
+    angles[jointBody] = bodyJointAngle;
+    angles[jointHip] = hipJointAngle;
+    angles[jointKnee] = kneeJointAngle;
+    angles[jointRightKnee] = shoulderAngle;
+    angles[jointCannon] = cannonRotation;
 }
 
-void drawLeftCannon()
+void drawRobot()
 {
-    //    Black
-    glMaterialfv(GL_FRONT, GL_AMBIENT, robotArm_mat_ambient);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, robotArm_mat_specular);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, robotArm_mat_diffuse);
-    glMaterialfv(GL_FRONT, GL_SHININESS, robotArm_mat_shininess);
-
-    glPushMatrix();  // 1
-    
-    // Rotate cannon around its own “length” axis
-    glTranslatef(-5, 5, 0);
-    glRotatef(cannonRotation, 0.0, 0.0, 1.0);
-    glTranslatef(5, -5, 0);
-    
-    // Position whole cannon with respect to parent body ---------------
-    glTranslatef(-5.0, 5.0, -1.0); // this will be done last
-
-    // build cannon (torus) --------------------------------------------
-    glPushMatrix();  // 2
-    glScalef(1.0, 1.0, 7.0);
-    glutSolidTorus(0.7, 1.0, 20, 20);
-    glPopMatrix();  // 2
-    
-    //  CYLINDER --------------------------------------
-    //    Chrome/silver looking
-    glMaterialfv(GL_FRONT, GL_AMBIENT, gun_mat_ambient);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, gun_mat_specular);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, gun_mat_diffuse);
-    glMaterialfv(GL_FRONT, GL_SHININESS, gun_mat_shininess);
-    
-    glPushMatrix();  //  3
-    // Position cylinder thing with respect to parent cannon torus
-    glTranslatef(0.0, 0.0, -5.0);
-
-    // build cylinder thing ------------------------------------------------
-    glScalef(1.0, 1.0, 1.0);
-    GLUquadricObj*myCylcinder;
-    myCylcinder = gluNewQuadric();
-    gluQuadricDrawStyle(myCylcinder, GLU_FILL);
-    gluCylinder(myCylcinder, 2.5, 2.5, 1.0, 20, 20);
-//    glutSolidSphere(2.0, 8, 8);
-    
-    //  BACK DISK ----------------------------------------
-    glPushMatrix();  // 4
-    // Position circle thing with respect to cylinder cannon
-    glTranslatef(0.0, 0.0, 0.0);
-    
-    // build circle thing (back)
-    glScalef(1.0, 1.0, 1.0);
-    GLUquadricObj*myDisk;
-    myDisk = gluNewQuadric();
-    gluQuadricDrawStyle(myDisk, GLU_FILL);
-    gluDisk(myDisk, 0.0, 2.5, 20, 1);
-    
-    //  FRONT DISK ----------------------------------------
-    glPushMatrix();  //  5
-    // Position circle thing with respect to cylinder cannon
-    glTranslatef(0.0, 0.0, 1.0);
-    
-    // build circle thing (front)
-    glScalef(1.0, 1.0, 1.0);
-    GLUquadricObj*myDiskF;
-    myDiskF = gluNewQuadric();
-    gluQuadricDrawStyle(myDiskF, GLU_FILL);
-    gluDisk(myDisk, 0.0, 2.5, 20, 1);
-    
-    //  SMALL CANNON SUB-PART ----------------------------------------
-    glPushMatrix();  // 6
-    // Position circle thing with respect to cylinder cannon
-    glRotatef(270, 1.0, 0.0, 0.0);
-    glTranslatef(0.0, -7.0, 1.2);
-    
-    // build circle thing (back)
-    glutSolidCone(1.0, 1.0, 20, 20);
-
-    glPopMatrix();  //  6 FRONT DISK -----------------------
-
-    glPopMatrix();  //  5
-    
-    glPopMatrix();  //  4
-
-    glPopMatrix();  //  3
-    
-    glPopMatrix();  //  1
+    PROFILE_ZONE("drawRobot");
+    poseRobot();
 
+    const Matrix4 *worlds = robotRig->GetGraph().GetWorlds();
+    for (int i = 0; i < robotRig->GetNumParts(); i++)
+    {
+        const RigPart &part = robotRig->GetPart(i);
+        robotQueue->Submit(part.material, part.primitive, worlds[part.node].m);
+    }
+    robotQueue->Flush(robotGeometry);
 }
 
-void drawRightCannon()
+void poseRobot()
 {
-    glMaterialfv(GL_FRONT, GL_AMBIENT, robotArm_mat_ambient);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, robotArm_mat_specular);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, robotArm_mat_diffuse);
-    glMaterialfv(GL_FRONT, GL_SHININESS, robotArm_mat_shininess);
-
-    glPushMatrix();
-    
-    // Position cannon with respect to parent body
-    glTranslatef(5.0, 5.0, -1.0); // this will be done last
-
-    // build cannon
-    glPushMatrix();
-    glScalef(1.0, 1.0, 7.0);
-    glutSolidTorus(0.7, 1.0, 20, 20);
-    glPopMatrix();
-    
-    //  Circle thing at the back
-    glMaterialfv(GL_FRONT, GL_AMBIENT, gun_mat_ambient);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, gun_mat_specular);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, gun_mat_diffuse);
-    glMaterialfv(GL_FRONT, GL_SHININESS, gun_mat_shininess);
-    
-    glPushMatrix();
-    // Position circle thing with respect to parent cannon
-    glTranslatef(0.0, 0.0, -5.0);
-
-    // build cylinder thing------------------------------------------------------------
-    glScalef(1.0, 1.0, 1.0);
-    GLUquadricObj*myCylcinder;
-    myCylcinder = gluNewQuadric();
-    gluQuadricDrawStyle(myCylcinder, GLU_FILL);
-    gluCylinder(myCylcinder, 2.5, 2.5, 1.0, 20, 20);
-//    glutSolidSphere(2.0, 8, 8);
-    
-    //  disk thing at the back
-    glMaterialfv(GL_FRONT, GL_AMBIENT, gun_mat_ambient);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, gun_mat_specular);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, gun_mat_diffuse);
-    glMaterialfv(GL_FRONT, GL_SHININESS, gun_mat_shininess);
-    
-    glPushMatrix();
-    // Position circle thing with respect to cylinder cannon
-    glTranslatef(0.0, 0.0, 0.0);
-    
-    // build circle thing (back)------------------------------------------------------------
-    glScalef(1.0, 1.0, 1.0);
-    GLUquadricObj*myDisk;
-    myDisk = gluNewQuadric();
-    gluQuadricDrawStyle(myDisk, GLU_FILL);
-    gluDisk(myDisk, 0.0, 2.5, 20, 1);
-    
-    //  disk thing at the front
-    glMaterialfv(GL_FRONT, GL_AMBIENT, gun_mat_ambient);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, gun_mat_specular);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, gun_mat_diffuse);
-    glMaterialfv(GL_FRONT, GL_SHININESS, gun_mat_shininess);
-    
-    glPushMatrix();
-    // Position circle thing with respect to cylinder cannon
-    glTranslatef(0.0, 0.0, 1.0);
-    
-    // build circle thing (front)------------------------------------------------------------
-    glScalef(1.0, 1.0, 1.0);
-    GLUquadricObj*myDiskF;
-    myDiskF = gluNewQuadric();
-    gluQuadricDrawStyle(myDiskF, GLU_FILL);
-    gluDisk(myDisk, 0.0, 2.5, 20, 1);
-    
-    glPopMatrix();
-    
-    glPopMatrix();
-    
-    glPopMatrix();
-    
-    glPopMatrix();
+    PROFILE_ZONE("poseRobot");
+    // Joints the last step moved are drawn part way into it, joints set from input since
+    // are drawn as they are. Only joints whose angle changed since the last frame are
+    // recomputed. Angles go the short way round, as the cannon does when its clip wraps
+    // from 360 to 0.
+    float angles[numRobotJoints];
+    getRobotAngles(angles);
+    const float alpha = simulation->GetAlpha();
+    for (int j = 0; j < numRobotJoints; j++)
+    {
+        if (angles[j] == stepEndAngles[j])
+        {
+            float delta = stepEndAngles[j] - stepStartAngles[j];
+            delta -= 360.0f * floorf(delta / 360.0f + 0.5f);
+            angles[j] = stepStartAngles[j] + alpha * delta;
+        }
+    }
 
+    // The robot stands at the origin of the ground mesh, the terrain is elsewhere
+    if (!drawTerrain)
+    {
+        const float origin = 0.0f;
+        PlantLeftFeet(*groundMesh, &origin, &origin, &angles[jointSpin], &angles[jointHip], &angles[jointKnee], 1);
+    }
+    robotRig->Pose(angles);
 }
 
 // Callback, called at initialization and whenever user resizes the window.
@@ -602,10 +444,10 @@ void reshape(int w, int h)
 	// Set up viewport, projection, then change to modelview matrix mode - 
 	// display function will then set up camera and do modeling transforms.
 	glViewport(0, 0, (GLsizei)w, (GLsizei)h);
+	windowWidth = w;
+	windowHeight = h;
 
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	gluPerspective(60.0, (GLdouble)w / h, 0.2, 40.0);
+	setProjection();
 
 	glMatrixMode(GL_MODELVIEW);
 	glLoadIdentity();
@@ -614,9 +456,6 @@ void reshape(int w, int h)
 	gluLookAt(0.0, 6.0, 22.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0);
 }
 
-bool stop = false;
-bool walk = false;
-
 // Callback, handles input from the keyboard, non-arrow keys
 void keyboard(unsigned char key, int x, int y)
 {
@@ -647,62 +486,191 @@ void keyboard(unsigned char key, int x, int y)
 		robotAngle -= 2.0;
 		break;
     case 'c':
-        stop = false;
-        glutTimerFunc(10, cannonAnimation, 0);
+        simulation->SetActive(cannonSystem, true);
+        startClock();
         break;
     case 'C':
-        stop = true;
+        simulation->SetActive(cannonSystem, false);
         break;
     case 'w':
-        walk = true;
-        glutTimerFunc(10, walkAnimation, 0);
+        if (walkPlayer.GetClip() != walkClip)
+            walkPlayer.Play(walkClip, walkFadeSeconds);
+        simulation->SetActive(walkSystem, true);
+        startClock();
         break;
     case 'W':
-        walk = false;
-        glutTimerFunc(10, undoWalk, 0);
+        if (walkPlayer.GetClip() == walkClip)
+            walkPlayer.Play(standClip, walkFadeSeconds);
+        break;
+    case 'f':
+        fireCannons();
+        break;
+    case 'g':
+        toggleTerrain();
+        break;
+    case 's':
+        if (drawCrowd)
+            printf("Crowd: %d robots, %d in view, %d draws, %d material changes, %.1f MB, %d threads\n",
+                crowd->GetNumRobots(), crowd->GetNumVisible(), crowd->GetDrawsIssued(), crowd->GetStateChanges(),
+                crowd->GetMemory() / (1024.0 * 1024.0), jobs->GetNumThreads());
+        else
+            printf("Robot: %d draws, %d material changes (%d unsorted), %d of %d transforms updated\n",
+                robotQueue->GetItemsDrawn(), robotQueue->GetStateChanges(), robotQueue->GetSubmittedStateChanges(),
+                robotRig->GetGraph().GetNodesUpdated(), robotRig->GetGraph().GetNumNodes());
+        break;
+    case 'm':
+        toggleCrowd();
+        break;
+    case 'p':
+        showProfile = !showProfile;
+        break;
+    case 'P':
+        if (Profiler::WriteChromeTrace("profile.json"))
+            printf("Wrote profile.json\n");
         break;
 	}
 
-	glutPostRedisplay();   // Trigger a window redisplay
+	if (!headless)
+		glutPostRedisplay();   // Trigger a window redisplay
+}
+
+
+void walkStep(float step)
+{
+    float angles[numRobotJoints];
+    getRobotAngles(angles);
+    walkPlayer.Advance(step);
+    walkPlayer.Sample(angles);
+    hipJointAngle = angles[jointHip];
+    kneeJointAngle = angles[jointKnee];
+    shoulderAngle = angles[jointRightKnee];
+    bodyJointAngle = angles[jointBody];
+
+    // Done once the fade back to standing is
+    if (walkPlayer.GetClip() == standClip && !walkPlayer.IsFading())
+        simulation->SetActive(walkSystem, false);
+}
+
+void cannonStep(float step)
+{
+    float angles[numRobotJoints];
+    getRobotAngles(angles);
+    cannonPlayer.Advance(step);
+    cannonPlayer.Sample(angles);
+    cannonRotation = angles[jointCannon];
+}
+
+void crowdStep(float step)
+{
+    crowdTime += step;
+}
+
+void saveStepStart()
+{
+    getRobotAngles(stepStartAngles);
+}
+
+void saveStepEnd()
+{
+    getRobotAngles(stepEndAngles);
 }
 
+// Starts ticking the clock, one tick chain however many animations are running
+void startClock()
+{
+    if (clockRunning)
+        return;
+    clockRunning = true;
+    simulation->Resume(clockNow());
+    if (!headless)
+        glutTimerFunc(frameInterval, clockTick, 0);
+}
 
-void walkAnimation(int param)
+// Redraws after each tick, until nothing is animating
+void clockTick(int param)
 {
-    if (walk)
+    if (advanceClock())
     {
-        if (hipJointAngle <= 40.0)
-        {
-            hipJointAngle += 1.0;
-        }
-        if (kneeJointAngle >= -30.0)
-        {
-            kneeJointAngle -= 1.0;
-        }
         glutPostRedisplay();
-        glutTimerFunc(10, walkAnimation, 0);
+        glutTimerFunc(frameInterval, clockTick, 0);
     }
 }
 
-void undoWalk(int param)
+// Runs the steps that are due, false once nothing is animating
+bool advanceClock()
 {
-    if (!walk)
+    if (!simulation->HasActiveSystems())
     {
-        hipJointAngle = 0.0;
-        kneeJointAngle = -40.0;
-        bodyJointAngle = 0.0;
-        glutPostRedisplay();
+        clockRunning = false;
+        return false;
     }
+    simulation->Advance(clockNow());
+    return true;
 }
 
-void cannonAnimation(int param)
+// Seconds, real time in a window and frame time when headless
+double clockNow()
 {
-    if (!stop)
+    if (headless)
+        return headlessTime;
+    return glutGet(GLUT_ELAPSED_TIME) / 1000.0;
+}
+
+// Crater the ground where each cannon points, only the hit tiles are rebuilt
+void fireCannons()
+{
+    const float range = 12.0;
+    const float angle = robotAngle * M_PI / 180.0;
+    const float cannonX[] = { -5.0, 5.0 };
+
+    for (int i = 0; i < 2; i++)
     {
-        cannonRotation += 1.0;
-        glutPostRedisplay();
-        glutTimerFunc(10, cannonAnimation, 0);
+        // Cannon aim point in robot space rotated with the robot about y, in ground mesh space
+        VECTOR3D hit(cannonX[i] * cos(angle) + range * sin(angle), 0.0, -cannonX[i] * sin(angle) + range * cos(angle));
+        groundMesh->ApplyBrush(hit, 3.0, -1.5);
     }
+    groundMesh->UpdateMesh();
+}
+
+// Switch between the small ground mesh and the large chunked terrain
+void toggleTerrain()
+{
+    if (!terrain)
+    {
+        const float worldSize = 512.0;
+        terrain = new Terrain(terrainSize, 64, worldSize);
+        terrain->GenerateHills(2.0, 60.0);
+        terrain->SetCompactChunks(true);
+        terrain->Build(VECTOR3D(-0.5 * worldSize, 0.0f, 0.5 * worldSize));
+        terrain->SetMaterial(VECTOR3D(0.0f, 0.05f, 0.0f), VECTOR3D(0.4f, 0.8f, 0.4f), VECTOR3D(0.04f, 0.04f, 0.04f), 0.2);
+    }
+    drawTerrain = !drawTerrain;
+}
+
+// Switch between the single robot and a crowd of crowdSize robots walking in place
+void toggleCrowd()
+{
+    if (!crowd)
+    {
+        jobs = new JobSystem();
+        crowd = new RobotCrowd(robotRig);
+        crowd->SetGround(groundMesh);
+        crowd->Spawn(crowdSize, crowdSpacing);
+    }
+    drawCrowd = !drawCrowd;
+    setProjection();
+    simulation->SetActive(crowdSystem, drawCrowd);
+    if (drawCrowd)
+        startClock();
+}
+
+// The crowd needs a far plane beyond the single robot's ground
+void setProjection()
+{
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluPerspective(60.0, (GLdouble)windowWidth / windowHeight, 0.2, drawCrowd ? 1000.0 : 40.0);
+    glMatrixMode(GL_MODELVIEW);
 }
 
 // Callback, handles input from the keyboard, function and arrow keys
@@ -727,7 +695,8 @@ void functionKeys(int key, int x, int y)
         else if (bodySelect) { bodyJointAngle += 2.0; }
     }
 
-	glutPostRedisplay();   // Trigger a window redisplay
+	if (!headless)
+		glutPostRedisplay();   // Trigger a window redisplay
 }
 
 
@@ -770,3 +739,200 @@ void mouseMotionHandler(int xMouse, int yMouse)
 	glutPostRedisplay();   // Trigger a window redisplay
 }
 
+
+// Draws frames into an offscreen framebuffer, for machines without a display:
+//   3DBot --headless [--frames N] [--size WxH] [--fps N] [--script file] [--output prefix] [--format ppm|png]
+//                    [--software] [--trace file] [--mesh-cache file]
+// Frame i is written to <prefix>0000.ppm and on, with --output none nothing is written.
+// --software draws with SoftwareRenderer instead of GL, see drawSoftware. --trace writes
+// the profiler's zones as Chrome trace JSON at the end and prints their timings.
+// Keys from the script are pressed before their frame, and each frame moves the
+// animation clock on by 1/fps seconds, so the same arguments give the same frames.
+int runHeadless(int argc, char **argv)
+{
+    int frames = 60;
+    int width = vWidth;
+    int height = vHeight;
+    double fps = 60.0;
+    const char *scriptFile = NULL;
+    const char *output = "frame";
+    bool png = false;
+    bool useSoftware = false;
+    const char *traceFile = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--headless") == 0)
+            continue;
+        else if (strcmp(argv[i], "--mesh-cache") == 0 && hasValue)
+            i++;
+        else if (strcmp(argv[i], "--frames") == 0 && hasValue)
+            frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--size") == 0 && hasValue)
+        {
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2)
+                width = 0;
+        }
+        else if (strcmp(argv[i], "--fps") == 0 && hasValue)
+            fps = atof(argv[++i]);
+        else if (strcmp(argv[i], "--script") == 0 && hasValue)
+            scriptFile = argv[++i];
+        else if (strcmp(argv[i], "--output") == 0 && hasValue)
+        {
+            output = argv[++i];
+            if (strcmp(output, "none") == 0)
+                output = NULL;
+        }
+        else if (strcmp(argv[i], "--software") == 0)
+            useSoftware = true;
+        else if (strcmp(argv[i], "--trace") == 0 && hasValue)
+            traceFile = argv[++i];
+        else if (strcmp(argv[i], "--format") == 0 && hasValue)
+        {
+            png = strcmp(argv[++i], "png") == 0;
+            if (!png && strcmp(argv[i], "ppm") != 0)
+                frames = -1;
+        }
+        else
+            frames = -1;
+    }
+    if (frames < 0 || width <= 0 || height <= 0 || fps <= 0.0)
+    {
+        fprintf(stderr, "Usage: %s --headless [--frames N] [--size WxH] [--fps N] [--script file] "
+            "[--output prefix|none] [--format ppm|png] [--software] [--trace file] [--mesh-cache file]\n", argv[0]);
+        return 1;
+    }
+
+    AnimationScript script;
+    if (scriptFile && !script.Load(scriptFile))
+        return 1;
+
+    HeadlessContext context;
+    if (!context.Create(width, height))
+        return 1;
+
+    headless = true;
+    initOpenGL(width, height);
+    reshape(width, height);
+    if (useSoftware)
+        initSoftware(width, height);
+
+    typedef std::chrono::steady_clock Clock;
+    std::chrono::duration<double> renderTime(0.0);
+    const Clock::time_point start = Clock::now();
+    int nextKey = 0;
+    char fileName[1024];
+    std::vector<unsigned char> softwarePixels;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        headlessTime = frame / fps;
+        for (; nextKey < script.GetNumKeys() && script.GetKey(nextKey).frame <= frame; nextKey++)
+        {
+            const ScriptKey &key = script.GetKey(nextKey);
+            if (key.special >= 0)
+                functionKeys(key.special, 0, 0);
+            else
+                keyboard(key.key, 0, 0);
+        }
+        if (clockRunning)
+            advanceClock();
+
+        // Reading back waits for the frame to finish
+        const Clock::time_point frameStart = Clock::now();
+        const unsigned char *pixels;
+        if (software)
+        {
+            drawSoftware();
+            PROFILE_ZONE("ReadPixels");
+            software->ReadPixels(softwarePixels);
+            pixels = &softwarePixels[0];
+        }
+        else
+        {
+            display();
+            PROFILE_ZONE("ReadPixels");
+            context.ReadPixels();
+            pixels = context.GetPixels();
+        }
+        renderTime += Clock::now() - frameStart;
+        Profiler::EndFrame();
+
+        if (output)
+        {
+            snprintf(fileName, sizeof(fileName), "%s%04d.%s", output, frame, png ? "png" : "ppm");
+            if (!(png ? WritePNG(fileName, pixels, width, height) : WritePPM(fileName, pixels, width, height)))
+            {
+                fprintf(stderr, "Cannot write %s\n", fileName);
+                return 1;
+            }
+        }
+    }
+
+    const std::chrono::duration<double> totalTime = Clock::now() - start;
+    printf("%d frames at %d x %d: %.1f frames/s rendered, %.1f frames/s with output\n", frames, width, height,
+        frames / renderTime.count(), frames / totalTime.count());
+
+    if (traceFile)
+    {
+        std::vector<ProfileStat> stats;
+        Profiler::GetZoneStats(stats);
+        printf("%-32s %10s %10s\n", "Zone (ms per frame)", "average", "p99");
+        for (size_t i = 0; i < stats.size(); i++)
+            printf("%-32s %10.3f %10.3f\n", stats[i].name, stats[i].average, stats[i].p99);
+        Profiler::GetCounterStats(stats);
+        for (size_t i = 0; i < stats.size(); i++)
+            printf("%-32s %10.0f %10.0f\n", stats[i].name, stats[i].average, stats[i].p99);
+        if (!Profiler::WriteChromeTrace(traceFile))
+        {
+            fprintf(stderr, "Cannot write %s\n", traceFile);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Lights and materials as initOpenGL gives GL, threads from the crowd's JobSystem
+void initSoftware(int w, int h)
+{
+    if (!jobs)
+        jobs = new JobSystem();
+    software = new SoftwareRenderer(w, h, jobs);
+    software->SetClearColor(0.4, 0.4, 0.4);
+    software->SetLight(0, light_position0, light_ambient, light_diffuse, light_specular);
+    software->SetLight(1, light_position1, light_ambient, light_diffuse, light_specular);
+
+    // Added in the robot queue's order, so the rig's material ids work here too
+    software->AddMaterial(robotBody_mat_ambient, robotBody_mat_specular, robotBody_mat_diffuse, robotBody_mat_shininess);
+    software->AddMaterial(robotArm_mat_ambient, robotArm_mat_specular, robotArm_mat_diffuse, robotArm_mat_shininess);
+    software->AddMaterial(gun_mat_ambient, gun_mat_specular, gun_mat_diffuse, gun_mat_shininess);
+    softwareGroundMaterial = software->AddMaterial(groundMesh->GetAmbient(), groundMesh->GetSpecular(),
+        groundMesh->GetDiffuse(), groundMesh->GetShininess());
+}
+
+// The single robot on the ground patch, drawn on the CPU with the camera display()
+// sets up. The crowd and the terrain are only drawn through GL.
+void drawSoftware()
+{
+    PROFILE_ZONE("drawSoftware");
+    Matrix4 projection, view;
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    setCamera();
+    glGetFloatv(GL_PROJECTION_MATRIX, projection.m);
+    glGetFloatv(GL_MODELVIEW_MATRIX, view.m);
+    software->Begin(projection, view);
+
+    poseRobot();
+    const Matrix4 *worlds = robotRig->GetGraph().GetWorlds();
+    for (int i = 0; i < robotRig->GetNumParts(); i++)
+    {
+        const RigPart &part = robotRig->GetPart(i);
+        software->DrawPrimitive(*robotGeometry, part.primitive, worlds[part.node], part.material);
+    }
+
+    Matrix4 ground;
+    ground.Translate(0.0, -20.0, 0.0);
+    software->DrawMesh(*groundMesh, ground, softwareGroundMaterial);
+    software->Render();
+}
@@ -0,0 +1,298 @@
+#define GL_SILENCE_DEPRECATION
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#include <GLUT/glut.h>
+#else
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+#include <GL/glut.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include "VECTOR3D.h"
+#include "GeometryCache.h"
+#include "RenderQueue.h"
+#include "TransformGraph.h"
+#include "VectorMath.h"
+#include "AnimationClip.h"
+#include "RobotRig.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "RobotCrowd.h"
+
+// Robots posed together, small enough that a block's node matrices stay in cache
+static const int crowdBlock = 64;
+
+// Robots per job in Step
+static const int crowdGrain = 256;
+
+// Sphere around a robot in any pose, relative to its position on the ground
+static const float boundsCenterY = -6.0f;
+static const float boundsRadius = 20.0f;
+
+RobotCrowd::RobotCrowd(const RobotRig *rig)
+	: walkClip(MakeWalkClip()), cannonClip(MakeCannonClip())
+{
+	this->rig = rig;
+	ground = NULL;
+	numRobots = 0;
+	drawsIssued = 0;
+	stateChanges = 0;
+	numVisible = 0;
+
+	for(int i=0; i < rig->GetNumParts(); i++)
+		drawOrder.push_back(i);
+	std::sort(drawOrder.begin(), drawOrder.end(), [rig](int a, int b)
+	{
+		const RigPart &pa = rig->GetPart(a);
+		const RigPart &pb = rig->GetPart(b);
+		if(pa.material != pb.material)
+			return pa.material < pb.material;
+		return pa.primitive < pb.primitive;
+	});
+}
+
+void RobotCrowd::Spawn(int count, float spacing)
+{
+	numRobots = count > 0 ? count : 0;
+	positionX.resize(numRobots);
+	positionZ.resize(numRobots);
+	walkTime.resize(numRobots);
+	cannonTime.assign(numRobots, 0.0f);
+	for(int j=0; j < numRobotJoints; j++)
+	{
+		cursors[j].assign(numRobots, 0);
+		angles[j].assign(numRobots, 0.0f);
+	}
+	visible.assign(numRobots, 1);
+	numVisible = numRobots;
+
+	const int side = (int)ceilf(sqrtf((float)numRobots));
+	const float offset = 0.5f*(side-1)*spacing;
+	for(int i=0; i < numRobots; i++)
+	{
+		positionX[i] = (i % side)*spacing - offset;
+		positionZ[i] = (i / side)*spacing - offset;
+
+		// Spread the headings and walk phases so the crowd does not move in lockstep
+		walkTime[i] = fmodf(i*0.618034f, 1.0f)*walkClip.GetDuration();
+		angles[jointSpin][i] = fmodf(i*137.507764f, 360.0f);
+	}
+
+	partWorlds.resize((size_t)rig->GetNumParts()*numRobots);
+	Animate(0.0f);
+}
+
+void RobotCrowd::Animate(float seconds, int first, int count)
+{
+	PROFILE_ZONE("RobotCrowd::Animate");
+	if(count <= 0)
+		return;
+	for(int i=first; i < first+count; i++)
+	{
+		walkTime[i] = walkClip.WrapTime(walkTime[i] + seconds);
+		cannonTime[i] = cannonClip.WrapTime(cannonTime[i] + seconds);
+	}
+
+	// A joint is driven by one of the clips
+	for(int j=0; j < numRobotJoints; j++)
+	{
+		const AnimationClip &clip = walkClip.HasCurve(j) ? walkClip : cannonClip;
+		const float *times = walkClip.HasCurve(j) ? &walkTime[first] : &cannonTime[first];
+		clip.SampleCurve(j, times, &cursors[j][first], &angles[j][first], count);
+	}
+	if(ground)
+	{
+		PlantLeftFeet(*ground, &positionX[first], &positionZ[first], &angles[jointSpin][first],
+			&angles[jointHip][first], &angles[jointKnee][first], count);
+	}
+}
+
+// Rows of the view-projection matrix give the planes, normalized so the distance to
+// a plane is in world units
+void RobotCrowd::FrustumPlanes(const Matrix4 &viewProjection, float planes[6][4])
+{
+	const float *m = viewProjection.m;
+	for(int i=0; i < 6; i++)
+	{
+		const int row = i / 2;
+		const float sign = (i % 2) ? -1.0f : 1.0f;
+		for(int k=0; k < 4; k++)
+			planes[i][k] = m[k*4+3] + sign*m[k*4+row];
+
+		const float length = sqrtf(planes[i][0]*planes[i][0] + planes[i][1]*planes[i][1] + planes[i][2]*planes[i][2]);
+		for(int k=0; k < 4; k++)
+			planes[i][k] /= length > 0.0f ? length : 1.0f;
+	}
+}
+
+void RobotCrowd::Cull(const float planes[6][4], int first, int count)
+{
+	PROFILE_ZONE("RobotCrowd::Cull");
+	for(int i=first; i < first+count; i++)
+	{
+		const float x = positionX[i];
+		const float z = positionZ[i];
+		unsigned char inside = 1;
+		for(int p=0; p < 6; p++)
+		{
+			if(planes[p][0]*x + planes[p][1]*boundsCenterY + planes[p][2]*z + planes[p][3] < -boundsRadius)
+				inside = 0;
+		}
+		visible[i] = inside;
+	}
+}
+
+void RobotCrowd::UpdateTransforms(int firstRobot, int numToUpdate)
+{
+	PROFILE_ZONE("RobotCrowd::UpdateTransforms");
+	const TransformGraph &graph = rig->GetGraph();
+	const int numNodes = graph.GetNumNodes();
+	const int numParts = rig->GetNumParts();
+
+	// Node world matrices for one block of robots: blockWorlds[node*crowdBlock + robot].
+	// One per thread, jobs on different threads update different ranges.
+	static thread_local std::vector<Mat4> blockWorlds;
+	blockWorlds.resize((size_t)numNodes*crowdBlock);
+	Mat4 locals[crowdBlock];
+
+	// Visible robots only, packed into blocks
+	int robots[crowdBlock];
+	int next = firstRobot;
+	const int end = firstRobot + numToUpdate;
+	while(next < end)
+	{
+		int count = 0;
+		for(; next < end && count < crowdBlock; next++)
+		{
+			if(visible[next])
+				robots[count++] = next;
+		}
+
+		// Parents come first, so their matrices for the whole block are ready. Each node
+		// is one batch multiply over the block.
+		for(int n=0; n < numNodes; n++)
+		{
+			const int parent = graph.GetParent(n);
+			const int joint = rig->GetNodeJoint(n);
+			const Mat4 *parentWorlds = parent >= 0 ? &blockWorlds[(size_t)parent*crowdBlock] : NULL;
+			Mat4 *worlds = &blockWorlds[(size_t)n*crowdBlock];
+
+			if(parentWorlds)
+			{
+				if(joint >= 0)
+				{
+					for(int r=0; r < count; r++)
+						locals[r] = Mat4(rig->GetJointLocal(joint, angles[joint][robots[r]]).m);
+					MultiplyMatrices(parentWorlds, locals, worlds, count);
+				}
+				else
+					MultiplyMatrices(parentWorlds, Mat4(graph.GetLocal(n).m), worlds, count);
+				continue;
+			}
+
+			// A translation on the left only moves the last column
+			for(int r=0; r < count; r++)
+			{
+				worlds[r] = Mat4((joint >= 0 ? rig->GetJointLocal(joint, angles[joint][robots[r]]) : graph.GetLocal(n)).m);
+				worlds[r].m[12] += positionX[robots[r]];
+				worlds[r].m[14] += positionZ[robots[r]];
+			}
+		}
+
+		for(int p=0; p < numParts; p++)
+		{
+			const Mat4 *worlds = &blockWorlds[(size_t)rig->GetPart(p).node*crowdBlock];
+			Matrix4 *out = &partWorlds[(size_t)p*numRobots];
+			for(int r=0; r < count; r++)
+				worlds[r].Store(out[robots[r]].m);
+		}
+	}
+}
+
+void RobotCrowd::Step(float seconds, const Matrix4 &viewProjection, JobSystem *jobs)
+{
+	PROFILE_ZONE("RobotCrowd::Step");
+	float planes[6][4];
+	FrustumPlanes(viewProjection, planes);
+
+	if(!jobs)
+	{
+		Animate(seconds);
+		Cull(planes, 0, numRobots);
+		UpdateTransforms();
+	}
+	else
+	{
+		JobGroup animated, culled, transformed;
+		jobs->ParallelFor(numRobots, crowdGrain, [this, seconds](int first, int count)
+		{
+			Animate(seconds, first, count);
+		}, &animated);
+		jobs->ParallelFor(numRobots, crowdGrain, [this, &planes](int first, int count)
+		{
+			Cull(planes, first, count);
+		}, &culled, &animated);
+		jobs->ParallelFor(numRobots, crowdGrain, [this](int first, int count)
+		{
+			UpdateTransforms(first, count);
+		}, &transformed, &culled);
+		jobs->Wait(&transformed);
+	}
+
+	numVisible = 0;
+	for(int i=0; i < numRobots; i++)
+		numVisible += visible[i];
+}
+
+void RobotCrowd::Draw(GeometryCache *geometry, const RenderQueue &materials)
+{
+	PROFILE_ZONE("RobotCrowd::Draw");
+	Matrix4 view;
+	glMatrixMode(GL_MODELVIEW);
+	glGetFloatv(GL_MODELVIEW_MATRIX, view.m);
+
+	tracker.Invalidate();
+	tracker.ResetStateChanges();
+	drawsIssued = 0;
+
+	geometry->Bind();
+	for(size_t i=0; i < drawOrder.size(); i++)
+	{
+		const int p = drawOrder[i];
+		const RigPart &part = rig->GetPart(p);
+		tracker.Apply(part.material, materials.GetMaterial(part.material));
+
+		const Matrix4 *worlds = &partWorlds[(size_t)p*numRobots];
+		Matrix4 modelview;
+		for(int r=0; r < numRobots; r++)
+		{
+			if(!visible[r])
+				continue;
+			modelview.SetProduct(view, worlds[r]);
+			glLoadMatrixf(modelview.m);
+			geometry->Draw(part.primitive);
+		}
+		drawsIssued += numVisible;
+	}
+	geometry->Unbind();
+	glLoadMatrixf(view.m);
+
+	stateChanges = tracker.GetStateChanges();
+}
+
+size_t RobotCrowd::GetMemory() const
+{
+	size_t bytes = (positionX.capacity() + positionZ.capacity() + walkTime.capacity() + cannonTime.capacity())*sizeof(float);
+	for(int j=0; j < numRobotJoints; j++)
+		bytes += angles[j].capacity()*sizeof(float) + cursors[j].capacity();
+	bytes += walkClip.GetMemory() + cannonClip.GetMemory();
+	bytes += visible.capacity() + partWorlds.capacity()*sizeof(Matrix4);
+	return bytes;
+}
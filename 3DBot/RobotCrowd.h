@@ -0,0 +1,97 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	RobotCrowd.h
+//	Many robots sharing one RobotRig. Per-robot state is kept as one array per field
+//	(position, clip times and cursors, each joint angle) and every robot is posed with
+//	the same node order, so the loops run over robots with the rig fixed.
+//
+//	Every robot plays the walk and cannon clips, each at its own time, and the joint
+//	angles are sampled a curve at a time over all the robots in a range. With a ground
+//	set, the left legs are then solved down onto its heights.
+//
+//	World matrices are worked out for blocks of robots, node by node, and stored part
+//	by part. Drawing then goes part by part: one material and one primitive, then a
+//	matrix load and a glDrawElements for every robot, instead of walking the rig once
+//	per robot.
+//
+//	Step runs a frame as three stages over ranges of robots on a JobSystem: animation,
+//	then culling against the view frustum, then world matrices for the robots left in
+//	view. Each stage waits for the one before; within a stage, ranges are independent.
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef ROBOTCROWD_H
+#define ROBOTCROWD_H
+
+#include <vector>
+
+class RobotCrowd
+{
+private:
+	const RobotRig *rig;
+	int numRobots;
+
+	// Per robot
+	std::vector<float> positionX;
+	std::vector<float> positionZ;
+	std::vector<float> walkTime;
+	std::vector<float> cannonTime;
+	std::vector<unsigned char> cursors[numRobotJoints];
+	std::vector<float> angles[numRobotJoints];
+	std::vector<unsigned char> visible;
+
+	AnimationClip walkClip;
+	AnimationClip cannonClip;
+	const QuadMesh *ground;
+
+	// Part world matrices, all robots of part 0 first: partWorlds[part*numRobots + robot]
+	std::vector<Matrix4> partWorlds;
+
+	// Parts sorted by material, then primitive
+	std::vector<int> drawOrder;
+
+	MaterialTracker tracker;
+	int drawsIssued;
+	int stateChanges;
+	int numVisible;
+
+public:
+	RobotCrowd(const RobotRig *rig);
+
+	// count robots on a square grid centered on the origin, spacing apart
+	void Spawn(int count, float spacing);
+
+	// Feet are planted on ground, or left where the clips put them if NULL
+	void SetGround(const QuadMesh *ground) { this->ground = ground; }
+
+	// Advance every robot's walk and cannon clips and sample its joint angles
+	void Animate(float seconds) { Animate(seconds, 0, numRobots); }
+	void Animate(float seconds, int first, int count);
+
+	// Marks the robots whose bounds are inside the six planes of FrustumPlanes
+	void Cull(const float planes[6][4], int first, int count);
+	static void FrustumPlanes(const Matrix4 &viewProjection, float planes[6][4]);
+
+	// World matrices of every part of every visible robot from the current angles
+	void UpdateTransforms() { UpdateTransforms(0, numRobots); }
+	void UpdateTransforms(int first, int count);
+
+	// Animate, Cull and UpdateTransforms as dependent jobs, serially without jobs
+	void Step(float seconds, const Matrix4 &viewProjection, JobSystem *jobs);
+
+	// Draws with the current modelview as the view, materials from the render queue
+	void Draw(GeometryCache *geometry, const RenderQueue &materials);
+
+	int GetNumRobots() const { return numRobots; }
+	float GetPositionX(int robot) const { return positionX[robot]; }
+	float GetPositionZ(int robot) const { return positionZ[robot]; }
+	float *GetAngles(int joint) { return angles[joint].data(); }
+	int GetNumVisible() const { return numVisible; }
+
+	// Statistics of the last Draw
+	int GetDrawsIssued() const { return drawsIssued; }
+	int GetStateChanges() const { return stateChanges; }
+
+	// Bytes of per-robot state and matrices
+	size_t GetMemory() const;
+};
+
+#endif	//ROBOTCROWD_H
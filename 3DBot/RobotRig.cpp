@@ -0,0 +1,305 @@
+#define GL_SILENCE_DEPRECATION
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#include <GLUT/glut.h>
+#else
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+#include <GL/glut.h>
+#endif
+#include <stdlib.h>
+#include <math.h>
+#include <map>
+#include <vector>
+#include "VECTOR3D.h"
+#include "GeometryCache.h"
+#include "TransformGraph.h"
+#include "AnimationClip.h"
+#include "TwoBoneIK.h"
+#include "QuadMesh.h"
+#include "RobotRig.h"
+
+static constexpr float robotBodyWidth = 8.0f;
+static constexpr float robotBodyLength = 9.0f;
+static constexpr float robotBodyDepth = 6.0f;
+static constexpr float upperArmLength = robotBodyLength;
+static constexpr float upperArmWidth = 0.125f*robotBodyWidth;
+static constexpr float gunLength = upperArmLength / 4.0f;
+
+// Hip joint blocks sit this far either side of the body's centre
+static constexpr float hipOffset = 0.5f*robotBodyWidth + 0.5f*upperArmWidth;
+
+// Bottom of the foot below the knee, see AddLowerLeg
+static constexpr float footSole = -(0.5f*upperArmLength + 0.5f*gunLength) - 1.0f;
+
+// Each joint was a translate, a rotation and one or more translates after it. The
+// translates after the rotation are summed into offset here.
+static constexpr JointPivot jointPivots[numRobotJoints] =
+{
+	// Spin robot on base
+	{ 1, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } },
+
+	// Rotate torso and cannons at hip
+	{ 0, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } },
+
+	// Rotate hip at body
+	{ 0, { hipOffset, -0.3f*robotBodyLength, -0.7f*robotBodyDepth },
+		{ -hipOffset, 0.3f*robotBodyLength, 0.7f*robotBodyDepth } },
+
+	// Rotate left leg at knee, then position it with respect to parent upper leg
+	{ 0, { -7.0f, -5.0f, -7.0f }, { 7.0f - 7.0f, 5.0f - 11.0f, 7.0f - 5.0f } },
+
+	// Rotate right leg at knee, then position it with respect to parent upper leg
+	{ 0, { hipOffset, 0.5f*upperArmLength, 0.0f }, { hipOffset - 2.0f, -0.5f*upperArmLength - 5.0f, -11.0f } },
+
+	// Rotate cannon around its own "length" axis, then position it with respect to parent body
+	{ 2, { -5.0f, 5.0f, 0.0f }, { 5.0f - 5.0f, -5.0f + 5.0f, -1.0f } },
+};
+
+// The left leg in the robot's y, z plane, from the hip pivot to the sole of the foot.
+// The knee bends backwards, to negative angles.
+static constexpr JointPivot hipPivot = jointPivots[jointHip];
+static constexpr JointPivot kneePivot = jointPivots[jointKnee];
+static constexpr TwoBoneChain leftLeg =
+{
+	{ hipPivot.pivot[1], hipPivot.pivot[2] },
+	{ hipPivot.offset[1] + kneePivot.pivot[1], hipPivot.offset[2] + kneePivot.pivot[2] },
+	{ kneePivot.offset[1] + footSole, kneePivot.offset[2] },
+	-1.0f
+};
+static constexpr float leftFootX = kneePivot.pivot[0] + kneePivot.offset[0];
+
+// Robots planted together, their feet and targets kept on the stack
+static const int plantBlock = 64;
+
+// The rotation fills two rows and columns of the identity, the translation is
+// pivot + R*offset
+Matrix4 JointPivot::GetLocal(float angle) const
+{
+	const float radians = angle*(float)M_PI/180.0f;
+	const float c = cosf(radians);
+	const float s = sinf(radians);
+	const int a = (axis + 1) % 3;
+	const int b = (axis + 2) % 3;
+
+	Matrix4 m;
+	m.m[a*4+a] = c;
+	m.m[a*4+b] = s;
+	m.m[b*4+a] = -s;
+	m.m[b*4+b] = c;
+	for(int r=0; r < 3; r++)
+		m.m[12+r] = pivot[r] + m.m[r]*offset[0] + m.m[4+r]*offset[1] + m.m[8+r]*offset[2];
+	return m;
+}
+
+RobotRig::RobotRig()
+{
+	for(int i=0; i < numRobotJoints; i++)
+	{
+		jointNodes[i] = -1;
+		builtAngles[i] = 0.0f;
+	}
+	bodyMaterial = rubberMaterial = chromeMaterial = 0;
+	unitCube = cube2 = cube3 = -1;
+	cannonTorus = cannonCylinder = cannonDisk = cannonCone = -1;
+}
+
+int RobotRig::AddNode(int parent, const Matrix4 &local, int joint)
+{
+	nodeJoints.push_back(joint);
+	return graph.AddNode(parent, local);
+}
+
+int RobotRig::AddJoint(int parent, int joint, const float *angles)
+{
+	builtAngles[joint] = angles[joint];
+	jointNodes[joint] = AddNode(parent, GetJointLocal(joint, angles[joint]), joint);
+	return jointNodes[joint];
+}
+
+Matrix4 RobotRig::GetJointLocal(int joint, float angle) const
+{
+	return jointPivots[joint].GetLocal(angle);
+}
+
+void RobotRig::AddPart(int parent, const Matrix4 &local, int material, GeometryCache::Handle primitive)
+{
+	RigPart part = { AddNode(parent, local), material, primitive };
+	parts.push_back(part);
+}
+
+// Cannon torus with the cylinder thing and its disks behind it, all parts of parent
+Matrix4 RobotRig::AddCannon(int parent, const Matrix4 &local)
+{
+	AddPart(parent, Matrix4(local).Scale(1.0, 1.0, 7.0), rubberMaterial, cannonTorus);
+
+	// Cylinder thing and the disk at its back, with respect to parent cannon torus
+	const Matrix4 cylinder = Matrix4(local).Translate(0.0, 0.0, -5.0);
+	AddPart(parent, cylinder, chromeMaterial, cannonCylinder);
+	AddPart(parent, cylinder, chromeMaterial, cannonDisk);
+
+	// Disk at the front
+	const Matrix4 front = Matrix4(cylinder).Translate(0.0, 0.0, 1.0);
+	AddPart(parent, front, chromeMaterial, cannonDisk);
+	return front;
+}
+
+// Hip joint block and the upper leg hanging from it at legAngle
+void RobotRig::AddUpperLeg(int parent, float hipX, float legAngle)
+{
+	// Position hip joint with respect to parent body
+	const Matrix4 hip = Matrix4().Translate(hipX, -0.3*robotBodyLength, -0.7*robotBodyDepth);
+	AddPart(parent, Matrix4(hip).Scale(1.0, 2.0, 2.0), chromeMaterial, unitCube);
+
+	// Rotate leg at hip, position it with respect to parent hip joint
+	AddPart(parent, Matrix4(hip).Rotate(legAngle, 0.0, 0.0, 1.0).Translate(0.0, -1.5, 0.0).Scale(1.0, 2.0, 1.0), chromeMaterial, cube2);
+}
+
+// Lower leg and foot below a knee joint
+void RobotRig::AddLowerLeg(int knee)
+{
+	AddPart(knee, Matrix4().Scale(1.0, 4.0, 1.0), rubberMaterial, cube3);
+
+	// Position foot with respect to parent leg
+	AddPart(knee, Matrix4().Translate(0, -(0.5*upperArmLength + 0.5*gunLength), 0.0).Scale(4.0, -2.0, -2.0), chromeMaterial, unitCube);
+}
+
+void RobotRig::Build(GeometryCache *geometry, int bodyMaterial, int rubberMaterial, int chromeMaterial, const float *angles)
+{
+	this->bodyMaterial = bodyMaterial;
+	this->rubberMaterial = rubberMaterial;
+	this->chromeMaterial = chromeMaterial;
+
+	unitCube = geometry->Cube(1.0);
+	cube2 = geometry->Cube(2.0);
+	cube3 = geometry->Cube(3.0);
+	cannonTorus = geometry->Torus(0.7, 1.0, 20, 20);
+	cannonCylinder = geometry->Cylinder(2.5, 2.5, 1.0, 20, 20);
+	cannonDisk = geometry->Disk(0.0, 2.5, 20, 1);
+	cannonCone = geometry->Cone(1.0, 1.0, 20, 20);
+
+	// Joints first, each part is a leaf under the joint that moves it
+	int robot = AddJoint(-1, jointSpin, angles);
+
+	int body = AddJoint(robot, jointBody, angles);
+	AddPart(body, Matrix4().Scale(robotBodyWidth, robotBodyLength, 2*robotBodyDepth), bodyMaterial, unitCube);
+
+	// Left cannon turns, it also carries the small cannon on top
+	int leftCannon = AddJoint(body, jointCannon, angles);
+	const Matrix4 leftFront = AddCannon(leftCannon, Matrix4());
+	AddPart(leftCannon, Matrix4(leftFront).Rotate(270, 1.0, 0.0, 0.0).Translate(0.0, -7.0, 1.2), chromeMaterial, cannonCone);
+
+	AddCannon(body, Matrix4().Translate(5.0, 5.0, -1.0));
+
+	// Left leg swings at the hip
+	int hip = AddJoint(robot, jointHip, angles);
+	AddUpperLeg(hip, -hipOffset, -30.0);
+	AddLowerLeg(AddJoint(hip, jointKnee, angles));
+
+	AddUpperLeg(robot, hipOffset, 30.0);
+	AddLowerLeg(AddJoint(robot, jointRightKnee, angles));
+
+	graph.Update();
+}
+
+void RobotRig::Pose(const float *angles)
+{
+	for(int i=0; i < numRobotJoints; i++)
+	{
+		if(jointNodes[i] >= 0 && angles[i] != builtAngles[i])
+		{
+			builtAngles[i] = angles[i];
+			graph.SetLocal(jointNodes[i], GetJointLocal(i, angles[i]));
+		}
+	}
+	graph.Update();
+}
+
+// One stride of each leg: the left leg swings from the hip and its knee bends most as
+// it passes back under the body, the right knee half a cycle behind it, and the body
+// rocks with the stride. Keys every eighth of a cycle, splined between.
+static const float walkCycleSeconds = 1.25f;
+static const int walkKeys = 9;
+static const float walkHip[walkKeys] = { 0.0f, 14.1f, 20.0f, 14.1f, 0.0f, -14.1f, -20.0f, -14.1f, 0.0f };
+static const float walkKnee[walkKeys] = { -50.0f, -47.1f, -40.0f, -32.9f, -30.0f, -32.9f, -40.0f, -47.1f, -50.0f };
+static const float walkRightKnee[walkKeys] = { -30.0f, -32.9f, -40.0f, -47.1f, -50.0f, -47.1f, -40.0f, -32.9f, -30.0f };
+static const float walkBody[walkKeys] = { 3.0f, 2.1f, 0.0f, -2.1f, -3.0f, -2.1f, 0.0f, 2.1f, 3.0f };
+
+// One turn of the cannon, at the degree per 10 ms step it has always turned
+static const float cannonTurnSeconds = 3.6f;
+
+AnimationClip MakeWalkClip()
+{
+	AnimationClip clip(numRobotJoints, walkCycleSeconds, true);
+	float times[walkKeys];
+	for(int k=0; k < walkKeys; k++)
+		times[k] = k*walkCycleSeconds/(walkKeys-1);
+	clip.SetCurve(jointHip, times, walkHip, walkKeys, curveSmooth);
+	clip.SetCurve(jointKnee, times, walkKnee, walkKeys, curveSmooth);
+	clip.SetCurve(jointRightKnee, times, walkRightKnee, walkKeys, curveSmooth);
+	clip.SetCurve(jointBody, times, walkBody, walkKeys, curveSmooth);
+	return clip;
+}
+
+AnimationClip MakeStandClip()
+{
+	const float duration = 0.25f;
+	const float times[2] = { 0.0f, duration };
+	const float level[2] = { 0.0f, 0.0f };
+	const float bent[2] = { -40.0f, -40.0f };
+	AnimationClip clip(numRobotJoints, duration, false);
+	clip.SetCurve(jointHip, times, level, 2, curveLinear);
+	clip.SetCurve(jointKnee, times, bent, 2, curveLinear);
+	clip.SetCurve(jointRightKnee, times, bent, 2, curveLinear);
+	clip.SetCurve(jointBody, times, level, 2, curveLinear);
+	return clip;
+}
+
+AnimationClip MakeCannonClip()
+{
+	const float times[2] = { 0.0f, cannonTurnSeconds };
+	const float turn[2] = { 0.0f, 360.0f };
+	AnimationClip clip(numRobotJoints, cannonTurnSeconds, true);
+	clip.SetCurve(jointCannon, times, turn, 2, curveLinear);
+	return clip;
+}
+
+// The foot where the angles put it is sampled on the ground and moved by the height
+// there. Blocks with no foot over a bump skip the solve.
+void PlantLeftFeet(const QuadMesh &ground, const float *positionX, const float *positionZ,
+	const float *heading, float *hip, float *knee, int count)
+{
+	float footY[plantBlock], footZ[plantBlock], heights[plantBlock];
+	float solvedHip[plantBlock], solvedKnee[plantBlock];
+	for(int first=0; first < count; first += plantBlock)
+	{
+		const int n = count - first < plantBlock ? count - first : plantBlock;
+		TwoBoneEnd(leftLeg, hip + first, knee + first, footY, footZ, n);
+
+		bool planted = false;
+		for(int r=0; r < n; r++)
+		{
+			const float radians = heading[first+r]*(float)M_PI/180.0f;
+			const float c = cosf(radians), s = sinf(radians);
+			const VECTOR3D foot(positionX[first+r] + c*leftFootX + s*footZ[r], 0.0f,
+				positionZ[first+r] - s*leftFootX + c*footZ[r]);
+			heights[r] = ground.SampleHeight(foot);
+			footY[r] += heights[r];
+			planted |= heights[r] != 0.0f;
+		}
+		if(!planted)
+			continue;
+
+		SolveTwoBone(leftLeg, footY, footZ, solvedHip, solvedKnee, n);
+		for(int r=0; r < n; r++)
+		{
+			if(heights[r] != 0.0f)
+			{
+				hip[first+r] = solvedHip[r];
+				knee[first+r] = solvedKnee[r];
+			}
+		}
+	}
+}
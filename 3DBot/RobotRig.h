@@ -0,0 +1,107 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	RobotRig.h
+//	The robot's joints and parts as a TransformGraph, shared by the single robot and
+//	by RobotCrowd. A robot's pose is one angle per joint, in degrees.
+//
+//	The robot's dimensions and joint pivots are constants folded when compiled (see
+//	RobotRig.cpp), so a joint's local transform is one rotation about a pivot and
+//	costs a sine and a cosine. Parts are leaves under the joint that moves them, with
+//	the fixed chain between the two folded into one matrix when the rig is built, so a
+//	posed robot is a matrix product per joint and per part.
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef ROBOTRIG_H
+#define ROBOTRIG_H
+
+#include <vector>
+
+class AnimationClip;
+class QuadMesh;
+
+enum RobotJoint
+{
+	jointSpin,			// whole robot about y, on its base
+	jointBody,			// torso and cannons at the hip
+	jointHip,			// left leg at the body
+	jointKnee,			// left lower leg
+	jointRightKnee,		// right lower leg
+	jointCannon,		// left cannon about its length
+	numRobotJoints
+};
+
+// Translate to pivot, rotate about the x, y or z axis, translate by offset
+struct JointPivot
+{
+	int axis;
+	float pivot[3];
+	float offset[3];
+
+	Matrix4 GetLocal(float angle) const;
+};
+
+struct RigPart
+{
+	int node;
+	int material;
+	GeometryCache::Handle primitive;
+};
+
+class RobotRig
+{
+private:
+	TransformGraph graph;
+	std::vector<RigPart> parts;
+
+	int jointNodes[numRobotJoints];
+	float builtAngles[numRobotJoints];
+
+	// Joint driving each node, -1 for fixed nodes
+	std::vector<int> nodeJoints;
+
+	int bodyMaterial;
+	int rubberMaterial;
+	int chromeMaterial;
+	GeometryCache::Handle unitCube, cube2, cube3;
+	GeometryCache::Handle cannonTorus, cannonCylinder, cannonDisk, cannonCone;
+
+private:
+	int AddNode(int parent, const Matrix4 &local, int joint = -1);
+	int AddJoint(int parent, int joint, const float *angles);
+	void AddPart(int parent, const Matrix4 &local, int material, GeometryCache::Handle primitive);
+
+	// local is the fixed transform from parent to the part, returns the front disk's
+	Matrix4 AddCannon(int parent, const Matrix4 &local);
+	void AddUpperLeg(int parent, float hipX, float legAngle);
+	void AddLowerLeg(int knee);
+
+public:
+	RobotRig();
+
+	// Tessellates the parts into geometry and poses the rig at angles
+	void Build(GeometryCache *geometry, int bodyMaterial, int rubberMaterial, int chromeMaterial, const float *angles);
+
+	// Rebuilds the joints whose angle changed, then the world matrices below them
+	void Pose(const float *angles);
+
+	const TransformGraph &GetGraph() const { return graph; }
+	int GetNodeJoint(int node) const { return nodeJoints[node]; }
+	Matrix4 GetJointLocal(int joint, float angle) const;
+
+	int GetNumParts() const { return (int)parts.size(); }
+	const RigPart &GetPart(int part) const { return parts[part]; }
+};
+
+// Clips with a curve per RobotJoint: the looping walk cycle, the standing pose the walk
+// fades in from and back to, and the left cannon turning once round
+AnimationClip MakeWalkClip();
+AnimationClip MakeStandClip();
+AnimationClip MakeCannonClip();
+
+// Left legs of count robots at positionX, positionZ on the ground's plane, turned by
+// heading about y, brought from their angles in hip and knee down onto ground's
+// heights. A foot keeps its height above the flat mesh: a robot posed on flat ground,
+// or off the mesh, is left as it was.
+void PlantLeftFeet(const QuadMesh &ground, const float *positionX, const float *positionZ,
+	const float *heading, float *hip, float *knee, int count);
+
+#endif	//ROBOTRIG_H
@@ -0,0 +1,69 @@
+#include <stdlib.h>
+#include "SimulationClock.h"
+
+SimulationClock::SimulationClock(double step, int maxSteps)
+{
+	this->step = step;
+	this->maxSteps = maxSteps;
+	beforeStep = NULL;
+	afterStep = NULL;
+	accumulator = 0.0;
+	lastTime = 0.0;
+	steps = 0;
+}
+
+int SimulationClock::AddSystem(SimulationSystem update, bool active)
+{
+	System system = { update, active };
+	systems.push_back(system);
+	return (int)systems.size() - 1;
+}
+
+bool SimulationClock::HasActiveSystems() const
+{
+	for(size_t i=0; i < systems.size(); i++)
+	{
+		if(systems[i].active)
+			return true;
+	}
+	return false;
+}
+
+void SimulationClock::Resume(double now)
+{
+	lastTime = now;
+}
+
+int SimulationClock::Advance(double now)
+{
+	double elapsed = now - lastTime;
+	lastTime = now;
+	if(elapsed < 0.0)
+		elapsed = 0.0;
+
+	accumulator += elapsed;
+	if(accumulator > maxSteps*step)
+		accumulator = maxSteps*step;
+
+	int run = 0;
+	while(accumulator >= step)
+	{
+		if(beforeStep)
+			beforeStep();
+
+		// A system switched off by an earlier one in the same step does not run
+		for(size_t i=0; i < systems.size(); i++)
+		{
+			if(systems[i].active)
+				systems[i].update((float)step);
+		}
+
+		if(afterStep)
+			afterStep();
+
+		accumulator -= step;
+		steps++;
+		run++;
+	}
+	return run;
+}
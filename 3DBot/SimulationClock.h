@@ -0,0 +1,66 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	SimulationClock.h
+//	One clock for everything that animates. Real time is added to an accumulator and
+//	the registered systems are run in whole steps of a fixed length, so an animation
+//	moves the same amount per second however fast frames are drawn or timers fire.
+//	What is left over in the accumulator, as a fraction of a step, is the alpha the
+//	display uses to interpolate between the previous and the current state.
+//
+//	A system only runs while it is active. The clock needs ticking only while some
+//	system is active.
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef SIMULATIONCLOCK_H
+#define SIMULATIONCLOCK_H
+
+#include <vector>
+
+typedef void (*SimulationSystem)(float step);
+typedef void (*SimulationHook)();
+
+class SimulationClock
+{
+private:
+	struct System
+	{
+		SimulationSystem update;
+		bool active;
+	};
+
+	std::vector<System> systems;
+
+	// Run around each step, for saving the states the display interpolates between
+	SimulationHook beforeStep;
+	SimulationHook afterStep;
+
+	double step;
+	double accumulator;
+	double lastTime;
+
+	// Steps one Advance may run, time beyond that is dropped rather than caught up
+	int maxSteps;
+	long long steps;
+
+public:
+	SimulationClock(double step, int maxSteps = 10);
+
+	int AddSystem(SimulationSystem update, bool active = false);
+	void SetActive(int system, bool active) { systems[system].active = active; }
+	bool IsActive(int system) const { return systems[system].active; }
+	bool HasActiveSystems() const;
+
+	void SetBeforeStep(SimulationHook hook) { beforeStep = hook; }
+	void SetAfterStep(SimulationHook hook) { afterStep = hook; }
+
+	// Starts counting from now, the time the clock sat idle is not simulated
+	void Resume(double now);
+
+	// Runs the whole steps up to now, in seconds. Returns the number of steps run.
+	int Advance(double now);
+
+	double GetStep() const { return step; }
+	float GetAlpha() const { return (float)(accumulator / step); }
+	long long GetSteps() const { return steps; }
+};
+
+#endif	//SIMULATIONCLOCK_H
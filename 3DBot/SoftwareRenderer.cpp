@@ -0,0 +1,583 @@
+#define GL_SILENCE_DEPRECATION
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#include <GLUT/glut.h>
+#else
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+#include <GL/glut.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "VECTOR3D.h"
+#include "QuadMesh.h"
+#include "GeometryCache.h"
+#include "TransformGraph.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "SoftwareRenderer.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SOFTWARE_RENDERER_SSE
+#include <immintrin.h>
+#endif
+
+// Triangles set up per job
+static const int setupGrain = 1024;
+
+static unsigned int PackColor(float r, float g, float b)
+{
+	const unsigned int ri = (unsigned int)(std::min(std::max(r, 0.0f), 1.0f)*255.0f + 0.5f);
+	const unsigned int gi = (unsigned int)(std::min(std::max(g, 0.0f), 1.0f)*255.0f + 0.5f);
+	const unsigned int bi = (unsigned int)(std::min(std::max(b, 0.0f), 1.0f)*255.0f + 0.5f);
+	return ri | (gi << 8) | (bi << 16) | 0xff000000u;
+}
+
+SoftwareRenderer::SoftwareRenderer(int width, int height, JobSystem *jobs)
+{
+	this->jobs = jobs;
+	simd = HasSIMD();
+	clearColor = PackColor(0.0f, 0.0f, 0.0f);
+	numChunks = 0;
+	trianglesBinned = 0;
+
+	// GL's defaults: ambient light only, no lights on
+	const float ambient[4] = { 0.2f, 0.2f, 0.2f, 1.0f };
+	SetAmbient(ambient);
+	for(int i=0; i < maxLights; i++)
+		lights[i].enabled = false;
+
+	this->width = 0;
+	this->height = 0;
+	Resize(width, height);
+}
+
+bool SoftwareRenderer::HasSIMD()
+{
+#ifdef SOFTWARE_RENDERER_SSE
+	return true;
+#else
+	return false;
+#endif
+}
+
+void SoftwareRenderer::Resize(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+	tilesX = (width + tileSize - 1) / tileSize;
+	tilesY = (height + tileSize - 1) / tileSize;
+	pitch = tilesX*tileSize;
+	color.assign((size_t)pitch*tilesY*tileSize, clearColor);
+	depth.assign((size_t)pitch*tilesY*tileSize, 1.0f);
+}
+
+void SoftwareRenderer::SetClearColor(float r, float g, float b)
+{
+	clearColor = PackColor(r, g, b);
+}
+
+void SoftwareRenderer::SetAmbient(const float *ambient)
+{
+	memcpy(globalAmbient, ambient, sizeof(globalAmbient));
+}
+
+void SoftwareRenderer::SetLight(int light, const float *position, const float *ambient, const float *diffuse, const float *specular)
+{
+	Light &l = lights[light];
+	l.enabled = true;
+	memcpy(l.position, position, sizeof(l.position));
+	memcpy(l.ambient, ambient, sizeof(l.ambient));
+	memcpy(l.diffuse, diffuse, sizeof(l.diffuse));
+	memcpy(l.specular, specular, sizeof(l.specular));
+}
+
+int SoftwareRenderer::AddMaterial(const GLfloat *ambient, const GLfloat *specular, const GLfloat *diffuse, const GLfloat *shininess)
+{
+	Material material;
+	memcpy(material.ambient, ambient, sizeof(material.ambient));
+	memcpy(material.diffuse, diffuse, sizeof(material.diffuse));
+	memcpy(material.specular, specular, sizeof(material.specular));
+	material.shininess = shininess[0];
+	materials.push_back(material);
+	return (int)materials.size()-1;
+}
+
+void SoftwareRenderer::Begin(const Matrix4 &projection, const Matrix4 &view)
+{
+	this->projection = projection;
+	this->view = view;
+	draws.clear();
+	sourceVertices.clear();
+	sourceIndices.clear();
+}
+
+void SoftwareRenderer::DrawPrimitive(const GeometryCache &geometry, GeometryCache::Handle primitive, const Matrix4 &model, int material)
+{
+	int firstIndex, numIndices, firstVertex, numVertices;
+	geometry.GetRange(primitive, firstIndex, numIndices, firstVertex, numVertices);
+
+	Draw draw = { model, material, (int)sourceVertices.size(), numVertices };
+	const GeometryCache::Vertex *vertices = geometry.GetVertices() + firstVertex;
+	sourceVertices.insert(sourceVertices.end(), vertices, vertices + numVertices);
+
+	const GLushort *indices = geometry.GetIndices() + firstIndex;
+	for(int i=0; i < numIndices; i++)
+		sourceIndices.push_back(draw.firstVertex + indices[i] - firstVertex);
+	draws.push_back(draw);
+}
+
+// Each grid quad as two triangles
+void SoftwareRenderer::DrawMesh(const QuadMesh &mesh, const Matrix4 &model, int material)
+{
+	const int size = mesh.GetGridSize();
+	const int rowLength = size + 1;
+	Draw draw = { model, material, (int)sourceVertices.size(), rowLength*rowLength };
+
+	for(int row=0; row <= size; row++)
+	{
+		for(int col=0; col <= size; col++)
+		{
+			const MeshVertex v = mesh.GetVertex(row, col);
+			GeometryCache::Vertex vertex = { v.position, v.normal };
+			sourceVertices.push_back(vertex);
+		}
+	}
+
+	for(int row=0; row < size; row++)
+	{
+		for(int col=0; col < size; col++)
+		{
+			const int v00 = draw.firstVertex + row*rowLength + col;
+			const int v01 = v00 + 1;
+			const int v10 = v00 + rowLength;
+			const int v11 = v10 + 1;
+			const int quad[6] = { v00, v10, v11, v00, v11, v01 };
+			sourceIndices.insert(sourceIndices.end(), quad, quad + 6);
+		}
+	}
+	draws.push_back(draw);
+}
+
+//------------------------------------------------------------------------------------------------------
+// Vertex stage
+
+static void Transform(const Matrix4 &m, const VECTOR3D &p, float out[4])
+{
+	for(int r=0; r < 4; r++)
+		out[r] = m.m[r]*p.x + m.m[4+r]*p.y + m.m[8+r]*p.z + m.m[12+r];
+}
+
+void SoftwareRenderer::ShadeDraw(int index)
+{
+	PROFILE_ZONE("SoftwareRenderer::ShadeDraw");
+	const Draw &draw = draws[index];
+	const Material &material = materials[draw.material];
+	const Matrix4 modelView = view * draw.model;
+	const Matrix4 clip = projection * modelView;
+
+	// Normals go through the inverse transpose of the upper 3x3, which is its cofactor
+	// matrix over the determinant. Only the determinant's sign matters before normalizing.
+	const float *m = modelView.m;
+	float normalMatrix[9] = {
+		m[5]*m[10] - m[9]*m[6], m[9]*m[2] - m[1]*m[10], m[1]*m[6] - m[5]*m[2],
+		m[8]*m[6] - m[4]*m[10], m[0]*m[10] - m[8]*m[2], m[4]*m[2] - m[0]*m[6],
+		m[4]*m[9] - m[8]*m[5], m[8]*m[1] - m[0]*m[9], m[0]*m[5] - m[4]*m[1]
+	};
+	const float det = m[0]*normalMatrix[0] + m[4]*normalMatrix[1] + m[8]*normalMatrix[2];
+	if(det < 0.0f)
+	{
+		for(int i=0; i < 9; i++)
+			normalMatrix[i] = -normalMatrix[i];
+	}
+
+	// Terms that do not depend on the vertex
+	float base[3];
+	for(int c=0; c < 3; c++)
+	{
+		base[c] = material.ambient[c]*globalAmbient[c];
+		for(int l=0; l < maxLights; l++)
+		{
+			if(lights[l].enabled)
+				base[c] += material.ambient[c]*lights[l].ambient[c];
+		}
+	}
+
+	for(int i=0; i < draw.numVertices; i++)
+	{
+		const GeometryCache::Vertex &source = sourceVertices[draw.firstVertex + i];
+		ShadedVertex &out = shaded[draw.firstVertex + i];
+
+		float clipPosition[4], eye[4];
+		Transform(clip, source.position, clipPosition);
+		Transform(modelView, source.position, eye);
+		out.x = clipPosition[0];
+		out.y = clipPosition[1];
+		out.z = clipPosition[2];
+		out.w = clipPosition[3];
+
+		const VECTOR3D &n = source.normal;
+		VECTOR3D normal(normalMatrix[0]*n.x + normalMatrix[1]*n.y + normalMatrix[2]*n.z,
+			normalMatrix[3]*n.x + normalMatrix[4]*n.y + normalMatrix[5]*n.z,
+			normalMatrix[6]*n.x + normalMatrix[7]*n.y + normalMatrix[8]*n.z);
+		normal.Normalize();
+
+		float lit[3] = { base[0], base[1], base[2] };
+		for(int l=0; l < maxLights; l++)
+		{
+			const Light &light = lights[l];
+			if(!light.enabled)
+				continue;
+
+			VECTOR3D toLight(light.position[0], light.position[1], light.position[2]);
+			if(light.position[3] != 0.0f)
+				toLight -= VECTOR3D(eye[0], eye[1], eye[2]);
+			toLight.Normalize();
+
+			const float diffuse = normal.DotProduct(toLight);
+			if(diffuse <= 0.0f)
+				continue;
+
+			VECTOR3D halfway = toLight + VECTOR3D(0.0f, 0.0f, 1.0f);
+			halfway.Normalize();
+			const float specular = powf(std::max(normal.DotProduct(halfway), 0.0f), material.shininess);
+			for(int c=0; c < 3; c++)
+				lit[c] += diffuse*material.diffuse[c]*light.diffuse[c] + specular*material.specular[c]*light.specular[c];
+		}
+		out.r = std::min(lit[0], 1.0f);
+		out.g = std::min(lit[1], 1.0f);
+		out.b = std::min(lit[2], 1.0f);
+	}
+}
+
+//------------------------------------------------------------------------------------------------------
+// Setup and binning
+
+void SoftwareRenderer::SetupChunk(int chunk)
+{
+	PROFILE_ZONE("SoftwareRenderer::SetupChunk");
+	const int numTiles = tilesX*tilesY;
+	const int first = chunk*setupGrain;
+	const int last = std::min(first + setupGrain, (int)setups.size());
+	int binned = 0;
+
+	for(int t=first; t < last; t++)
+	{
+		Setup &setup = setups[t];
+		setup.minX = 1;
+		setup.maxX = 0;
+
+		const ShadedVertex *v[3] = { &shaded[sourceIndices[3*t]], &shaded[sourceIndices[3*t+1]], &shaded[sourceIndices[3*t+2]] };
+		if(v[0]->z < -v[0]->w || v[1]->z < -v[1]->w || v[2]->z < -v[2]->w)
+			continue;
+
+		// Window coordinates
+		float x[3], y[3], attributes[3][numAttributes];
+		for(int k=0; k < 3; k++)
+		{
+			const float invW = 1.0f / v[k]->w;
+			x[k] = (v[k]->x*invW*0.5f + 0.5f)*width;
+			y[k] = (v[k]->y*invW*0.5f + 0.5f)*height;
+			attributes[k][attributeZ] = v[k]->z*invW*0.5f + 0.5f;
+			attributes[k][attributeInvW] = invW;
+			attributes[k][attributeR] = v[k]->r*invW;
+			attributes[k][attributeG] = v[k]->g*invW;
+			attributes[k][attributeB] = v[k]->b*invW;
+		}
+
+		float area = (x[1] - x[0])*(y[2] - y[0]) - (x[2] - x[0])*(y[1] - y[0]);
+		if(area == 0.0f)
+			continue;
+		if(area < 0.0f)
+		{
+			// Nothing is culled, clockwise triangles are turned around
+			std::swap(x[1], x[2]);
+			std::swap(y[1], y[2]);
+			for(int a=0; a < numAttributes; a++)
+				std::swap(attributes[1][a], attributes[2][a]);
+			area = -area;
+		}
+
+		const float minX = std::min(x[0], std::min(x[1], x[2]));
+		const float maxX = std::max(x[0], std::max(x[1], x[2]));
+		const float minY = std::min(y[0], std::min(y[1], y[2]));
+		const float maxY = std::max(y[0], std::max(y[1], y[2]));
+		setup.minX = std::max(0, (int)ceilf(minX - 0.5f));
+		setup.maxX = std::min(width - 1, (int)floorf(maxX - 0.5f));
+		setup.minY = std::max(0, (int)ceilf(minY - 0.5f));
+		setup.maxY = std::min(height - 1, (int)floorf(maxY - 0.5f));
+		if(setup.minX > setup.maxX || setup.minY > setup.maxY)
+		{
+			setup.minX = 1;
+			setup.maxX = 0;
+			continue;
+		}
+
+		for(int k=0; k < 3; k++)
+		{
+			const int a = (k+1) % 3;
+			const int b = (k+2) % 3;
+			const float dx = x[b] - x[a];
+			const float dy = y[b] - y[a];
+			setup.edgeX[k] = -dy;
+			setup.edgeY[k] = dx;
+			setup.edgeC[k] = dy*x[a] - dx*y[a];
+
+			// Pixel centres exactly on an edge belong to the triangle left of or below
+			// it, so neighbours sharing the edge do not both draw them
+			setup.topLeft[k] = dy < 0.0f || (dy == 0.0f && dx < 0.0f);
+		}
+		setup.invArea = 1.0f / area;
+		for(int a=0; a < numAttributes; a++)
+		{
+			setup.base[a] = attributes[0][a];
+			setup.toV1[a] = attributes[1][a] - attributes[0][a];
+			setup.toV2[a] = attributes[2][a] - attributes[0][a];
+		}
+
+		for(int ty=setup.minY / tileSize; ty <= setup.maxY / tileSize; ty++)
+		{
+			for(int tx=setup.minX / tileSize; tx <= setup.maxX / tileSize; tx++)
+				bins[chunk*numTiles + ty*tilesX + tx].push_back(t);
+		}
+		binned++;
+	}
+	chunkBinned[chunk] = binned;
+}
+
+//------------------------------------------------------------------------------------------------------
+// Rasterization
+
+void SoftwareRenderer::RasterizeScalar(const Setup &setup, int x0, int y0, int x1, int y1)
+{
+	for(int y=y0; y <= y1; y++)
+	{
+		const float py = y + 0.5f;
+		float *depthRow = &depth[(size_t)y*pitch];
+		unsigned int *colorRow = &color[(size_t)y*pitch];
+
+		for(int x=x0; x <= x1; x++)
+		{
+			const float px = x + 0.5f;
+			float e[3];
+			bool inside = true;
+			for(int k=0; k < 3; k++)
+			{
+				e[k] = setup.edgeX[k]*px + setup.edgeY[k]*py + setup.edgeC[k];
+				inside = inside && (e[k] > 0.0f || (e[k] == 0.0f && setup.topLeft[k]));
+			}
+			if(!inside)
+				continue;
+
+			const float l1 = e[1]*setup.invArea;
+			const float l2 = e[2]*setup.invArea;
+			float value[numAttributes];
+			for(int a=0; a < numAttributes; a++)
+				value[a] = setup.base[a] + l1*setup.toV1[a] + l2*setup.toV2[a];
+
+			if(value[attributeZ] >= depthRow[x])
+				continue;
+			depthRow[x] = value[attributeZ];
+
+			const float w = 1.0f / value[attributeInvW];
+			colorRow[x] = PackColor(value[attributeR]*w, value[attributeG]*w, value[attributeB]*w);
+		}
+	}
+}
+
+#ifdef SOFTWARE_RENDERER_SSE
+
+// Four pixels of a row at a time, x0 is a multiple of 4. Lanes past x1 are still
+// inside the tile and the edge functions keep them out of the triangle.
+void SoftwareRenderer::RasterizeSSE(const Setup &setup, int x0, int y0, int x1, int y1)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 scale = _mm_set1_ps(255.0f);
+	const __m128 lanes = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128i alpha = _mm_set1_epi32((int)0xff000000u);
+	const __m128 invArea = _mm_set1_ps(setup.invArea);
+
+	__m128 edgeX[3], topLeft[3];
+	for(int k=0; k < 3; k++)
+	{
+		edgeX[k] = _mm_set1_ps(setup.edgeX[k]);
+		topLeft[k] = _mm_castsi128_ps(_mm_set1_epi32(setup.topLeft[k] ? -1 : 0));
+	}
+	__m128 base[numAttributes], toV1[numAttributes], toV2[numAttributes];
+	for(int a=0; a < numAttributes; a++)
+	{
+		base[a] = _mm_set1_ps(setup.base[a]);
+		toV1[a] = _mm_set1_ps(setup.toV1[a]);
+		toV2[a] = _mm_set1_ps(setup.toV2[a]);
+	}
+
+	for(int y=y0; y <= y1; y++)
+	{
+		const float py = y + 0.5f;
+		__m128 rowStart[3];
+		for(int k=0; k < 3; k++)
+			rowStart[k] = _mm_set1_ps(setup.edgeY[k]*py + setup.edgeC[k]);
+
+		float *depthRow = &depth[(size_t)y*pitch];
+		unsigned int *colorRow = &color[(size_t)y*pitch];
+
+		for(int x=x0; x <= x1; x += 4)
+		{
+			const __m128 px = _mm_add_ps(_mm_set1_ps((float)x), lanes);
+			__m128 e[3];
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for(int k=0; k < 3; k++)
+			{
+				e[k] = _mm_add_ps(_mm_mul_ps(edgeX[k], px), rowStart[k]);
+				const __m128 onEdge = _mm_and_ps(_mm_cmpeq_ps(e[k], zero), topLeft[k]);
+				inside = _mm_and_ps(inside, _mm_or_ps(_mm_cmpgt_ps(e[k], zero), onEdge));
+			}
+			if(_mm_movemask_ps(inside) == 0)
+				continue;
+
+			const __m128 l1 = _mm_mul_ps(e[1], invArea);
+			const __m128 l2 = _mm_mul_ps(e[2], invArea);
+			__m128 value[numAttributes];
+			for(int a=0; a < numAttributes; a++)
+				value[a] = _mm_add_ps(base[a], _mm_add_ps(_mm_mul_ps(l1, toV1[a]), _mm_mul_ps(l2, toV2[a])));
+
+			const __m128 oldDepth = _mm_loadu_ps(depthRow + x);
+			const __m128 pass = _mm_and_ps(inside, _mm_cmplt_ps(value[attributeZ], oldDepth));
+			if(_mm_movemask_ps(pass) == 0)
+				continue;
+			_mm_storeu_ps(depthRow + x, _mm_or_ps(_mm_and_ps(pass, value[attributeZ]), _mm_andnot_ps(pass, oldDepth)));
+
+			const __m128 w = _mm_div_ps(one, value[attributeInvW]);
+			__m128i rgba = alpha;
+			for(int c=0; c < 3; c++)
+			{
+				__m128 channel = _mm_mul_ps(value[attributeR + c], w);
+				channel = _mm_min_ps(_mm_max_ps(channel, zero), one);
+				const __m128i bytes = _mm_cvtps_epi32(_mm_mul_ps(channel, scale));
+				rgba = _mm_or_si128(rgba, _mm_slli_epi32(bytes, 8*c));
+			}
+
+			const __m128i passMask = _mm_castps_si128(pass);
+			const __m128i oldColor = _mm_loadu_si128((const __m128i *)(colorRow + x));
+			const __m128i newColor = _mm_or_si128(_mm_and_si128(passMask, rgba), _mm_andnot_si128(passMask, oldColor));
+			_mm_storeu_si128((__m128i *)(colorRow + x), newColor);
+		}
+	}
+}
+
+#else
+
+void SoftwareRenderer::RasterizeSSE(const Setup &setup, int x0, int y0, int x1, int y1)
+{
+	RasterizeScalar(setup, x0, y0, x1, y1);
+}
+
+#endif
+
+void SoftwareRenderer::RasterizeTile(int tile)
+{
+	PROFILE_ZONE("SoftwareRenderer::RasterizeTile");
+	const int numTiles = tilesX*tilesY;
+	const int tileX = (tile % tilesX)*tileSize;
+	const int tileY = (tile / tilesX)*tileSize;
+
+	// The tile's part of the buffers is cleared by the job that draws it
+	for(int y=tileY; y < tileY + tileSize; y++)
+	{
+		std::fill(color.begin() + (size_t)y*pitch + tileX, color.begin() + (size_t)y*pitch + tileX + tileSize, clearColor);
+		std::fill(depth.begin() + (size_t)y*pitch + tileX, depth.begin() + (size_t)y*pitch + tileX + tileSize, 1.0f);
+	}
+
+	for(int chunk=0; chunk < numChunks; chunk++)
+	{
+		const std::vector<int> &bin = bins[chunk*numTiles + tile];
+		for(size_t i=0; i < bin.size(); i++)
+		{
+			const Setup &setup = setups[bin[i]];
+			const int x0 = std::max(setup.minX, tileX);
+			const int x1 = std::min(setup.maxX, tileX + tileSize - 1);
+			const int y0 = std::max(setup.minY, tileY);
+			const int y1 = std::min(setup.maxY, tileY + tileSize - 1);
+			if(simd)
+				RasterizeSSE(setup, x0 & ~3, y0, x1, y1);
+			else
+				RasterizeScalar(setup, x0, y0, x1, y1);
+		}
+	}
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void SoftwareRenderer::Render()
+{
+	PROFILE_ZONE("SoftwareRenderer::Render");
+	const int numTriangles = (int)sourceIndices.size() / 3;
+	const int numTiles = tilesX*tilesY;
+	shaded.resize(sourceVertices.size());
+	setups.resize(numTriangles);
+
+	// Bins keep their memory from frame to frame
+	numChunks = (numTriangles + setupGrain - 1) / setupGrain;
+	if((int)bins.size() < numChunks*numTiles)
+		bins.resize(numChunks*numTiles);
+	for(int i=0; i < numChunks*numTiles; i++)
+		bins[i].clear();
+	chunkBinned.assign(numChunks, 0);
+
+	if(!jobs)
+	{
+		for(int i=0; i < (int)draws.size(); i++)
+			ShadeDraw(i);
+		for(int i=0; i < numChunks; i++)
+			SetupChunk(i);
+		for(int i=0; i < numTiles; i++)
+			RasterizeTile(i);
+	}
+	else
+	{
+		JobGroup shadedGroup, binnedGroup, rasterizedGroup;
+		jobs->ParallelFor((int)draws.size(), 1, [this](int first, int count)
+		{
+			for(int i=first; i < first + count; i++)
+				ShadeDraw(i);
+		}, &shadedGroup);
+		jobs->ParallelFor(numChunks, 1, [this](int first, int count)
+		{
+			for(int i=first; i < first + count; i++)
+				SetupChunk(i);
+		}, &binnedGroup, &shadedGroup);
+		jobs->ParallelFor(numTiles, 1, [this](int first, int count)
+		{
+			for(int i=first; i < first + count; i++)
+				RasterizeTile(i);
+		}, &rasterizedGroup, &binnedGroup);
+		jobs->Wait(&rasterizedGroup);
+	}
+
+	trianglesBinned = 0;
+	for(int i=0; i < numChunks; i++)
+		trianglesBinned += chunkBinned[i];
+}
+
+void SoftwareRenderer::ReadPixels(std::vector<unsigned char> &rgb) const
+{
+	rgb.resize((size_t)3*width*height);
+	for(int y=0; y < height; y++)
+	{
+		const unsigned int *row = &color[(size_t)(height-1-y)*pitch];
+		unsigned char *out = &rgb[(size_t)3*y*width];
+		for(int x=0; x < width; x++)
+		{
+			out[3*x] = (unsigned char)row[x];
+			out[3*x+1] = (unsigned char)(row[x] >> 8);
+			out[3*x+2] = (unsigned char)(row[x] >> 16);
+		}
+	}
+}
@@ -0,0 +1,175 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	SoftwareRenderer.h
+//	CPU rendering of the robot scene, for machines without a GPU. Draws are collected
+//	with their model matrix and material, then Render runs three stages, on a
+//	JobSystem when it has one:
+//
+//	1. vertices are transformed and lit per vertex like the fixed-function lighting
+//	   of initOpenGL: global ambient plus point lights with ambient, diffuse and
+//	   Blinn-Phong specular terms, the viewer along +z,
+//	2. triangles are set up in window coordinates and binned into the screen tiles
+//	   they touch,
+//	3. tiles are rasterized in parallel, each by one job that owns its part of the
+//	   colour and depth buffers. Edge functions, the depth test and perspective
+//	   correct colour are evaluated four pixels at a time with SSE where available.
+//
+//	Triangles reaching behind the near plane are dropped rather than clipped, which the
+//	robot scene's cameras never need. Back faces are lit with the front material, as
+//	GL does without two-sided lighting for the robot's closed parts.
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef SOFTWARERENDERER_H
+#define SOFTWARERENDERER_H
+
+#include <vector>
+
+class QuadMesh;
+class JobSystem;
+
+class SoftwareRenderer
+{
+public:
+	static const int tileSize = 64;
+	static const int maxLights = 2;
+
+private:
+	struct Material
+	{
+		float ambient[4];
+		float diffuse[4];
+		float specular[4];
+		float shininess;
+	};
+
+	struct Light
+	{
+		bool enabled;
+		float position[4];
+		float ambient[4];
+		float diffuse[4];
+		float specular[4];
+	};
+
+	// Vertices and triangles of a draw, copied into the frame arrays at these offsets
+	struct Draw
+	{
+		Matrix4 model;
+		int material;
+		int firstVertex;
+		int numVertices;
+	};
+
+	// Clip space position and lit colour
+	struct ShadedVertex
+	{
+		float x, y, z, w;
+		float r, g, b;
+	};
+
+	// Attributes interpolated across a triangle, all divided by w but depth
+	enum { attributeZ, attributeInvW, attributeR, attributeG, attributeB, numAttributes };
+
+	// A triangle in window coordinates, counterclockwise. Edge k is opposite vertex k,
+	// edgeX*x + edgeY*y + edgeC is positive inside it and equals the area at vertex k.
+	struct Setup
+	{
+		float edgeX[3];
+		float edgeY[3];
+		float edgeC[3];
+		int topLeft[3];
+		float invArea;
+
+		// Attribute at vertex 0 and its change towards vertices 1 and 2
+		float base[numAttributes];
+		float toV1[numAttributes];
+		float toV2[numAttributes];
+
+		// Pixels whose centres can be inside
+		int minX, minY, maxX, maxY;
+	};
+
+	int width;
+	int height;
+	int tilesX;
+	int tilesY;
+
+	// Rows of pitch pixels, bottom row first like GL. Padded to whole tiles so a tile
+	// never needs bounds checks.
+	int pitch;
+	std::vector<unsigned int> color;
+	std::vector<float> depth;
+	unsigned int clearColor;
+
+	JobSystem *jobs;
+	bool simd;
+
+	std::vector<Material> materials;
+	Light lights[maxLights];
+	float globalAmbient[4];
+	Matrix4 projection;
+	Matrix4 view;
+
+	// This frame's draws
+	std::vector<Draw> draws;
+	std::vector<GeometryCache::Vertex> sourceVertices;
+	std::vector<int> sourceIndices;
+	std::vector<ShadedVertex> shaded;
+	std::vector<Setup> setups;
+
+	// Triangles set up by chunk c that touch tile t are in bins[c*numTiles + t], so no
+	// two chunks write to the same bin and each tile keeps the draw order
+	int numChunks;
+	std::vector<std::vector<int> > bins;
+	std::vector<int> chunkBinned;
+	int trianglesBinned;
+
+private:
+	void ShadeDraw(int draw);
+	void SetupChunk(int chunk);
+	void RasterizeTile(int tile);
+	void RasterizeScalar(const Setup &setup, int x0, int y0, int x1, int y1);
+	void RasterizeSSE(const Setup &setup, int x0, int y0, int x1, int y1);
+
+public:
+	// jobs NULL renders on the calling thread
+	SoftwareRenderer(int width, int height, JobSystem *jobs = NULL);
+
+	void Resize(int width, int height);
+	int GetWidth() const { return width; }
+	int GetHeight() const { return height; }
+
+	// Four pixels at a time where the CPU has SSE, on by default
+	static bool HasSIMD();
+	void SetSIMD(bool simd) { this->simd = simd && HasSIMD(); }
+	bool IsSIMD() const { return simd; }
+
+	void SetClearColor(float r, float g, float b);
+
+	// As glLightModelfv(GL_LIGHT_MODEL_AMBIENT) and glLightfv, position in eye coordinates
+	void SetAmbient(const float *ambient);
+	void SetLight(int light, const float *position, const float *ambient, const float *diffuse, const float *specular);
+
+	// As RenderQueue::AddMaterial, the values are copied
+	int AddMaterial(const GLfloat *ambient, const GLfloat *specular, const GLfloat *diffuse, const GLfloat *shininess);
+
+	// Starts a frame with the given camera, draws are kept until Render
+	void Begin(const Matrix4 &projection, const Matrix4 &view);
+	void DrawPrimitive(const GeometryCache &geometry, GeometryCache::Handle primitive, const Matrix4 &model, int material);
+	void DrawMesh(const QuadMesh &mesh, const Matrix4 &model, int material);
+
+	// Clears the buffers and draws everything since Begin
+	void Render();
+
+	// RGBA bytes in memory, rows of GetPitch pixels, bottom row first
+	const unsigned int *GetColor() const { return &color[0]; }
+	const float *GetDepth() const { return &depth[0]; }
+	int GetPitch() const { return pitch; }
+
+	// RGB bytes, top row first, as HeadlessContext writes them
+	void ReadPixels(std::vector<unsigned char> &rgb) const;
+
+	int GetNumTriangles() const { return (int)setups.size(); }
+	int GetTrianglesBinned() const { return trianglesBinned; }
+};
+
+#endif	//SOFTWARERENDERER_H
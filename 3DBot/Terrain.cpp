@@ -0,0 +1,429 @@
+#define GL_SILENCE_DEPRECATION
+#ifndef __APPLE__
+#define GL_GLEXT_PROTOTYPES   // glGenBuffers etc. are only prototyped in glext.h
+#endif
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#include <GLUT/glut.h>
+#else
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+#include <GL/glut.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <utility>
+#include <vector>
+#include "VECTOR3D.h"
+#include "MeshArena.h"
+#include "QuadMesh.h"
+#include "Profiler.h"
+#include "Terrain.h"
+
+
+Terrain::Terrain(int size, int chunkSize, float worldSize, int numLevels)
+{
+	// Chunk meshes use 16-bit indices, (chunkSize+3)^2 vertices with the apron. Each
+	// LOD level halves chunkSize, so it is rounded down to a power of two.
+	if(chunkSize < 2) chunkSize = 2;
+	if(chunkSize > 128) chunkSize = 128;
+	while(chunkSize & (chunkSize-1))
+		chunkSize &= chunkSize-1;
+	if(size < chunkSize) size = chunkSize;
+
+	this->chunkSize = chunkSize;
+	this->chunksPerSide = (size + chunkSize-1) / chunkSize;
+	this->size = chunksPerSide*chunkSize;
+	this->cellSize = worldSize / this->size;
+
+	// A level needs at least two cells per chunk side for its border ring
+	int maxLevels = 1;
+	while((chunkSize >> maxLevels) >= 2)
+		maxLevels++;
+	this->numLevels = numLevels < 1 ? 1 : (numLevels > maxLevels ? maxLevels : numLevels);
+
+	heights.assign((this->size+1)*(this->size+1), 0.0f);
+	arena = new MeshArena();
+	lodBuffer = 0;
+	lodUploaded = false;
+	useVBO = false;
+	lodDistance = 24.0f;
+	compactChunks = false;
+	chunksDrawn = 0;
+	trianglesDrawn = 0;
+
+	BuildLodIndices();
+}
+
+Terrain::~Terrain()
+{
+	for(size_t i=0; i < chunks.size(); i++)
+		delete chunks[i];
+	delete arena;
+	if(lodBuffer)
+		glDeleteBuffers(1, &lodBuffer);
+}
+
+// Rolling hills from a few sine waves, heights in [-amplitude, amplitude]
+void Terrain::GenerateHills(float amplitude, float wavelength)
+{
+	const float f = 2.0f*M_PI*cellSize / wavelength;
+	for(int j=0; j <= size; j++)
+	{
+		for(int k=0; k <= size; k++)
+		{
+			float h = 0.6f*sinf(k*f)*cosf(j*f*0.7f) + 0.3f*sinf(k*f*2.3f + 1.0f)*sinf(j*f*1.9f) + 0.1f*cosf((j+k)*f*5.1f);
+			SetHeight(j, k, amplitude*h);
+		}
+	}
+}
+
+bool Terrain::Build(VECTOR3D origin)
+{
+	this->origin = origin;
+	useVBO = QuadMesh::SupportsVBO();
+
+	for(size_t i=0; i < chunks.size(); i++)
+		delete chunks[i];
+	chunks.assign(chunksPerSide*chunksPerSide, (QuadMesh *)NULL);
+	chunkMinHeight.assign(chunks.size(), 0.0f);
+	chunkMaxHeight.assign(chunks.size(), 0.0f);
+	chunkLevel.assign(chunks.size(), 0);
+
+	VECTOR3D dir1v(1.0f, 0.0f, 0.0f);
+	VECTOR3D dir2v(0.0f, 0.0f, -1.0f);
+	const int meshSize = chunkSize+2;
+	std::vector<float> chunkHeights((meshSize+1)*(meshSize+1));
+
+	for(int cr=0; cr < chunksPerSide; cr++)
+	{
+		for(int cc=0; cc < chunksPerSide; cc++)
+		{
+			// Chunk mesh starts one apron quad before the chunk
+			const int row0 = cr*chunkSize - 1;
+			const int col0 = cc*chunkSize - 1;
+			VECTOR3D chunkOrigin = origin + dir1v*(col0*cellSize) + dir2v*(row0*cellSize);
+
+			// Chunks are only drawn with the shared LOD lists, never their own quads
+			QuadMesh *mesh = new QuadMesh(meshSize, meshSize*cellSize, arena);
+			mesh->SetQuadIndices(false);
+			if(!mesh->InitMesh(meshSize, chunkOrigin, meshSize*cellSize, meshSize*cellSize, dir1v, dir2v))
+			{
+				delete mesh;
+				return false;
+			}
+
+			// Apron heights outside the terrain repeat the edge
+			for(int j=0; j <= meshSize; j++)
+			{
+				int row = row0 + j;
+				row = row < 0 ? 0 : (row > size ? size : row);
+				for(int k=0; k <= meshSize; k++)
+				{
+					int col = col0 + k;
+					col = col < 0 ? 0 : (col > size ? size : col);
+					chunkHeights[j*(meshSize+1)+k] = GetHeight(row, col);
+				}
+			}
+			mesh->SetHeights(&chunkHeights[0], meshSize+1);
+			if(compactChunks)
+				mesh->SetCompact(true);
+
+			chunks[cr*chunksPerSide+cc] = mesh;
+			UpdateChunkBounds(cr, cc);
+		}
+	}
+
+	return true;
+}
+
+size_t Terrain::GetMemory() const
+{
+	size_t bytes = heights.size()*sizeof(float);
+	for(size_t i=0; i < chunks.size(); i++)
+		bytes += chunks[i] ? chunks[i]->GetVertexMemory() + chunks[i]->GetIndexMemory() : 0;
+	return bytes + lodIndices.size()*sizeof(GLushort);
+}
+
+void Terrain::UpdateChunkBounds(int chunkRow, int chunkCol)
+{
+	float minHeight = 1e30f, maxHeight = -1e30f;
+	for(int j=chunkRow*chunkSize; j <= (chunkRow+1)*chunkSize; j++)
+	{
+		for(int k=chunkCol*chunkSize; k <= (chunkCol+1)*chunkSize; k++)
+		{
+			const float h = GetHeight(j, k);
+			if(h < minHeight) minHeight = h;
+			if(h > maxHeight) maxHeight = h;
+		}
+	}
+	chunkMinHeight[chunkRow*chunksPerSide+chunkCol] = minHeight;
+	chunkMaxHeight[chunkRow*chunksPerSide+chunkCol] = maxHeight;
+}
+
+void Terrain::SetMaterial(VECTOR3D ambient, VECTOR3D diffuse, VECTOR3D specular, double shininess)
+{
+	for(size_t i=0; i < chunks.size(); i++)
+		chunks[i]->SetMaterial(ambient, diffuse, specular, shininess);
+}
+
+// Chunk grid point (row, col), 0..chunkSize, to an index into the chunk mesh with apron
+GLushort Terrain::ChunkVertex(int row, int col) const
+{
+	return (GLushort)((row+1)*(chunkSize+3) + col+1);
+}
+
+// Triangle wound counterclockwise in (col, row) space like the QuadMesh quads
+void Terrain::AddTriangle(std::vector<GLushort> &out, int r0, int c0, int r1, int c1, int r2, int c2)
+{
+	const int area = (c1-c0)*(r2-r0) - (r1-r0)*(c2-c0);
+	if(area == 0)
+		return;
+	if(area < 0)
+	{
+		std::swap(r1, r2);
+		std::swap(c1, c2);
+	}
+	out.push_back(ChunkVertex(r0, c0));
+	out.push_back(ChunkVertex(r1, c1));
+	out.push_back(ChunkVertex(r2, c2));
+}
+
+// Triangulate the strip between one chunk edge and the inner ring one step in.
+// The edge has a vertex every outerStep (twice the step next to a coarser chunk)
+// and the two polylines are zipped together by position along the edge.
+void Terrain::AddBorder(std::vector<GLushort> &out, int side, int step, int outerStep)
+{
+	std::vector<int> outer, inner;
+	for(int t=0; t <= chunkSize; t+=outerStep)
+		outer.push_back(t);
+	for(int t=step; t <= chunkSize-step; t+=step)
+		inner.push_back(t);
+
+	// (t, depth) along the side to (row, col), walking the border counterclockwise
+	int rows[3], cols[3];
+	size_t i=0, j=0;
+	while(i+1 < outer.size() || j+1 < inner.size())
+	{
+		int t[3], depth[3];
+		if(j+1 >= inner.size() || (i+1 < outer.size() && outer[i+1] <= inner[j+1]))
+		{
+			t[0] = outer[i]; depth[0] = 0;
+			t[1] = outer[i+1]; depth[1] = 0;
+			t[2] = inner[j]; depth[2] = step;
+			i++;
+		}
+		else
+		{
+			t[0] = outer[i]; depth[0] = 0;
+			t[1] = inner[j+1]; depth[1] = step;
+			t[2] = inner[j]; depth[2] = step;
+			j++;
+		}
+
+		for(int v=0; v < 3; v++)
+		{
+			switch(side)
+			{
+			case 0: rows[v] = depth[v];             cols[v] = t[v];                 break;
+			case 1: rows[v] = t[v];                 cols[v] = chunkSize - depth[v]; break;
+			case 2: rows[v] = chunkSize - depth[v]; cols[v] = chunkSize - t[v];     break;
+			default: rows[v] = chunkSize - t[v];    cols[v] = depth[v];             break;
+			}
+		}
+		AddTriangle(out, rows[0], cols[0], rows[1], cols[1], rows[2], cols[2]);
+	}
+}
+
+void Terrain::BuildLodIndices()
+{
+	lodIndices.clear();
+	lodFirst.assign(numLevels*16, 0);
+	lodCount.assign(numLevels*16, 0);
+
+	for(int level=0; level < numLevels; level++)
+	{
+		const int step = 1 << level;
+		for(int mask=0; mask < 16; mask++)
+		{
+			const int first = (int)lodIndices.size();
+
+			// Interior cells, two triangles each
+			for(int r=step; r < chunkSize-step; r+=step)
+			{
+				for(int c=step; c < chunkSize-step; c+=step)
+				{
+					AddTriangle(lodIndices, r, c, r, c+step, r+step, c+step);
+					AddTriangle(lodIndices, r, c, r+step, c+step, r+step, c);
+				}
+			}
+
+			for(int side=0; side < 4; side++)
+			{
+				AddBorder(lodIndices, side, step, (mask & (1 << side)) ? 2*step : step);
+			}
+
+			lodFirst[level*16+mask] = first;
+			lodCount[level*16+mask] = (int)lodIndices.size() - first;
+		}
+	}
+}
+
+// Level from the distance between the camera and each chunk's bounding box, then
+// coarse chunks next to much finer ones are refined until neighbours differ by one
+void Terrain::SelectLevels(const float *cameraPos)
+{
+	const float chunkWorld = chunkSize*cellSize;
+	for(int cr=0; cr < chunksPerSide; cr++)
+	{
+		for(int cc=0; cc < chunksPerSide; cc++)
+		{
+			const int c = cr*chunksPerSide+cc;
+			const float minX = origin.x + cc*chunkWorld, maxX = minX + chunkWorld;
+			const float maxZ = origin.z - cr*chunkWorld, minZ = maxZ - chunkWorld;
+			const float minY = origin.y + chunkMinHeight[c], maxY = origin.y + chunkMaxHeight[c];
+
+			const float dx = cameraPos[0] < minX ? minX - cameraPos[0] : (cameraPos[0] > maxX ? cameraPos[0] - maxX : 0.0f);
+			const float dy = cameraPos[1] < minY ? minY - cameraPos[1] : (cameraPos[1] > maxY ? cameraPos[1] - maxY : 0.0f);
+			const float dz = cameraPos[2] < minZ ? minZ - cameraPos[2] : (cameraPos[2] > maxZ ? cameraPos[2] - maxZ : 0.0f);
+			const float distance = sqrtf(dx*dx + dy*dy + dz*dz);
+
+			int level = 0;
+			for(float d=lodDistance; distance >= d && level < numLevels-1; d*=2.0f)
+				level++;
+			chunkLevel[c] = level;
+		}
+	}
+
+	bool changed = true;
+	while(changed)
+	{
+		changed = false;
+		for(int cr=0; cr < chunksPerSide; cr++)
+		{
+			for(int cc=0; cc < chunksPerSide; cc++)
+			{
+				int &level = chunkLevel[cr*chunksPerSide+cc];
+				const int neighbours[4][2] = { {cr-1, cc}, {cr, cc+1}, {cr+1, cc}, {cr, cc-1} };
+				for(int n=0; n < 4; n++)
+				{
+					const int nr = neighbours[n][0], nc = neighbours[n][1];
+					if(nr < 0 || nc < 0 || nr >= chunksPerSide || nc >= chunksPerSide)
+						continue;
+					if(level > chunkLevel[nr*chunksPerSide+nc]+1)
+					{
+						level = chunkLevel[nr*chunksPerSide+nc]+1;
+						changed = true;
+					}
+				}
+			}
+		}
+	}
+}
+
+void Terrain::Draw()
+{
+	PROFILE_ZONE("Terrain::Draw");
+	chunksDrawn = 0;
+	trianglesDrawn = 0;
+	if(chunks.empty())
+		return;
+
+	GLfloat modelview[16], projection[16], clip[16];
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+	glGetFloatv(GL_PROJECTION_MATRIX, projection);
+	for(int c=0; c < 4; c++)
+	{
+		for(int r=0; r < 4; r++)
+		{
+			clip[c*4+r] = projection[r]*modelview[c*4] + projection[4+r]*modelview[c*4+1]
+				+ projection[8+r]*modelview[c*4+2] + projection[12+r]*modelview[c*4+3];
+		}
+	}
+
+	// Frustum planes in terrain space: left, right, bottom, top, near, far
+	float planes[6][4];
+	for(int p=0; p < 6; p++)
+	{
+		const int axis = p/2;
+		const float sign = (p % 2) ? -1.0f : 1.0f;
+		for(int i=0; i < 4; i++)
+			planes[p][i] = clip[i*4+3] + sign*clip[i*4+axis];
+	}
+
+	// Camera in terrain space, the modelview is a rotation plus translation
+	const float *t = &modelview[12];
+	float cameraPos[3];
+	for(int i=0; i < 3; i++)
+		cameraPos[i] = -(modelview[i*4]*t[0] + modelview[i*4+1]*t[1] + modelview[i*4+2]*t[2]);
+	SelectLevels(cameraPos);
+
+	if(useVBO && !lodUploaded)
+	{
+		if(!lodBuffer)
+			glGenBuffers(1, &lodBuffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lodBuffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, lodIndices.size()*sizeof(GLushort), &lodIndices[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		lodUploaded = true;
+	}
+	const GLushort *indexBase = useVBO ? NULL : &lodIndices[0];
+
+	// All chunks share one material
+	chunks[0]->ApplyMaterial();
+
+	const float chunkWorld = chunkSize*cellSize;
+	for(int cr=0; cr < chunksPerSide; cr++)
+	{
+		for(int cc=0; cc < chunksPerSide; cc++)
+		{
+			const int c = cr*chunksPerSide+cc;
+			const float minX = origin.x + cc*chunkWorld, maxX = minX + chunkWorld;
+			const float maxZ = origin.z - cr*chunkWorld, minZ = maxZ - chunkWorld;
+			const float minY = origin.y + chunkMinHeight[c], maxY = origin.y + chunkMaxHeight[c];
+
+			// Outside if the box corner furthest along a plane normal is behind it
+			bool visible = true;
+			for(int p=0; p < 6 && visible; p++)
+			{
+				const float x = planes[p][0] >= 0 ? maxX : minX;
+				const float y = planes[p][1] >= 0 ? maxY : minY;
+				const float z = planes[p][2] >= 0 ? maxZ : minZ;
+				visible = planes[p][0]*x + planes[p][1]*y + planes[p][2]*z + planes[p][3] >= 0;
+			}
+			if(!visible)
+				continue;
+
+			// Edges next to a coarser chunk are stitched
+			const int level = chunkLevel[c];
+			const int neighbours[4][2] = { {cr-1, cc}, {cr, cc+1}, {cr+1, cc}, {cr, cc-1} };
+			int mask = 0;
+			for(int n=0; n < 4; n++)
+			{
+				const int nr = neighbours[n][0], nc = neighbours[n][1];
+				if(nr >= 0 && nc >= 0 && nr < chunksPerSide && nc < chunksPerSide && chunkLevel[nr*chunksPerSide+nc] > level)
+					mask |= 1 << n;
+			}
+
+			const int lod = level*16+mask;
+			// Binding may upload the chunk's own buffers, so the LOD indices are bound after
+			chunks[c]->BindVertexArrays();
+			if(useVBO)
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lodBuffer);
+			PROFILE_COUNT(counterDrawCalls, 1);
+			PROFILE_COUNT(counterVertices, lodCount[lod]);
+			glDrawElements(GL_TRIANGLES, lodCount[lod], GL_UNSIGNED_SHORT, indexBase + lodFirst[lod]);
+			chunks[c]->UnbindVertexArrays();
+
+			chunksDrawn++;
+			trianglesDrawn += lodCount[lod]/3;
+		}
+	}
+
+	if(useVBO)
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,103 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	Terrain.h
+//	Large heightfield ground split into fixed size chunks. Each chunk is a QuadMesh
+//	at full resolution and is drawn at one of several geomipmap levels picked by
+//	distance to the camera. Neighbouring chunks differ by at most one level and the
+//	finer side of a seam is stitched to the coarser edge so there are no cracks.
+//	Chunks outside the view frustum are skipped.
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+class QuadMesh;
+class MeshArena;
+
+class Terrain
+{
+private:
+
+	// Quads per side of the whole terrain and of one chunk, size is a multiple of chunkSize
+	int size;
+	int chunkSize;
+	int chunksPerSide;
+	float cellSize;
+	VECTOR3D origin;
+
+	// (size+1)*(size+1) heights, row by row
+	std::vector<float> heights;
+
+	// Each chunk mesh covers its chunkSize quads plus one apron quad on every side so
+	// that normals along chunk edges see the same faces as their neighbours do
+	std::vector<QuadMesh *> chunks;
+
+	// Shared by the chunk meshes. Compacting a chunk frees its full layout arrays,
+	// which the next chunk then gets back, so a build touches the heap only for the
+	// compact vertices.
+	MeshArena *arena;
+	std::vector<float> chunkMinHeight;
+	std::vector<float> chunkMaxHeight;
+
+	// Chunks are switched to QuadMesh's compact vertex layout once built
+	bool compactChunks;
+
+	// Index lists per level and per mask of edges bordering a coarser neighbour
+	// (bit 0 first row, 1 last column, 2 last row, 3 first column)
+	int numLevels;
+	std::vector<GLushort> lodIndices;
+	std::vector<int> lodFirst;
+	std::vector<int> lodCount;
+	GLuint lodBuffer;
+	bool lodUploaded;
+
+	// Looked up by Build rather than on every Draw
+	bool useVBO;
+
+	// Distance at which chunks drop to level 1, each further level doubles it
+	float lodDistance;
+
+	std::vector<int> chunkLevel;
+	int chunksDrawn;
+	int trianglesDrawn;
+
+private:
+	void BuildLodIndices();
+	void AddBorder(std::vector<GLushort> &out, int side, int step, int outerStep);
+	void AddTriangle(std::vector<GLushort> &out, int r0, int c0, int r1, int c1, int r2, int c2);
+	GLushort ChunkVertex(int row, int col) const;
+	void SelectLevels(const float *cameraPos);
+	void UpdateChunkBounds(int chunkRow, int chunkCol);
+
+public:
+
+	Terrain(int size, int chunkSize = 64, float worldSize = 256.0f, int numLevels = 5);
+	~Terrain();
+
+	int GetSize() const { return size; }
+	float GetCellSize() const { return cellSize; }
+
+	float GetHeight(int row, int col) const { return heights[row*(size+1)+col]; }
+	void SetHeight(int row, int col, float height) { heights[row*(size+1)+col] = height; }
+	void GenerateHills(float amplitude, float wavelength);
+
+	// Build the chunk meshes from the heightfield. The terrain spans worldSize along
+	// x from origin and worldSize along -z, like the ground mesh.
+	bool Build(VECTOR3D origin);
+
+	// Store built chunks as 4 byte compact vertices instead of the full layout
+	void SetCompactChunks(bool compact) { compactChunks = compact; }
+
+	// Bytes held by the heightfield, the chunk vertices and the index lists
+	size_t GetMemory() const;
+
+	void SetMaterial(VECTOR3D ambient, VECTOR3D diffuse, VECTOR3D specular, double shininess);
+	void SetLodDistance(float distance) { lodDistance = distance; }
+
+	// Cull, pick levels and draw with the current modelview and projection matrices
+	void Draw();
+
+	int GetChunksDrawn() const { return chunksDrawn; }
+	int GetTrianglesDrawn() const { return trianglesDrawn; }
+};
+
+#endif	//TERRAIN_H
@@ -0,0 +1,53 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "TransformGraph.h"
+
+TransformGraph::TransformGraph()
+{
+	nodesUpdated = 0;
+}
+
+int TransformGraph::AddNode(int parent, const Matrix4 &local)
+{
+	if(parent >= (int)parents.size())
+		parent = -1;
+
+	parents.push_back(parent);
+	locals.push_back(local);
+	worlds.push_back(local);
+	dirty.push_back(1);
+	return (int)parents.size()-1;
+}
+
+void TransformGraph::SetLocal(int node, const Matrix4 &local)
+{
+	locals[node] = local;
+	dirty[node] = 1;
+}
+
+void TransformGraph::Update()
+{
+	// Parents come first, so a dirty parent has been recomputed before its children
+	// see the flag
+	nodesUpdated = 0;
+	const int numNodes = (int)parents.size();
+	for(int i=0; i < numNodes; i++)
+	{
+		const int parent = parents[i];
+		if(parent >= 0 && dirty[parent])
+			dirty[i] = 1;
+		if(!dirty[i])
+			continue;
+
+		if(parent >= 0)
+			worlds[i].SetProduct(worlds[parent], locals[i]);
+		else
+			worlds[i] = locals[i];
+		nodesUpdated++;
+	}
+
+	if(numNodes > 0)
+		memset(&dirty[0], 0, dirty.size());
+}
@@ -0,0 +1,131 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	TransformGraph.h
+//	Hierarchy of local transforms with cached world matrices, computed on the CPU
+//	instead of through the fixed-function matrix stack.
+//
+//	Nodes are stored flat, every node after its parent, so one pass in index order
+//	updates the whole tree. SetLocal only marks the node dirty. Update then
+//	recomputes the world matrices of the dirty nodes and their descendants and leaves
+//	every other node's cached matrix alone.
+//
+//	Matrix4 is column-major like OpenGL, and Translate, Rotate and Scale multiply on
+//	the right like glTranslatef, glRotatef and glScalef, so a glPushMatrix sequence
+//	translates line for line.
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TRANSFORMGRAPH_H
+#define TRANSFORMGRAPH_H
+
+#include <math.h>
+#include <vector>
+
+struct Matrix4
+{
+	float m[16];
+
+	Matrix4() { SetIdentity(); }
+
+	void SetIdentity()
+	{
+		for(int i=0; i < 16; i++)
+			m[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+	}
+
+	// this = a * b, this must not be a or b
+	void SetProduct(const Matrix4 &a, const Matrix4 &b)
+	{
+		for(int c=0; c < 4; c++)
+		{
+			for(int r=0; r < 4; r++)
+			{
+				m[c*4+r] = a.m[r]*b.m[c*4] + a.m[4+r]*b.m[c*4+1] + a.m[8+r]*b.m[c*4+2] + a.m[12+r]*b.m[c*4+3];
+			}
+		}
+	}
+
+	Matrix4 operator*(const Matrix4 &rhs) const
+	{
+		Matrix4 result;
+		result.SetProduct(*this, rhs);
+		return result;
+	}
+
+	Matrix4 &Translate(float x, float y, float z)
+	{
+		for(int r=0; r < 4; r++)
+			m[12+r] += m[r]*x + m[4+r]*y + m[8+r]*z;
+		return *this;
+	}
+
+	Matrix4 &Scale(float x, float y, float z)
+	{
+		for(int r=0; r < 4; r++)
+		{
+			m[r] *= x;
+			m[4+r] *= y;
+			m[8+r] *= z;
+		}
+		return *this;
+	}
+
+	// Degrees about the axis (x, y, z), as glRotatef
+	Matrix4 &Rotate(float angle, float x, float y, float z)
+	{
+		const float length = sqrtf(x*x + y*y + z*z);
+		if(length == 0.0f)
+			return *this;
+		x /= length;
+		y /= length;
+		z /= length;
+
+		const float radians = angle*(float)M_PI/180.0f;
+		const float c = cosf(radians);
+		const float s = sinf(radians);
+		const float t = 1.0f - c;
+
+		Matrix4 rotation;
+		rotation.m[0] = x*x*t + c;
+		rotation.m[1] = y*x*t + z*s;
+		rotation.m[2] = x*z*t - y*s;
+		rotation.m[4] = x*y*t - z*s;
+		rotation.m[5] = y*y*t + c;
+		rotation.m[6] = y*z*t + x*s;
+		rotation.m[8] = x*z*t + y*s;
+		rotation.m[9] = y*z*t - x*s;
+		rotation.m[10] = z*z*t + c;
+		*this = *this * rotation;
+		return *this;
+	}
+};
+
+class TransformGraph
+{
+private:
+	std::vector<int> parents;
+	std::vector<Matrix4> locals;
+	std::vector<Matrix4> worlds;
+	std::vector<unsigned char> dirty;
+
+	// World matrices recomputed by the last Update
+	int nodesUpdated;
+
+public:
+	TransformGraph();
+
+	// parent is -1 for a root, otherwise a node added earlier
+	int AddNode(int parent, const Matrix4 &local);
+	void SetLocal(int node, const Matrix4 &local);
+	const Matrix4 &GetLocal(int node) const { return locals[node]; }
+	int GetParent(int node) const { return parents[node]; }
+
+	void Update();
+
+	// Valid after Update. GetWorlds is all of them in node order.
+	const Matrix4 &GetWorld(int node) const { return worlds[node]; }
+	const Matrix4 *GetWorlds() const { return worlds.data(); }
+
+	int GetNumNodes() const { return (int)parents.size(); }
+	int GetNodesUpdated() const { return nodesUpdated; }
+};
+
+#endif	//TRANSFORMGRAPH_H
@@ -0,0 +1,56 @@
+#include <math.h>
+#include "TwoBoneIK.h"
+
+static const float degrees = 180.0f/(float)M_PI;
+
+void TwoBoneEnd(const TwoBoneChain &chain, const float *upperAngles, const float *lowerAngles,
+	float *endY, float *endZ, int count)
+{
+	const float rootY = chain.root[0], rootZ = chain.root[1];
+	const float upperY = chain.upper[0], upperZ = chain.upper[1];
+	const float lowerY = chain.lower[0], lowerZ = chain.lower[1];
+	for(int i=0; i < count; i++)
+	{
+		const float upper = upperAngles[i]/degrees;
+		const float whole = upper + lowerAngles[i]/degrees;
+		const float cu = cosf(upper), su = sinf(upper);
+		const float cw = cosf(whole), sw = sinf(whole);
+		endY[i] = rootY + cu*upperY - su*upperZ + cw*lowerY - sw*lowerZ;
+		endZ[i] = rootZ + su*upperY + cu*upperZ + sw*lowerY + cw*lowerZ;
+	}
+}
+
+// With the knee's cosine c, the lower bone lies along the upper one turned by the knee's
+// bend, so the vector from root to end is the upper bone scaled by 1 + c*ratio plus
+// its perpendicular scaled by bend*s*ratio, ratio being the lower length over the upper.
+// The lower angle is that bend less the one between the bones at rest.
+void SolveTwoBone(const TwoBoneChain &chain, const float *targetY, const float *targetZ,
+	float *upperAngles, float *lowerAngles, int count)
+{
+	const float rootY = chain.root[0], rootZ = chain.root[1];
+	const float upperY = chain.upper[0], upperZ = chain.upper[1];
+	const float upperSquared = upperY*upperY + upperZ*upperZ;
+	const float lowerSquared = chain.lower[0]*chain.lower[0] + chain.lower[1]*chain.lower[1];
+	const float lengths = 2.0f*sqrtf(upperSquared*lowerSquared);
+	const float ratio = sqrtf(lowerSquared/upperSquared);
+	const float bend = chain.bend < 0.0f ? -1.0f : 1.0f;
+	const float rest = atan2f(upperY*chain.lower[1] - upperZ*chain.lower[0], upperY*chain.lower[0] + upperZ*chain.lower[1]);
+
+	for(int i=0; i < count; i++)
+	{
+		const float dy = targetY[i] - rootY;
+		const float dz = targetZ[i] - rootZ;
+		const float c = fminf(fmaxf((dy*dy + dz*dz - upperSquared - lowerSquared)/lengths, -1.0f), 1.0f);
+		const float s = bend*sqrtf(1.0f - c*c);
+
+		const float along = 1.0f + c*ratio;
+		const float across = s*ratio;
+		const float vy = along*upperY - across*upperZ;
+		const float vz = along*upperZ + across*upperY;
+
+		float lower = (atan2f(s, c) - rest)*degrees;
+		lower -= 360.0f*floorf(lower/360.0f + 0.5f);
+		lowerAngles[i] = lower;
+		upperAngles[i] = atan2f(vy*dz - vz*dy, vy*dy + vz*dz)*degrees;
+	}
+}
@@ -0,0 +1,37 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	TwoBoneIK.h
+//	Analytic inverse kinematics for a chain of two bones turning about the same axis,
+//	as the robot's hip and knee both turn about x. Points are (y, z) in the plane the
+//	chain moves in, and a rotation by an angle in degrees takes (y, z) to
+//	(cy - sz, sy + cz), as JointPivot::GetLocal does about x.
+//
+//	The knee angle comes from the law of cosines on the two bone lengths and the
+//	distance to the target, the hip angle is then the one turning the end of the
+//	chain onto the target's direction: an acos and an atan2 a chain, no iterating.
+//	A target out of reach leaves the chain straight, or folded, pointing at it.
+//
+//	Both solve and its forward counterpart run over arrays, one entry a chain, so a
+//	crowd's legs are solved in one pass with the chain's constants held in registers.
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TWOBONEIK_H
+#define TWOBONEIK_H
+
+// At upper and lower angles of 0, the end is root + upper + lower
+struct TwoBoneChain
+{
+	float root[2];		// pivot of the upper bone
+	float upper[2];		// from root to the pivot of the lower bone
+	float lower[2];		// from that pivot to the end
+	float bend;			// 1 or -1, the side the lower bone folds to
+};
+
+// end = root + R(upper)(upper + R(lower)lower) for count chains
+void TwoBoneEnd(const TwoBoneChain &chain, const float *upperAngles, const float *lowerAngles,
+	float *endY, float *endZ, int count);
+
+// Angles putting the end of count chains on the targets, within 180 degrees of 0
+void SolveTwoBone(const TwoBoneChain &chain, const float *targetY, const float *targetZ,
+	float *upperAngles, float *lowerAngles, int count);
+
+#endif	//TWOBONEIK_H
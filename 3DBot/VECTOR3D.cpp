@@ -0,0 +1,128 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	VECTOR3D.cpp
+//	Function definitions for the 3d vector class declared in VECTOR3D.h. Angles are in
+//	degrees and rotations are counterclockwise looking down the axis, as glRotatef.
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <type_traits>
+#include "VECTOR3D.h"
+
+static_assert(std::is_trivially_copyable<VECTOR3D>::value, "VECTOR3D arrays are copied with memcpy");
+static_assert(sizeof(VECTOR3D) == 3*sizeof(float), "VECTOR3D arrays are read as packed floats");
+
+void VECTOR3D::RotateX(double angle)
+{
+	(*this)=GetRotatedX(angle);
+}
+
+VECTOR3D VECTOR3D::GetRotatedX(double angle) const
+{
+	if(angle==0.0)
+		return (*this);
+
+	const float sinAngle=(float)sin(M_PI*angle/180);
+	const float cosAngle=(float)cos(M_PI*angle/180);
+
+	return VECTOR3D(x, y*cosAngle - z*sinAngle, y*sinAngle + z*cosAngle);
+}
+
+void VECTOR3D::RotateY(double angle)
+{
+	(*this)=GetRotatedY(angle);
+}
+
+VECTOR3D VECTOR3D::GetRotatedY(double angle) const
+{
+	if(angle==0.0)
+		return (*this);
+
+	const float sinAngle=(float)sin(M_PI*angle/180);
+	const float cosAngle=(float)cos(M_PI*angle/180);
+
+	return VECTOR3D(x*cosAngle + z*sinAngle, y, -x*sinAngle + z*cosAngle);
+}
+
+void VECTOR3D::RotateZ(double angle)
+{
+	(*this)=GetRotatedZ(angle);
+}
+
+VECTOR3D VECTOR3D::GetRotatedZ(double angle) const
+{
+	if(angle==0.0)
+		return (*this);
+
+	const float sinAngle=(float)sin(M_PI*angle/180);
+	const float cosAngle=(float)cos(M_PI*angle/180);
+
+	return VECTOR3D(x*cosAngle - y*sinAngle, x*sinAngle + y*cosAngle, z);
+}
+
+void VECTOR3D::RotateAxis(double angle, const VECTOR3D & axis)
+{
+	(*this)=GetRotatedAxis(angle, axis);
+}
+
+// Rows of the rotation matrix about the normalized axis, as glRotatef builds it
+VECTOR3D VECTOR3D::GetRotatedAxis(double angle, const VECTOR3D & axis) const
+{
+	if(angle==0.0)
+		return (*this);
+
+	VECTOR3D u=axis;
+	u.Normalize();
+
+	const float sinAngle=(float)sin(M_PI*angle/180);
+	const float cosAngle=(float)cos(M_PI*angle/180);
+	const float oneMinusCosAngle=1.0f-cosAngle;
+
+	const VECTOR3D row0(u.x*u.x*oneMinusCosAngle + cosAngle,
+		u.x*u.y*oneMinusCosAngle - sinAngle*u.z,
+		u.x*u.z*oneMinusCosAngle + sinAngle*u.y);
+	const VECTOR3D row1(u.x*u.y*oneMinusCosAngle + sinAngle*u.z,
+		u.y*u.y*oneMinusCosAngle + cosAngle,
+		u.y*u.z*oneMinusCosAngle - sinAngle*u.x);
+	const VECTOR3D row2(u.x*u.z*oneMinusCosAngle - sinAngle*u.y,
+		u.y*u.z*oneMinusCosAngle + sinAngle*u.x,
+		u.z*u.z*oneMinusCosAngle + cosAngle);
+
+	return VECTOR3D(DotProduct(row0), DotProduct(row1), DotProduct(row2));
+}
+
+void VECTOR3D::PackTo01()
+{
+	(*this)=GetPackedTo01();
+}
+
+// Normalized, then from [-1, 1] to [0, 1], for normals stored as colours
+VECTOR3D VECTOR3D::GetPackedTo01() const
+{
+	VECTOR3D temp(*this);
+
+	temp.Normalize();
+
+	return temp*0.5f + VECTOR3D(0.5f, 0.5f, 0.5f);
+}
+
+bool VECTOR3D::operator==(const VECTOR3D & rhs) const
+{
+	return x==rhs.x && y==rhs.y && z==rhs.z;
+}
+
+// Branch free so the loop vectorizes where sqrtf need not set errno: zero vectors are
+// divided by 1 and stay zero, and == is used as it cannot trap on NaN where > can. The
+// components are divided rather than scaled by a reciprocal so the results are the
+// same as Normalize's.
+void NormalizeArray(VECTOR3D * vectors, int count)
+{
+	float * f=(float *)vectors;
+	for(int i=0; i < count; i++, f+=3)
+	{
+		const float norm=sqrtf(f[0]*f[0] + f[1]*f[1] + f[2]*f[2]);
+		const float divisor=norm + (norm==0.0f ? 1.0f : 0.0f);
+		f[0]/=divisor;
+		f[1]/=divisor;
+		f[2]/=divisor;
+	}
+}
@@ -8,6 +8,10 @@
 //									-	Corrected Lerp
 //				7th January 2003	-	Added QuadraticInterpolate
 //
+//	Trivially copyable: the copy constructor and destructor are the implicit ones, so
+//	arrays of VECTOR3D copy with memcpy and loops over them can be vectorized. MulAdd,
+//	LerpInto and NormalizeArray work in place without building temporaries.
+//
 //	Copyright (c) 2006, Paul Baker
 //	Distributed under the New BSD Licence. (See accompanying file License.txt or copy at
 //	http://www.paulsprojects.net/NewBSDLicense.txt)
@@ -29,11 +33,6 @@ public:
 	VECTOR3D(const float * rhs)	:	x(*rhs), y(*(rhs+1)), z(*(rhs+2))
 	{}
 
-	VECTOR3D(const VECTOR3D & rhs)	:	x(rhs.x), y(rhs.y), z(rhs.z)
-	{}
-
-	~VECTOR3D() {}	//empty
-
 	void Set(float newX, float newY, float newZ)
 	{	x=newX;	y=newY;	z=newZ;	}
 	
@@ -90,10 +89,28 @@ public:
 
 	//linear interpolate
 	VECTOR3D lerp(const VECTOR3D & v2, float factor) const
-	{	return (*this)*(1.0f-factor) + v2*factor;	}
+	{
+		const float w0=1.0f-factor;
+		return VECTOR3D(x*w0 + v2.x*factor, y*w0 + v2.y*factor, z*w0 + v2.z*factor);
+	}
 
+	//Bernstein weights, one vector built
 	VECTOR3D QuadraticInterpolate(const VECTOR3D & v2, const VECTOR3D & v3, float factor) const
-	{	return (*this)*(1.0f-factor)*(1.0f-factor) + 2*v2*factor*(1.0f-factor) + v3*factor*factor;}
+	{
+		const float w0=(1.0f-factor)*(1.0f-factor);
+		const float w1=2.0f*factor*(1.0f-factor);
+		const float w2=factor*factor;
+		return VECTOR3D(x*w0 + v2.x*w1 + v3.x*w2, y*w0 + v2.y*w1 + v3.y*w2, z*w0 + v2.z*w1 + v3.z*w2);
+	}
+
+	//lerp into result, saving the construction of a temporary
+	void LerpInto(const VECTOR3D & v2, float factor, VECTOR3D & result) const
+	{
+		const float w0=1.0f-factor;
+		result.x=x*w0 + v2.x*factor;
+		result.y=y*w0 + v2.y*factor;
+		result.z=z*w0 + v2.z*factor;
+	}
 
 
 	//overloaded operators
@@ -141,6 +158,10 @@ public:
 
 	void operator*=(const float rhs)
 	{	x*=rhs;	y*=rhs;	z*=rhs;	}
+
+	//self-add of v2*factor, as (*this)+=v2*factor without the temporary
+	VECTOR3D & MulAdd(const VECTOR3D & v2, float factor)
+	{	x+=v2.x*factor;	y+=v2.y*factor;	z+=v2.z*factor;	return *this;	}
 	
 	void operator/=(const float rhs)
 	{	if(rhs==0.0f)
@@ -164,4 +185,10 @@ public:
 	float z;
 };
 
+inline VECTOR3D operator*(float scaleFactor, const VECTOR3D & rhs)
+{	return rhs*scaleFactor;	}
+
+//Normalize each of count vectors, as VECTOR3D::Normalize does
+void NormalizeArray(VECTOR3D * vectors, int count);
+
 #endif	//VECTOR3D_H
\ No newline at end of file
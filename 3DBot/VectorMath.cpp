@@ -0,0 +1,232 @@
+#include <math.h>
+#include "VECTOR3D.h"
+#include "VectorMath.h"
+
+Mat4 Mat4::GetTransposed() const
+{
+	Mat4 result;
+	for(int c=0; c < 4; c++)
+	{
+		for(int r=0; r < 4; r++)
+			result.m[r*4+c] = m[c*4+r];
+	}
+	return result;
+}
+
+// The 3x3 part is inverted through its cofactors, the translation is then taken back
+// through the inverse
+Mat4 Mat4::GetAffineInverse() const
+{
+	const float *a = m;
+	float cofactors[9];
+	cofactors[0] = a[5]*a[10] - a[6]*a[9];
+	cofactors[1] = a[2]*a[9] - a[1]*a[10];
+	cofactors[2] = a[1]*a[6] - a[2]*a[5];
+	cofactors[3] = a[6]*a[8] - a[4]*a[10];
+	cofactors[4] = a[0]*a[10] - a[2]*a[8];
+	cofactors[5] = a[2]*a[4] - a[0]*a[6];
+	cofactors[6] = a[4]*a[9] - a[5]*a[8];
+	cofactors[7] = a[1]*a[8] - a[0]*a[9];
+	cofactors[8] = a[0]*a[5] - a[1]*a[4];
+
+	const float determinant = a[0]*cofactors[0] + a[4]*cofactors[1] + a[8]*cofactors[2];
+	const float scale = determinant != 0.0f ? 1.0f / determinant : 0.0f;
+
+	Mat4 result;
+	for(int c=0; c < 3; c++)
+	{
+		for(int r=0; r < 3; r++)
+			result.m[c*4+r] = cofactors[c*3+r]*scale;
+	}
+	for(int r=0; r < 3; r++)
+		result.m[12+r] = -(result.m[r]*a[12] + result.m[4+r]*a[13] + result.m[8+r]*a[14]);
+	return result;
+}
+
+Mat4 Mat4::Translation(float x, float y, float z)
+{
+	Mat4 result;
+	result.m[12] = x;
+	result.m[13] = y;
+	result.m[14] = z;
+	return result;
+}
+
+Mat4 Mat4::Scaling(float x, float y, float z)
+{
+	Mat4 result;
+	result.m[0] = x;
+	result.m[5] = y;
+	result.m[10] = z;
+	return result;
+}
+
+Quat Quat::FromAxisAngle(float angle, const VECTOR3D &axis)
+{
+	const float length = axis.GetLength();
+	if(length == 0.0f)
+		return Quat();
+
+	const float half = 0.5f*angle*(float)M_PI/180.0f;
+	const float s = sinf(half) / length;
+	return Quat(axis.x*s, axis.y*s, axis.z*s, cosf(half));
+}
+
+// From the largest of w, x, y and z, which keeps the square root away from zero
+Quat Quat::FromMat4(const Mat4 &matrix)
+{
+	const float *m = matrix.m;
+	const float trace = m[0] + m[5] + m[10];
+	Quat q;
+	if(trace > 0.0f)
+	{
+		const float s = 0.5f / sqrtf(trace + 1.0f);
+		q = Quat((m[6] - m[9])*s, (m[8] - m[2])*s, (m[1] - m[4])*s, 0.25f / s);
+	}
+	else if(m[0] > m[5] && m[0] > m[10])
+	{
+		const float s = 2.0f*sqrtf(1.0f + m[0] - m[5] - m[10]);
+		q = Quat(0.25f*s, (m[4] + m[1]) / s, (m[8] + m[2]) / s, (m[6] - m[9]) / s);
+	}
+	else if(m[5] > m[10])
+	{
+		const float s = 2.0f*sqrtf(1.0f + m[5] - m[0] - m[10]);
+		q = Quat((m[4] + m[1]) / s, 0.25f*s, (m[9] + m[6]) / s, (m[8] - m[2]) / s);
+	}
+	else
+	{
+		const float s = 2.0f*sqrtf(1.0f + m[10] - m[0] - m[5]);
+		q = Quat((m[8] + m[2]) / s, (m[9] + m[6]) / s, 0.25f*s, (m[1] - m[4]) / s);
+	}
+	q.Normalize();
+	return q;
+}
+
+void Quat::Normalize()
+{
+	const float length = sqrtf(Dot(*this));
+	if(length > 0.0f)
+	{
+		x /= length; y /= length; z /= length; w /= length;
+	}
+}
+
+// v + 2w(u x v) + 2u x (u x v), u the vector part
+VECTOR3D Quat::Rotate(const VECTOR3D &v) const
+{
+	const VECTOR3D u(x, y, z);
+	const VECTOR3D t = u.CrossProduct(v)*2.0f;
+	return v + t*w + u.CrossProduct(t);
+}
+
+Mat4 Quat::GetMat4() const
+{
+	Mat4 result;
+	result.m[0] = 1.0f - 2.0f*(y*y + z*z);
+	result.m[1] = 2.0f*(x*y + z*w);
+	result.m[2] = 2.0f*(x*z - y*w);
+	result.m[4] = 2.0f*(x*y - z*w);
+	result.m[5] = 1.0f - 2.0f*(x*x + z*z);
+	result.m[6] = 2.0f*(y*z + x*w);
+	result.m[8] = 2.0f*(x*z + y*w);
+	result.m[9] = 2.0f*(y*z - x*w);
+	result.m[10] = 1.0f - 2.0f*(x*x + y*y);
+	return result;
+}
+
+Quat Quat::Nlerp(const Quat &a, const Quat &b, float factor)
+{
+	const float sign = a.Dot(b) < 0.0f ? -1.0f : 1.0f;
+	Quat q(a.x + (b.x*sign - a.x)*factor, a.y + (b.y*sign - a.y)*factor,
+		a.z + (b.z*sign - a.z)*factor, a.w + (b.w*sign - a.w)*factor);
+	q.Normalize();
+	return q;
+}
+
+Quat Quat::Slerp(const Quat &a, const Quat &b, float factor)
+{
+	float cosine = a.Dot(b);
+	const float sign = cosine < 0.0f ? -1.0f : 1.0f;
+	cosine *= sign;
+
+	// Nearly the same rotation, where sin(angle) is too small to divide by
+	if(cosine > 0.9995f)
+		return Nlerp(a, b, factor);
+
+	const float angle = acosf(cosine);
+	const float s = 1.0f / sinf(angle);
+	const float wa = sinf((1.0f - factor)*angle)*s;
+	const float wb = sinf(factor*angle)*s*sign;
+	return Quat(a.x*wa + b.x*wb, a.y*wa + b.y*wb, a.z*wa + b.z*wb, a.w*wa + b.w*wb);
+}
+
+void TransformPoints(const Mat4 &m, const Vec4 *in, Vec4 *out, int count)
+{
+	const SimdFloat4 c0 = SimdLoad(&m.m[0]), c1 = SimdLoad(&m.m[4]), c2 = SimdLoad(&m.m[8]), c3 = SimdLoad(&m.m[12]);
+	for(int i=0; i < count; i++)
+	{
+		const SimdFloat4 p = in[i].Load();
+		out[i].Store(SimdMulAdd(c3, SimdLane(p, 3), SimdMulAdd(c2, SimdLane(p, 2),
+			SimdMulAdd(c1, SimdLane(p, 1), SimdMul(c0, SimdLane(p, 0))))));
+	}
+}
+
+void TransformPoints(const Mat4 &m, const VECTOR3D *in, VECTOR3D *out, int count)
+{
+	const float *a = m.m;
+	for(int i=0; i < count; i++)
+	{
+		const float x = in[i].x, y = in[i].y, z = in[i].z;
+		out[i].Set(a[0]*x + a[4]*y + a[8]*z + a[12], a[1]*x + a[5]*y + a[9]*z + a[13], a[2]*x + a[6]*y + a[10]*z + a[14]);
+	}
+}
+
+void TransformPoints(const Mat4 &m, const float *x, const float *y, const float *z,
+	float *outX, float *outY, float *outZ, int count)
+{
+	const float *a = m.m;
+	int i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		const SimdFloat4 px = SimdLoadUnaligned(x + i), py = SimdLoadUnaligned(y + i), pz = SimdLoadUnaligned(z + i);
+		SimdStoreUnaligned(outX + i, SimdMulAdd(SimdSplat(a[8]), pz, SimdMulAdd(SimdSplat(a[4]), py,
+			SimdMulAdd(SimdSplat(a[0]), px, SimdSplat(a[12])))));
+		SimdStoreUnaligned(outY + i, SimdMulAdd(SimdSplat(a[9]), pz, SimdMulAdd(SimdSplat(a[5]), py,
+			SimdMulAdd(SimdSplat(a[1]), px, SimdSplat(a[13])))));
+		SimdStoreUnaligned(outZ + i, SimdMulAdd(SimdSplat(a[10]), pz, SimdMulAdd(SimdSplat(a[6]), py,
+			SimdMulAdd(SimdSplat(a[2]), px, SimdSplat(a[14])))));
+	}
+	for(; i < count; i++)
+	{
+		const float px = x[i], py = y[i], pz = z[i];
+		outX[i] = a[0]*px + a[4]*py + a[8]*pz + a[12];
+		outY[i] = a[1]*px + a[5]*py + a[9]*pz + a[13];
+		outZ[i] = a[2]*px + a[6]*py + a[10]*pz + a[14];
+	}
+}
+
+void MultiplyMatrices(const Mat4 *a, const Mat4 *b, Mat4 *out, int count)
+{
+	for(int i=0; i < count; i++)
+		out[i].SetProduct(a[i], b[i]);
+}
+
+void MultiplyMatrices(const Mat4 *a, const Mat4 &b, Mat4 *out, int count)
+{
+	for(int i=0; i < count; i++)
+		out[i].SetProduct(a[i], b);
+}
+
+void MultiplyMatrices(const Mat4 &a, const Mat4 *b, Mat4 *out, int count)
+{
+	const SimdFloat4 a0 = SimdLoad(&a.m[0]), a1 = SimdLoad(&a.m[4]), a2 = SimdLoad(&a.m[8]), a3 = SimdLoad(&a.m[12]);
+	for(int i=0; i < count; i++)
+	{
+		for(int c=0; c < 4; c++)
+		{
+			const SimdFloat4 bc = SimdLoad(&b[i].m[c*4]);
+			SimdStore(&out[i].m[c*4], SimdMulAdd(a3, SimdLane(bc, 3), SimdMulAdd(a2, SimdLane(bc, 2),
+				SimdMulAdd(a1, SimdLane(bc, 1), SimdMul(a0, SimdLane(bc, 0))))));
+		}
+	}
+}
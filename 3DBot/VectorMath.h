@@ -0,0 +1,215 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	VectorMath.h
+//	16 byte aligned 4-float vectors, 4x4 matrices and quaternions for CPU work on many
+//	robots at once: skinning, culling and posing. Vec4 and Mat4 go through the Simd
+//	functions below, which are SSE on x86, NEON on ARM and plain loops elsewhere, so
+//	nothing outside this header touches intrinsics.
+//
+//	Mat4 is column-major with m[c*4+r] like Matrix4 and OpenGL, and a Matrix4 loads
+//	from and stores to one through its m array. Angles are in degrees, as glRotatef.
+//
+//	The batch functions work through arrays: points by one matrix, as 4-float
+//	vectors, VECTOR3Ds or separate x, y and z arrays, and matrices pairwise or all by
+//	one matrix. Outputs may not overlap inputs unless they are the same array.
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef VECTORMATH_H
+#define VECTORMATH_H
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define VECTORMATH_SSE
+#include <xmmintrin.h>
+typedef __m128 SimdFloat4;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define VECTORMATH_NEON
+#include <arm_neon.h>
+typedef float32x4_t SimdFloat4;
+#else
+struct SimdFloat4 { float v[4]; };
+#endif
+
+#ifdef VECTORMATH_SSE
+inline SimdFloat4 SimdLoad(const float *aligned) { return _mm_load_ps(aligned); }
+inline SimdFloat4 SimdLoadUnaligned(const float *p) { return _mm_loadu_ps(p); }
+inline void SimdStore(float *aligned, SimdFloat4 a) { _mm_store_ps(aligned, a); }
+inline void SimdStoreUnaligned(float *p, SimdFloat4 a) { _mm_storeu_ps(p, a); }
+inline SimdFloat4 SimdSplat(float f) { return _mm_set1_ps(f); }
+inline SimdFloat4 SimdAdd(SimdFloat4 a, SimdFloat4 b) { return _mm_add_ps(a, b); }
+inline SimdFloat4 SimdSub(SimdFloat4 a, SimdFloat4 b) { return _mm_sub_ps(a, b); }
+inline SimdFloat4 SimdMul(SimdFloat4 a, SimdFloat4 b) { return _mm_mul_ps(a, b); }
+inline SimdFloat4 SimdMulAdd(SimdFloat4 a, SimdFloat4 b, SimdFloat4 c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+inline SimdFloat4 SimdMin(SimdFloat4 a, SimdFloat4 b) { return _mm_min_ps(a, b); }
+inline SimdFloat4 SimdMax(SimdFloat4 a, SimdFloat4 b) { return _mm_max_ps(a, b); }
+#define SimdLane(a, lane) _mm_shuffle_ps(a, a, _MM_SHUFFLE(lane, lane, lane, lane))
+#elif defined(VECTORMATH_NEON)
+inline SimdFloat4 SimdLoad(const float *aligned) { return vld1q_f32(aligned); }
+inline SimdFloat4 SimdLoadUnaligned(const float *p) { return vld1q_f32(p); }
+inline void SimdStore(float *aligned, SimdFloat4 a) { vst1q_f32(aligned, a); }
+inline void SimdStoreUnaligned(float *p, SimdFloat4 a) { vst1q_f32(p, a); }
+inline SimdFloat4 SimdSplat(float f) { return vdupq_n_f32(f); }
+inline SimdFloat4 SimdAdd(SimdFloat4 a, SimdFloat4 b) { return vaddq_f32(a, b); }
+inline SimdFloat4 SimdSub(SimdFloat4 a, SimdFloat4 b) { return vsubq_f32(a, b); }
+inline SimdFloat4 SimdMul(SimdFloat4 a, SimdFloat4 b) { return vmulq_f32(a, b); }
+inline SimdFloat4 SimdMulAdd(SimdFloat4 a, SimdFloat4 b, SimdFloat4 c) { return vmlaq_f32(c, a, b); }
+inline SimdFloat4 SimdMin(SimdFloat4 a, SimdFloat4 b) { return vminq_f32(a, b); }
+inline SimdFloat4 SimdMax(SimdFloat4 a, SimdFloat4 b) { return vmaxq_f32(a, b); }
+#define SimdLane(a, lane) vdupq_n_f32(vgetq_lane_f32(a, lane))
+#else
+inline SimdFloat4 SimdLoad(const float *p) { SimdFloat4 r; for(int i=0; i < 4; i++) r.v[i] = p[i]; return r; }
+inline SimdFloat4 SimdLoadUnaligned(const float *p) { return SimdLoad(p); }
+inline void SimdStore(float *p, SimdFloat4 a) { for(int i=0; i < 4; i++) p[i] = a.v[i]; }
+inline void SimdStoreUnaligned(float *p, SimdFloat4 a) { SimdStore(p, a); }
+inline SimdFloat4 SimdSplat(float f) { SimdFloat4 r; for(int i=0; i < 4; i++) r.v[i] = f; return r; }
+inline SimdFloat4 SimdAdd(SimdFloat4 a, SimdFloat4 b) { for(int i=0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+inline SimdFloat4 SimdSub(SimdFloat4 a, SimdFloat4 b) { for(int i=0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+inline SimdFloat4 SimdMul(SimdFloat4 a, SimdFloat4 b) { for(int i=0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+inline SimdFloat4 SimdMulAdd(SimdFloat4 a, SimdFloat4 b, SimdFloat4 c) { for(int i=0; i < 4; i++) c.v[i] += a.v[i]*b.v[i]; return c; }
+inline SimdFloat4 SimdMin(SimdFloat4 a, SimdFloat4 b) { for(int i=0; i < 4; i++) a.v[i] = b.v[i] < a.v[i] ? b.v[i] : a.v[i]; return a; }
+inline SimdFloat4 SimdMax(SimdFloat4 a, SimdFloat4 b) { for(int i=0; i < 4; i++) a.v[i] = b.v[i] > a.v[i] ? b.v[i] : a.v[i]; return a; }
+#define SimdLane(a, lane) SimdSplat((a).v[lane])
+#endif
+
+struct alignas(16) Vec4
+{
+	float x, y, z, w;
+
+	Vec4() : x(0.0f), y(0.0f), z(0.0f), w(0.0f) {}
+	Vec4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+
+	// w is 1 for a point, 0 for a direction
+	Vec4(const VECTOR3D &v, float w) : x(v.x), y(v.y), z(v.z), w(w) {}
+
+	SimdFloat4 Load() const { return SimdLoad(&x); }
+	void Store(SimdFloat4 v) { SimdStore(&x, v); }
+
+	Vec4 operator+(const Vec4 &rhs) const { Vec4 r; r.Store(SimdAdd(Load(), rhs.Load())); return r; }
+	Vec4 operator-(const Vec4 &rhs) const { Vec4 r; r.Store(SimdSub(Load(), rhs.Load())); return r; }
+	Vec4 operator*(float rhs) const { Vec4 r; r.Store(SimdMul(Load(), SimdSplat(rhs))); return r; }
+
+	float Dot(const Vec4 &rhs) const { return x*rhs.x + y*rhs.y + z*rhs.z + w*rhs.w; }
+	VECTOR3D GetVECTOR3D() const { return VECTOR3D(x, y, z); }
+};
+
+struct alignas(16) Mat4
+{
+	float m[16];
+
+	Mat4() { SetIdentity(); }
+
+	// 16 floats, column-major, need not be aligned (Matrix4::m)
+	explicit Mat4(const float *columns)
+	{
+		for(int c=0; c < 4; c++)
+			SimdStore(&m[c*4], SimdLoadUnaligned(&columns[c*4]));
+	}
+
+	void SetIdentity()
+	{
+		for(int i=0; i < 16; i++)
+			m[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+	}
+
+	void Store(float *columns) const
+	{
+		for(int c=0; c < 4; c++)
+			SimdStoreUnaligned(&columns[c*4], SimdLoad(&m[c*4]));
+	}
+
+	// this = a * b, this may be a or b
+	void SetProduct(const Mat4 &a, const Mat4 &b)
+	{
+		const SimdFloat4 a0 = SimdLoad(&a.m[0]), a1 = SimdLoad(&a.m[4]), a2 = SimdLoad(&a.m[8]), a3 = SimdLoad(&a.m[12]);
+		SimdFloat4 columns[4];
+		for(int c=0; c < 4; c++)
+		{
+			const SimdFloat4 bc = SimdLoad(&b.m[c*4]);
+			columns[c] = SimdMulAdd(a3, SimdLane(bc, 3), SimdMulAdd(a2, SimdLane(bc, 2),
+				SimdMulAdd(a1, SimdLane(bc, 1), SimdMul(a0, SimdLane(bc, 0)))));
+		}
+		for(int c=0; c < 4; c++)
+			SimdStore(&m[c*4], columns[c]);
+	}
+
+	Mat4 operator*(const Mat4 &rhs) const
+	{
+		Mat4 result;
+		result.SetProduct(*this, rhs);
+		return result;
+	}
+
+	Vec4 operator*(const Vec4 &v) const
+	{
+		const SimdFloat4 p = v.Load();
+		Vec4 result;
+		result.Store(SimdMulAdd(SimdLoad(&m[12]), SimdLane(p, 3), SimdMulAdd(SimdLoad(&m[8]), SimdLane(p, 2),
+			SimdMulAdd(SimdLoad(&m[4]), SimdLane(p, 1), SimdMul(SimdLoad(&m[0]), SimdLane(p, 0))))));
+		return result;
+	}
+
+	VECTOR3D TransformPoint(const VECTOR3D &p) const { return ((*this) * Vec4(p, 1.0f)).GetVECTOR3D(); }
+	VECTOR3D TransformDirection(const VECTOR3D &d) const { return ((*this) * Vec4(d, 0.0f)).GetVECTOR3D(); }
+
+	Mat4 GetTransposed() const;
+
+	// The inverse of a rotation, translation and uniform or non-uniform scale
+	Mat4 GetAffineInverse() const;
+
+	static Mat4 Translation(float x, float y, float z);
+	static Mat4 Scaling(float x, float y, float z);
+};
+
+struct alignas(16) Quat
+{
+	float x, y, z, w;
+
+	Quat() : x(0.0f), y(0.0f), z(0.0f), w(1.0f) {}
+	Quat(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+
+	// Degrees about axis, which need not be normalized, as glRotatef
+	static Quat FromAxisAngle(float angle, const VECTOR3D &axis);
+
+	// Rotation part of a matrix without scale
+	static Quat FromMat4(const Mat4 &m);
+
+	// Rotates by rhs first, then by this
+	Quat operator*(const Quat &rhs) const
+	{
+		return Quat(w*rhs.x + x*rhs.w + y*rhs.z - z*rhs.y,
+			w*rhs.y - x*rhs.z + y*rhs.w + z*rhs.x,
+			w*rhs.z + x*rhs.y - y*rhs.x + z*rhs.w,
+			w*rhs.w - x*rhs.x - y*rhs.y - z*rhs.z);
+	}
+
+	Quat GetConjugate() const { return Quat(-x, -y, -z, w); }
+	float Dot(const Quat &rhs) const { return x*rhs.x + y*rhs.y + z*rhs.z + w*rhs.w; }
+	void Normalize();
+
+	VECTOR3D Rotate(const VECTOR3D &v) const;
+	Mat4 GetMat4() const;
+
+	// Shortest path between two unit quaternions. Nlerp is cheaper and close for
+	// small angles, Slerp keeps a constant angular speed.
+	static Quat Nlerp(const Quat &a, const Quat &b, float factor);
+	static Quat Slerp(const Quat &a, const Quat &b, float factor);
+};
+
+// out[i] = m * in[i]
+void TransformPoints(const Mat4 &m, const Vec4 *in, Vec4 *out, int count);
+
+// Points with w = 1, without the divide
+void TransformPoints(const Mat4 &m, const VECTOR3D *in, VECTOR3D *out, int count);
+
+// Points as separate x, y and z arrays, four at a time
+void TransformPoints(const Mat4 &m, const float *x, const float *y, const float *z,
+	float *outX, float *outY, float *outZ, int count);
+
+// out[i] = a[i] * b[i]
+void MultiplyMatrices(const Mat4 *a, const Mat4 *b, Mat4 *out, int count);
+
+// out[i] = a * b[i]
+void MultiplyMatrices(const Mat4 &a, const Mat4 *b, Mat4 *out, int count);
+
+// out[i] = a[i] * b
+void MultiplyMatrices(const Mat4 *a, const Mat4 &b, Mat4 *out, int count);
+
+#endif	//VECTORMATH_H
@@ -0,0 +1,85 @@
+#define GL_SILENCE_DEPRECATION
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+#include <stddef.h>
+#include <vector>
+#include "VertexCache.h"
+
+// A vertex loaded into a FIFO cache is evicted cacheSize loads later. Between loading
+// a vertex as the lower one of its column and using it again as the upper one, a band
+// row loads bandWidth+1 vertices, one more in the triangle list order which loads the
+// next lower vertex before it.
+int GridBandWidth(int cacheSize)
+{
+	return cacheSize > 4 ? cacheSize-3 : 1;
+}
+
+float ComputeACMR(const unsigned int *indices, int count, GLenum mode, unsigned int restartIndex, int cacheSize)
+{
+	std::vector<unsigned int> cache(cacheSize > 0 ? cacheSize : 1, restartIndex);
+	int next = 0;
+	int misses = 0;
+	int triangles = 0;
+
+	// Last vertices of the current primitive, to find its triangles
+	unsigned int corners[4];
+	int cornerCount = 0;
+
+	for(int i=0; i < count; i++)
+	{
+		const unsigned int v = indices[i];
+		if(mode == GL_TRIANGLE_STRIP && v == restartIndex)
+		{
+			cornerCount = 0;
+			continue;
+		}
+
+		bool hit = false;
+		for(size_t c=0; c < cache.size(); c++)
+		{
+			if(cache[c] == v)
+			{
+				hit = true;
+				break;
+			}
+		}
+		if(!hit)
+		{
+			cache[next] = v;
+			next = (next+1) % (int)cache.size();
+			misses++;
+		}
+
+		corners[cornerCount++] = v;
+		if(mode == GL_TRIANGLE_STRIP)
+		{
+			if(cornerCount == 3)
+			{
+				if(corners[0] != corners[1] && corners[1] != corners[2] && corners[0] != corners[2])
+					triangles++;
+				corners[0] = corners[1];
+				corners[1] = corners[2];
+				cornerCount = 2;
+			}
+		}
+		else if(mode == GL_QUADS)
+		{
+			if(cornerCount == 4)
+			{
+				triangles += 2;
+				cornerCount = 0;
+			}
+		}
+		else if(cornerCount == 3)
+		{
+			if(corners[0] != corners[1] && corners[1] != corners[2] && corners[0] != corners[2])
+				triangles++;
+			cornerCount = 0;
+		}
+	}
+
+	return triangles > 0 ? (float)misses / triangles : 0.0f;
+}
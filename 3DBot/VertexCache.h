@@ -0,0 +1,129 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	VertexCache.h
+//	Index orders for a (meshSize+1)*(meshSize+1) vertex grid and a FIFO model of the
+//	post-transform vertex cache to score them.
+//
+//	Row by row quads reuse only the vertex shared with the previous quad, since a
+//	whole grid row does not fit in the cache. The optimized orders walk the grid in
+//	column bands narrow enough that the previous row of the band is still cached, so
+//	each new row of quads costs about one miss per quad instead of two. Scored as
+//	ACMR, misses per triangle, that is about 0.5 + 0.5/bandWidth against 1.0.
+//
+//	Each band starts with degenerate triangles that load its top row on its own.
+//	Otherwise the first row loads both its rows at once, flushing the vertices the
+//	next row needs, and every row after it misses the same way.
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef VERTEXCACHE_H
+#define VERTEXCACHE_H
+
+// Conservative post-transform cache size, older GPUs and software rasterizers keep
+// 16 to 32 vertices
+static const int defaultVertexCacheSize = 16;
+
+// Widest band, in quads, whose previous row stays in a FIFO cache of cacheSize
+int GridBandWidth(int cacheSize);
+
+// Indices in draw order: mode is GL_QUADS, GL_TRIANGLES or GL_TRIANGLE_STRIP, strips
+// are separated by restartIndex. Returns misses per triangle, degenerate triangles
+// are not counted.
+float ComputeACMR(const unsigned int *indices, int count, GLenum mode, unsigned int restartIndex, int cacheSize);
+
+// Counterclockwise quad corners, row by row
+template <typename IndexType>
+void BuildGridQuads(IndexType *index, int meshSize)
+{
+	for(int j=0; j < meshSize; j++)
+	{
+		for(int k=0; k < meshSize; k++)
+		{
+			*index++ = (IndexType)(j*    (meshSize+1)+k);
+			*index++ = (IndexType)(j*    (meshSize+1)+k+1);
+			*index++ = (IndexType)((j+1)*(meshSize+1)+k+1);
+			*index++ = (IndexType)((j+1)*(meshSize+1)+k);
+		}
+	}
+}
+
+static inline int GridBands(int meshSize, int bandWidth)
+{
+	return (meshSize + bandWidth-1) / bandWidth;
+}
+
+// One strip per row of each band and one to load its top row, each followed by a
+// restart index
+static inline int GridStripIndexCount(int meshSize, int bandWidth)
+{
+	const int bands = GridBands(meshSize, bandWidth);
+	return (meshSize+1)*(2*(meshSize + bands) + bands) + meshSize*bands;
+}
+
+static inline int GridTriangleIndexCount(int meshSize)
+{
+	return 6*meshSize*meshSize + 3*meshSize;
+}
+
+// Quads are split along the diagonal from their second to their fourth corner, the
+// way Mesa splits GL_QUADS, so the optimized orders draw the same triangles.
+//
+// Strips zigzag between the upper and lower vertex of each column. The repeated first
+// vertex adds a degenerate triangle that puts the real ones on the odd positions,
+// where the zigzag gives that diagonal with counterclockwise winding.
+template <typename IndexType>
+IndexType *BuildGridStrips(IndexType *index, int meshSize, int bandWidth, IndexType restartIndex)
+{
+	for(int c0=0; c0 < meshSize; c0 += bandWidth)
+	{
+		const int c1 = c0+bandWidth < meshSize ? c0+bandWidth : meshSize;
+
+		// Every vertex twice, so all the triangles are degenerate
+		for(int k=c0; k <= c1; k++)
+		{
+			*index++ = (IndexType)k;
+			*index++ = (IndexType)k;
+		}
+		*index++ = restartIndex;
+
+		for(int j=0; j < meshSize; j++)
+		{
+			*index++ = (IndexType)(j*(meshSize+1)+c0);
+			for(int k=c0; k <= c1; k++)
+			{
+				*index++ = (IndexType)(j*    (meshSize+1)+k);
+				*index++ = (IndexType)((j+1)*(meshSize+1)+k);
+			}
+			*index++ = restartIndex;
+		}
+	}
+	return index;
+}
+
+// Same order as BuildGridStrips as a plain list, for contexts without primitive restart
+template <typename IndexType>
+IndexType *BuildGridTriangles(IndexType *index, int meshSize, int bandWidth)
+{
+	for(int c0=0; c0 < meshSize; c0 += bandWidth)
+	{
+		const int c1 = c0+bandWidth < meshSize ? c0+bandWidth : meshSize;
+		for(int k=c0; k < c1; k++)
+		{
+			*index++ = (IndexType)k; *index++ = (IndexType)k; *index++ = (IndexType)(k+1);
+		}
+
+		for(int j=0; j < meshSize; j++)
+		{
+			for(int k=c0; k < c1; k++)
+			{
+				const IndexType a = (IndexType)(j*    (meshSize+1)+k);
+				const IndexType b = (IndexType)(j*    (meshSize+1)+k+1);
+				const IndexType c = (IndexType)((j+1)*(meshSize+1)+k+1);
+				const IndexType d = (IndexType)((j+1)*(meshSize+1)+k);
+				*index++ = a; *index++ = b; *index++ = d;
+				*index++ = b; *index++ = c; *index++ = d;
+			}
+		}
+	}
+	return index;
+}
+
+#endif	//VERTEXCACHE_H
@@ -0,0 +1,194 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	CrowdBenchmark.cpp
+//	Frame time against robot count for RobotCrowd: the walk animation and world
+//	matrices for every part (update), and the part by part draw (draw, timed to
+//	glFinish). For comparison, replay is the single robot path run once per robot:
+//	pose the rig, submit each part to a RenderQueue and flush.
+//
+//	Opens a GLUT window for the GL context. With --no-draw only the update runs, and
+//	no window is needed.
+//
+//	Build: cmake -S . -B build && cmake --build build --target CrowdBenchmark
+//
+//	Usage: CrowdBenchmark [--no-draw] [robots ...]
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#define GL_SILENCE_DEPRECATION
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#include <OpenGL/glu.h>
+#include <GLUT/glut.h>
+#else
+#include <GL/gl.h>
+#include <GL/glu.h>
+#include <GL/glut.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <map>
+#include <vector>
+#include "VECTOR3D.h"
+#include "GeometryCache.h"
+#include "RenderQueue.h"
+#include "TransformGraph.h"
+#include "AnimationClip.h"
+#include "RobotRig.h"
+#include "JobSystem.h"
+#include "RobotCrowd.h"
+
+static const int frames = 5;
+static const float frameSeconds = 1.0f / 60.0f;
+
+typedef std::chrono::steady_clock Clock;
+
+static double Milliseconds(Clock::time_point start)
+{
+	std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+	return elapsed.count();
+}
+
+// Same materials and lights as Robot3D
+static GLfloat bodyAmbient[] = { 0.0f, 0.05f, 0.05f, 1.0f };
+static GLfloat bodySpecular[] = { 0.4f, 0.5f, 0.5f, 1.0f };
+static GLfloat bodyDiffuse[] = { 0.04f, 0.7f, 0.7f, 1.0f };
+static GLfloat rubberAmbient[] = { 0.02f, 0.02f, 0.02f, 1.0f };
+static GLfloat rubberSpecular[] = { 0.4f, 0.4f, 0.4f, 1.0f };
+static GLfloat rubberDiffuse[] = { 0.01f, 0.01f, 0.01f, 1.0f };
+static GLfloat chromeAmbient[] = { 0.25f, 0.25f, 0.25f, 1.0f };
+static GLfloat chromeSpecular[] = { 0.774597f, 0.774597f, 0.774597f, 1.0f };
+static GLfloat chromeDiffuse[] = { 0.4f, 0.4f, 0.4f, 1.0f };
+static GLfloat rubberShininess[] = { 10.0f };
+static GLfloat chromeShininess[] = { 76.8f };
+
+static void SetupView()
+{
+	GLfloat position0[] = { -4.0f, 8.0f, 8.0f, 1.0f };
+	GLfloat position1[] = { 4.0f, 8.0f, 8.0f, 1.0f };
+	GLfloat white[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glLightfv(GL_LIGHT0, GL_DIFFUSE, white);
+	glLightfv(GL_LIGHT1, GL_DIFFUSE, white);
+	glLightfv(GL_LIGHT0, GL_POSITION, position0);
+	glLightfv(GL_LIGHT1, GL_POSITION, position1);
+	glEnable(GL_LIGHTING);
+	glEnable(GL_LIGHT0);
+	glEnable(GL_LIGHT1);
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_NORMALIZE);
+
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	gluPerspective(60.0, 650.0 / 500.0, 0.2, 1000.0);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	gluLookAt(0.0, 120.0, 260.0, 0.0, -20.0, 0.0, 0.0, 1.0, 0.0);
+}
+
+int main(int argc, char **argv)
+{
+	bool draw = true;
+	std::vector<int> counts;
+	for(int i=1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--no-draw") == 0)
+			draw = false;
+		else
+			counts.push_back(atoi(argv[i]));
+	}
+	if(counts.empty())
+	{
+		const int defaults[] = { 1000, 2000, 5000, 10000, 20000, 50000 };
+		counts.assign(defaults, defaults + sizeof(defaults)/sizeof(defaults[0]));
+	}
+
+	if(draw)
+	{
+		glutInit(&argc, argv);
+		glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+		glutInitWindowSize(650, 500);
+		glutCreateWindow("CrowdBenchmark");
+		SetupView();
+	}
+
+	GeometryCache geometry;
+	RenderQueue queue;
+	const int bodyMaterial = queue.AddMaterial(bodyAmbient, bodySpecular, bodyDiffuse, rubberShininess);
+	const int rubberMaterial = queue.AddMaterial(rubberAmbient, rubberSpecular, rubberDiffuse, rubberShininess);
+	const int chromeMaterial = queue.AddMaterial(chromeAmbient, chromeSpecular, chromeDiffuse, chromeShininess);
+
+	float pose[numRobotJoints] = { 0.0f, 0.0f, 0.0f, -40.0f, -40.0f, 0.0f };
+	RobotRig rig;
+	rig.Build(&geometry, bodyMaterial, rubberMaterial, chromeMaterial, pose);
+
+	printf("%10s %12s %12s %12s %12s %12s %10s\n", "robots", "update ms", "draw ms", "frame ms", "replay ms", "draws", "MB");
+	for(size_t c=0; c < counts.size(); c++)
+	{
+		RobotCrowd crowd(&rig);
+		crowd.Spawn(counts[c], 24.0f);
+		crowd.UpdateTransforms();
+		if(draw)
+		{
+			// Warm up: buffer upload and first use of the matrices
+			crowd.Draw(&geometry, queue);
+			glFinish();
+		}
+
+		double update = 0.0, drawTime = 0.0, replay = 0.0;
+		for(int f=0; f < frames; f++)
+		{
+			Clock::time_point start = Clock::now();
+			crowd.Animate(frameSeconds);
+			crowd.UpdateTransforms();
+			update += Milliseconds(start);
+
+			if(draw)
+			{
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				start = Clock::now();
+				crowd.Draw(&geometry, queue);
+				glFinish();
+				drawTime += Milliseconds(start);
+				glutSwapBuffers();
+			}
+
+			// The same robots through the single robot path
+			start = Clock::now();
+			for(int r=0; r < crowd.GetNumRobots(); r++)
+			{
+				for(int j=0; j < numRobotJoints; j++)
+					pose[j] = crowd.GetAngles(j)[r];
+				rig.Pose(pose);
+
+				const Matrix4 *worlds = rig.GetGraph().GetWorlds();
+				for(int p=0; p < rig.GetNumParts(); p++)
+				{
+					const RigPart &part = rig.GetPart(p);
+					Matrix4 world = worlds[part.node];
+					world.m[12] += crowd.GetPositionX(r);
+					world.m[14] += crowd.GetPositionZ(r);
+					queue.Submit(part.material, part.primitive, world.m);
+				}
+			}
+			if(draw)
+			{
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				queue.Flush(&geometry);
+				glFinish();
+				glutSwapBuffers();
+			}
+			else
+			{
+				queue.Clear();
+			}
+			replay += Milliseconds(start);
+		}
+
+		printf("%10d %12.2f %12.2f %12.2f %12.2f %12d %10.1f\n", crowd.GetNumRobots(), update / frames,
+			drawTime / frames, (update + drawTime) / frames, replay / frames, crowd.GetDrawsIssued(),
+			crowd.GetMemory() / (1024.0 * 1024.0));
+	}
+
+	return 0;
+}
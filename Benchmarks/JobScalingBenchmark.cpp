@@ -0,0 +1,144 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	JobScalingBenchmark.cpp
+//	Time of RobotCrowd::Step (animation, culling and world matrices as dependent jobs)
+//	on a JobSystem of 1 to N threads. Speedup is against 1 thread, the serial column
+//	is Step without a JobSystem. No GL needed.
+//
+//	The camera looks straight down on the whole crowd, so every robot is posed. The
+//	crowd camera of Robot3D only sees a couple of thousand robots of a large crowd.
+//
+//	Build: cmake -S . -B build && cmake --build build --target JobScalingBenchmark
+//
+//	Usage: JobScalingBenchmark [--threads N] [robots ...]
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#define GL_SILENCE_DEPRECATION
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#include <GLUT/glut.h>
+#else
+#include <GL/gl.h>
+#include <GL/glut.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <map>
+#include <vector>
+#include "VECTOR3D.h"
+#include "GeometryCache.h"
+#include "RenderQueue.h"
+#include "TransformGraph.h"
+#include "AnimationClip.h"
+#include "RobotRig.h"
+#include "JobSystem.h"
+#include "RobotCrowd.h"
+
+static const int frames = 20;
+static const float spacing = 24.0f;
+static const float frameSeconds = 1.0f / 60.0f;
+
+typedef std::chrono::steady_clock Clock;
+
+static double Milliseconds(Clock::time_point start)
+{
+	std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+	return elapsed.count();
+}
+
+// gluPerspective and gluLookAt, without a GL context
+static Matrix4 Perspective(float fovy, float aspect, float zNear, float zFar)
+{
+	const float f = 1.0f / tanf(0.5f*fovy*(float)M_PI/180.0f);
+	Matrix4 m;
+	m.m[0] = f / aspect;
+	m.m[5] = f;
+	m.m[10] = (zFar + zNear) / (zNear - zFar);
+	m.m[11] = -1.0f;
+	m.m[14] = 2.0f*zFar*zNear / (zNear - zFar);
+	m.m[15] = 0.0f;
+	return m;
+}
+
+static Matrix4 LookAt(VECTOR3D eye, VECTOR3D center, VECTOR3D up)
+{
+	VECTOR3D f = center - eye;
+	f.Normalize();
+	VECTOR3D s = f.CrossProduct(up);
+	s.Normalize();
+	VECTOR3D u = s.CrossProduct(f);
+
+	Matrix4 m;
+	m.m[0] = s.x; m.m[4] = s.y; m.m[8] = s.z;
+	m.m[1] = u.x; m.m[5] = u.y; m.m[9] = u.z;
+	m.m[2] = -f.x; m.m[6] = -f.y; m.m[10] = -f.z;
+	m.Translate(-eye.x, -eye.y, -eye.z);
+	return m;
+}
+
+static double TimeSteps(RobotCrowd &crowd, const Matrix4 &viewProjection, JobSystem *jobs)
+{
+	// One untimed frame, so the per-thread scratch is allocated
+	crowd.Step(frameSeconds, viewProjection, jobs);
+
+	Clock::time_point start = Clock::now();
+	for(int f=0; f < frames; f++)
+		crowd.Step(frameSeconds, viewProjection, jobs);
+	return Milliseconds(start) / frames;
+}
+
+int main(int argc, char **argv)
+{
+	int maxThreads = (int)std::thread::hardware_concurrency();
+	std::vector<int> counts;
+	for(int i=1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--threads") == 0 && i+1 < argc)
+			maxThreads = atoi(argv[++i]);
+		else
+			counts.push_back(atoi(argv[i]));
+	}
+	if(maxThreads < 1)
+		maxThreads = 1;
+	if(counts.empty())
+	{
+		counts.push_back(10000);
+		counts.push_back(50000);
+	}
+
+	// Only handles are needed, nothing is uploaded or drawn
+	GeometryCache geometry;
+	float pose[numRobotJoints] = { 0.0f, 0.0f, 0.0f, -40.0f, -40.0f, 0.0f };
+	RobotRig rig;
+	rig.Build(&geometry, 0, 1, 2, pose);
+
+	printf("%10s %8s %10s %12s %12s %10s\n", "robots", "visible", "threads", "step ms", "serial ms", "speedup");
+	for(size_t c=0; c < counts.size(); c++)
+	{
+		RobotCrowd crowd(&rig);
+		crowd.Spawn(counts[c], spacing);
+
+		// High enough for the 60 degree field of view to take in the whole grid
+		const float halfExtent = 0.5f*ceilf(sqrtf((float)counts[c]))*spacing + spacing;
+		const float height = 1.8f*halfExtent;
+		const Matrix4 viewProjection = Perspective(60.0f, 650.0f / 500.0f, 1.0f, height + 100.0f) *
+			LookAt(VECTOR3D(0.0f, height, 0.0f), VECTOR3D(0.0f, 0.0f, 0.0f), VECTOR3D(0.0f, 0.0f, -1.0f));
+		const double serial = TimeSteps(crowd, viewProjection, NULL);
+
+		double single = 0.0;
+		for(int threads=1; threads <= maxThreads; threads++)
+		{
+			JobSystem jobs(threads);
+			const double elapsed = TimeSteps(crowd, viewProjection, &jobs);
+			if(threads == 1)
+				single = elapsed;
+
+			printf("%10d %8d %10d %12.2f %12.2f %10.2f\n", crowd.GetNumRobots(), crowd.GetNumVisible(), threads,
+				elapsed, serial, single / elapsed);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,443 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	MicroBenchmarks.cpp
+//	Times the mesh, vector math and draw submission hot paths and writes the results as
+//	JSON, so runs of two commits on the same machine can be compared entry by entry:
+//
+//	-	QuadMesh::InitMesh and QuadMesh::ComputeNormals, on a JobSystem with a thread per
+//		core, for each mesh size,
+//	-	VECTOR3D CrossProduct, Normalize, lerp and QuadraticInterpolate over arrays of
+//		vectors too large for the L1 cache, and next to them the same work through the
+//		operators and through MulAdd, LerpInto and NormalizeArray, and array copies,
+//	-	the VectorMath batches, points by one matrix and matrices pairwise, next to
+//		Matrix4::SetProduct,
+//	-	the walk clip's four curves sampled for a crowd of robots playing forward with
+//		cursors, and the same samples found without them,
+//	-	two-bone IK for the same crowd, solved back onto the ends of its walking legs,
+//		and PlantLeftFeet sampling a bumpy ground mesh under each foot before solving,
+//	-	QuadMesh::DrawMesh into a headless context for each mesh size, as the time for
+//		the call to return and the time until glFinish does. Skipped where there is no
+//		EGL.
+//
+//	Mesh sizes go from 16 to 4096 quads per side by factors of 4. Each entry is run
+//	until repetitions runs and at least minSeconds have passed, and the minimum, median
+//	and mean times are kept along with the median per item (vertex, quad or vector).
+//
+//	Build: cmake -S . -B build && cmake --build build --target MicroBenchmarks
+//
+//	Usage: MicroBenchmarks [--sizes 16,64,...] [--repetitions N] [--label text] [--output file]
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#define GL_SILENCE_DEPRECATION
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#include <GLUT/glut.h>
+#else
+#include <GL/gl.h>
+#include <GL/glut.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include "VECTOR3D.h"
+#include "GeometryCache.h"
+#include "TransformGraph.h"
+#include "VectorMath.h"
+#include "AnimationClip.h"
+#include "TwoBoneIK.h"
+#include "RobotRig.h"
+#include "MeshKernels.h"
+#include "JobSystem.h"
+#include "QuadMesh.h"
+#include "Headless.h"
+
+static const double minSeconds = 0.2;
+static const int vectorCount = 1 << 18;
+static const int matrixCount = 1 << 14;
+static const int robotCount = 1 << 14;
+
+struct BenchmarkResult
+{
+	std::string name;
+	int meshSize;
+	long long items;
+	int repetitions;
+	double minNs;
+	double medianNs;
+	double meanNs;
+};
+
+static std::vector<BenchmarkResult> results;
+static int repetitions = 5;
+
+// Runs body until there are repetitions samples and minSeconds have passed. setup, if
+// any, runs untimed before each sample.
+static void Measure(const std::string &name, int meshSize, long long items, const std::function<void()> &body,
+	const std::function<void()> &setup = std::function<void()>())
+{
+	typedef std::chrono::steady_clock Clock;
+	std::vector<double> samples;
+	std::chrono::duration<double> total(0.0);
+	while((int)samples.size() < repetitions || total.count() < minSeconds)
+	{
+		if(setup)
+			setup();
+		const Clock::time_point start = Clock::now();
+		body();
+		const std::chrono::duration<double> elapsed = Clock::now() - start;
+		samples.push_back(elapsed.count() * 1.0e9);
+		total += elapsed;
+	}
+
+	std::sort(samples.begin(), samples.end());
+	BenchmarkResult result;
+	result.name = name;
+	result.meshSize = meshSize;
+	result.items = items;
+	result.repetitions = (int)samples.size();
+	result.minNs = samples[0];
+	result.medianNs = samples[samples.size() / 2];
+	result.meanNs = 0.0;
+	for(size_t i=0; i < samples.size(); i++)
+		result.meanNs += samples[i];
+	result.meanNs /= samples.size();
+	results.push_back(result);
+
+	fprintf(stderr, "%-36s %6d %12.0f ns %9.3f ns/item\n", name.c_str(), meshSize, result.medianNs,
+		result.medianNs / items);
+}
+
+// Keeps results from being optimized away
+static volatile float sink;
+
+static void BenchmarkVectors()
+{
+	std::vector<VECTOR3D> a(vectorCount), b(vectorCount), c(vectorCount), out(vectorCount);
+	srand(1);
+	for(int i=0; i < vectorCount; i++)
+	{
+		a[i].Set(rand() / (float)RAND_MAX - 0.5f, rand() / (float)RAND_MAX - 0.5f, rand() / (float)RAND_MAX - 0.5f);
+		b[i].Set(rand() / (float)RAND_MAX - 0.5f, rand() / (float)RAND_MAX - 0.5f, rand() / (float)RAND_MAX - 0.5f);
+		c[i].Set(rand() / (float)RAND_MAX - 0.5f, rand() / (float)RAND_MAX - 0.5f, rand() / (float)RAND_MAX - 0.5f);
+	}
+
+	Measure("VECTOR3D::CrossProduct", 0, vectorCount, [&]()
+	{
+		for(int i=0; i < vectorCount; i++)
+			out[i] = a[i].CrossProduct(b[i]);
+		sink = out[vectorCount/2].x;
+	});
+	Measure("VECTOR3D::Normalize", 0, vectorCount, [&]()
+	{
+		for(int i=0; i < vectorCount; i++)
+			out[i].Normalize();
+		sink = out[vectorCount/2].x;
+	}, [&]()
+	{
+		out = a;
+	});
+	Measure("NormalizeArray", 0, vectorCount, [&]()
+	{
+		NormalizeArray(&out[0], vectorCount);
+		sink = out[vectorCount/2].x;
+	}, [&]()
+	{
+		out = a;
+	});
+	Measure("VECTOR3D copy", 0, vectorCount, [&]()
+	{
+		std::copy(a.begin(), a.end(), out.begin());
+		sink = out[vectorCount/2].x;
+	});
+	Measure("VECTOR3D operator+ operator*", 0, vectorCount, [&]()
+	{
+		for(int i=0; i < vectorCount; i++)
+			out[i] = out[i] + a[i]*0.5f;
+		sink = out[vectorCount/2].x;
+	}, [&]()
+	{
+		out = b;
+	});
+	Measure("VECTOR3D::MulAdd", 0, vectorCount, [&]()
+	{
+		for(int i=0; i < vectorCount; i++)
+			out[i].MulAdd(a[i], 0.5f);
+		sink = out[vectorCount/2].x;
+	}, [&]()
+	{
+		out = b;
+	});
+	Measure("VECTOR3D::lerp", 0, vectorCount, [&]()
+	{
+		for(int i=0; i < vectorCount; i++)
+			out[i] = a[i].lerp(b[i], (i & 255) / 255.0f);
+		sink = out[vectorCount/2].x;
+	});
+	Measure("VECTOR3D::LerpInto", 0, vectorCount, [&]()
+	{
+		for(int i=0; i < vectorCount; i++)
+			a[i].LerpInto(b[i], (i & 255) / 255.0f, out[i]);
+		sink = out[vectorCount/2].x;
+	});
+	Measure("VECTOR3D::QuadraticInterpolate", 0, vectorCount, [&]()
+	{
+		for(int i=0; i < vectorCount; i++)
+			out[i] = a[i].QuadraticInterpolate(b[i], c[i], (i & 255) / 255.0f);
+		sink = out[vectorCount/2].x;
+	});
+}
+
+static void BenchmarkBatches()
+{
+	std::vector<float> x(vectorCount), y(vectorCount), z(vectorCount);
+	std::vector<float> outX(vectorCount), outY(vectorCount), outZ(vectorCount);
+	for(int i=0; i < vectorCount; i++)
+	{
+		x[i] = (float)(i % 101);
+		y[i] = (float)(i % 37);
+		z[i] = (float)(i % 53);
+	}
+	Matrix4 transform;
+	transform.Translate(1.0f, 2.0f, 3.0f).Rotate(30.0f, 0.0f, 1.0f, 0.0f);
+	const Mat4 m(transform.m);
+	Measure("TransformPoints SoA", 0, vectorCount, [&]()
+	{
+		TransformPoints(m, &x[0], &y[0], &z[0], &outX[0], &outY[0], &outZ[0], vectorCount);
+		sink = outX[vectorCount/2];
+	});
+
+	std::vector<Matrix4> a(matrixCount), b(matrixCount), product(matrixCount);
+	for(int i=0; i < matrixCount; i++)
+	{
+		a[i].Rotate((float)(i % 360), 0.0f, 1.0f, 0.0f).Translate(0.0f, (float)i, 0.0f);
+		b[i].Rotate((float)(i % 90), 1.0f, 0.0f, 0.0f);
+	}
+	Measure("Matrix4::SetProduct", 0, matrixCount, [&]()
+	{
+		for(int i=0; i < matrixCount; i++)
+			product[i].SetProduct(a[i], b[i]);
+		sink = product[matrixCount/2].m[12];
+	});
+
+	std::vector<Mat4> a4(matrixCount), b4(matrixCount), product4(matrixCount);
+	for(int i=0; i < matrixCount; i++)
+	{
+		a4[i] = Mat4(a[i].m);
+		b4[i] = Mat4(b[i].m);
+	}
+	Measure("MultiplyMatrices", 0, matrixCount, [&]()
+	{
+		MultiplyMatrices(&a4[0], &b4[0], &product4[0], matrixCount);
+		sink = product4[matrixCount/2].m[12];
+	});
+}
+
+// A frame of a crowd: every robot 16 ms on, each at its own point in the cycle
+static void BenchmarkClips()
+{
+	const AnimationClip walk = MakeWalkClip();
+	std::vector<float> times(robotCount), angles(robotCount);
+	std::vector<unsigned char> cursors((size_t)numRobotJoints*robotCount, 0);
+	for(int i=0; i < robotCount; i++)
+		times[i] = fmodf(i*0.618034f, 1.0f)*walk.GetDuration();
+
+	Measure("AnimationClip::SampleCurve", 0, robotCount, [&]()
+	{
+		for(int i=0; i < robotCount; i++)
+			times[i] = walk.WrapTime(times[i] + 0.016f);
+		for(int j=0; j < numRobotJoints; j++)
+			walk.SampleCurve(j, &times[0], &cursors[(size_t)j*robotCount], &angles[0], robotCount);
+		sink = angles[robotCount/2];
+	});
+	Measure("AnimationClip::Sample no cursor", 0, robotCount, [&]()
+	{
+		for(int i=0; i < robotCount; i++)
+			times[i] = walk.WrapTime(times[i] + 0.016f);
+		for(int j=0; j < numRobotJoints; j++)
+		{
+			if(!walk.HasCurve(j))
+				continue;
+			for(int i=0; i < robotCount; i++)
+				angles[i] = walk.Sample(j, times[i]);
+		}
+		sink = angles[robotCount/2];
+	});
+}
+
+// The crowd's left legs mid-walk, scattered over a 32 x 32 mesh with bumps under most
+// of their feet
+static void BenchmarkIK()
+{
+	const AnimationClip walk = MakeWalkClip();
+	const TwoBoneChain leg = { { -2.7f, -4.2f }, { -2.3f, -2.8f }, { -12.6f, 2.0f }, -1.0f };
+	std::vector<float> hip(robotCount), knee(robotCount), solvedHip(robotCount), solvedKnee(robotCount);
+	std::vector<float> footY(robotCount), footZ(robotCount);
+	std::vector<float> positionX(robotCount), positionZ(robotCount), heading(robotCount);
+	for(int i=0; i < robotCount; i++)
+	{
+		const float time = fmodf(i*0.618034f, 1.0f)*walk.GetDuration();
+		hip[i] = walk.Sample(jointHip, time);
+		knee[i] = walk.Sample(jointKnee, time);
+		positionX[i] = fmodf(i*0.618034f, 1.0f)*28.0f - 14.0f;
+		positionZ[i] = fmodf(i*0.414214f, 1.0f)*28.0f - 14.0f;
+		heading[i] = fmodf(i*137.507764f, 360.0f);
+	}
+	TwoBoneEnd(leg, &hip[0], &knee[0], &footY[0], &footZ[0], robotCount);
+
+	Measure("SolveTwoBone", 0, robotCount, [&]()
+	{
+		SolveTwoBone(leg, &footY[0], &footZ[0], &solvedHip[0], &solvedKnee[0], robotCount);
+		sink = solvedKnee[robotCount/2];
+	});
+
+	QuadMesh ground(64, 32.0f);
+	ground.InitMesh(64, VECTOR3D(-16.0f, 0.0f, 16.0f), 32.0, 32.0, VECTOR3D(1.0f, 0.0f, 0.0f), VECTOR3D(0.0f, 0.0f, -1.0f));
+	for(int b=0; b < 64; b++)
+	{
+		VECTOR3D center(-16.0f + (b*7 % 32), 0.0f, 16.0f - (b*13 % 32));
+		ground.ApplyBrush(center, 2.0f + b % 5, (b % 3 - 1)*1.5f + 0.5f);
+	}
+	Measure("PlantLeftFeet", 0, robotCount, [&]()
+	{
+		PlantLeftFeet(ground, &positionX[0], &positionZ[0], &heading[0], &solvedHip[0], &solvedKnee[0], robotCount);
+		sink = solvedKnee[robotCount/2];
+	}, [&]()
+	{
+		solvedHip = hip;
+		solvedKnee = knee;
+	});
+}
+
+static void BenchmarkMesh(int meshSize, bool draw)
+{
+	const VECTOR3D origin(-16.0f, 0.0f, 16.0f);
+	const VECTOR3D dir1v(1.0f, 0.0f, 0.0f);
+	const VECTOR3D dir2v(0.0f, 0.0f, -1.0f);
+	const long long vertices = (long long)(meshSize+1)*(meshSize+1);
+	const long long quads = (long long)meshSize*meshSize;
+
+	// ComputeNormals splits its rows over a thread per core
+	static JobSystem jobs;
+	QuadMesh mesh(meshSize, 32.0f);
+	mesh.SetJobSystem(&jobs);
+	Measure("QuadMesh::InitMesh", meshSize, vertices, [&]()
+	{
+		mesh.InitMesh(meshSize, origin, 32.0, 32.0, dir1v, dir2v);
+	});
+
+	// Bumpy ground so the normals are not all straight up
+	for(int b=0; b < 64; b++)
+	{
+		VECTOR3D center(-16.0f + (b*7 % 32), 0.0f, 16.0f - (b*13 % 32));
+		mesh.ApplyBrush(center, 2.0f + b % 5, (b % 3 - 1)*1.5f);
+	}
+	Measure("QuadMesh::ComputeNormals", meshSize, vertices, [&]()
+	{
+		mesh.ComputeNormals();
+	});
+
+	if(!draw)
+		return;
+
+	// The first draw uploads the buffers and builds the ordered indices
+	mesh.DrawMesh(meshSize);
+	glFinish();
+	Measure("QuadMesh::DrawMesh submit", meshSize, quads, [&]()
+	{
+		mesh.DrawMesh(meshSize);
+	}, [&]()
+	{
+		glFinish();
+	});
+	Measure("QuadMesh::DrawMesh finish", meshSize, quads, [&]()
+	{
+		mesh.DrawMesh(meshSize);
+		glFinish();
+	});
+}
+
+static bool WriteJSON(FILE *file, const char *label)
+{
+	fprintf(file, "{\n\t\"suite\": \"MicroBenchmarks\",\n\t\"label\": \"%s\",\n", label);
+	fprintf(file, "\t\"meshKernels\": \"%s\",\n\t\"results\": [\n", SelectMeshKernels()->name);
+	for(size_t i=0; i < results.size(); i++)
+	{
+		const BenchmarkResult &r = results[i];
+		fprintf(file, "\t\t{\"name\": \"%s\", \"meshSize\": %d, \"items\": %lld, \"repetitions\": %d, "
+			"\"minNs\": %.0f, \"medianNs\": %.0f, \"meanNs\": %.0f, \"nsPerItem\": %.4f}%s\n", r.name.c_str(),
+			r.meshSize, r.items, r.repetitions, r.minNs, r.medianNs, r.meanNs, r.medianNs / r.items,
+			i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "\t]\n}\n");
+	return !ferror(file);
+}
+
+int main(int argc, char **argv)
+{
+	std::vector<int> sizes;
+	const char *label = "";
+	const char *output = NULL;
+	for(int i=1; i < argc; i++)
+	{
+		const bool hasValue = i + 1 < argc;
+		if(strcmp(argv[i], "--sizes") == 0 && hasValue)
+		{
+			for(char *size = strtok(argv[++i], ","); size; size = strtok(NULL, ","))
+				sizes.push_back(atoi(size));
+		}
+		else if(strcmp(argv[i], "--repetitions") == 0 && hasValue)
+			repetitions = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--label") == 0 && hasValue)
+			label = argv[++i];
+		else if(strcmp(argv[i], "--output") == 0 && hasValue)
+			output = argv[++i];
+		else
+		{
+			fprintf(stderr, "Usage: %s [--sizes 16,64,...] [--repetitions N] [--label text] [--output file]\n", argv[0]);
+			return 1;
+		}
+	}
+	if(sizes.empty())
+	{
+		for(int size=16; size <= 4096; size *= 4)
+			sizes.push_back(size);
+	}
+	if(repetitions < 1)
+		repetitions = 1;
+
+	BenchmarkVectors();
+	BenchmarkBatches();
+	BenchmarkClips();
+	BenchmarkIK();
+
+	HeadlessContext context;
+	const bool draw = context.Create(256, 256);
+	if(draw)
+	{
+		// Looking down on the meshes, which all cover the same 32 x 32 square
+		glMatrixMode(GL_PROJECTION);
+		glOrtho(-16.0, 16.0, -16.0, 16.0, -64.0, 64.0);
+		glMatrixMode(GL_MODELVIEW);
+		glRotatef(90.0, 1.0, 0.0, 0.0);
+		glEnable(GL_DEPTH_TEST);
+		glEnable(GL_LIGHTING);
+		glEnable(GL_LIGHT0);
+	}
+	for(size_t s=0; s < sizes.size(); s++)
+		BenchmarkMesh(sizes[s], draw);
+
+	FILE *file = output ? fopen(output, "w") : stdout;
+	if(!file || !WriteJSON(file, label))
+	{
+		fprintf(stderr, "Cannot write %s\n", output ? output : "results");
+		return 1;
+	}
+	if(output)
+		fclose(file);
+	return 0;
+}
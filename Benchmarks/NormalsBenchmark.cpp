@@ -0,0 +1,118 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	NormalsBenchmark.cpp
+//	Times QuadMesh::ComputeNormals with the scalar reference kernels against the SIMD
+//	kernels picked for this CPU, on one thread and on N threads, and reports how far
+//	the SIMD normals are from the reference. The last column is the cost of one
+//	crater (ApplyBrush plus the incremental UpdateMesh) for comparison.
+//
+//	Build: cmake -S . -B build && cmake --build build --target NormalsBenchmark
+//
+//	Usage: NormalsBenchmark [threads] [meshSize ...]
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#define GL_SILENCE_DEPRECATION
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#include <GLUT/glut.h>
+#else
+#include <GL/gl.h>
+#include <GL/glut.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "VECTOR3D.h"
+#include "MeshKernels.h"
+#include "JobSystem.h"
+#include "QuadMesh.h"
+
+static const int repetitions = 5;
+
+// Best of a few runs, in milliseconds
+static double TimeComputeNormals(QuadMesh &mesh, const MeshKernels *kernels, JobSystem *jobs)
+{
+	double best = 1e30;
+	mesh.SetKernels(kernels);
+	mesh.SetJobSystem(jobs);
+	for(int r=0; r < repetitions; r++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		mesh.ComputeNormals();
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		if(elapsed.count() < best)
+			best = elapsed.count();
+	}
+	return best;
+}
+
+int main(int argc, char **argv)
+{
+	int threads = argc > 1 ? atoi(argv[1]) : (int)std::thread::hardware_concurrency();
+	if(threads < 1)
+		threads = 1;
+
+	std::vector<int> sizes;
+	for(int i=2; i < argc; i++)
+		sizes.push_back(atoi(argv[i]));
+	if(sizes.empty())
+	{
+		sizes.push_back(256);
+		sizes.push_back(1024);
+		sizes.push_back(2048);
+	}
+
+	VECTOR3D origin(-16.0f, 0.0f, 16.0f);
+	VECTOR3D dir1v(1.0f, 0.0f, 0.0f);
+	VECTOR3D dir2v(0.0f, 0.0f, -1.0f);
+
+	JobSystem jobs(threads);
+	const MeshKernels *scalar = FindMeshKernels("scalar");
+	const MeshKernels *simd = SelectMeshKernels();
+
+	printf("%10s %12s %12s %12s %12s %9s %9s %10s %10s\n", "meshSize", "vertices", "scalar ms", "simd ms",
+		"simd N ms", "simd", "threads", "max error", "crater ms");
+	for(size_t s=0; s < sizes.size(); s++)
+	{
+		int meshSize = sizes[s];
+		QuadMesh mesh(meshSize, 32.0f);
+		mesh.InitMesh(meshSize, origin, 32.0, 32.0, dir1v, dir2v);
+
+		// Bumpy ground so the normals are not all straight up
+		for(int b=0; b < 64; b++)
+		{
+			VECTOR3D center(-16.0f + (b*7 % 32), 0.0f, 16.0f - (b*13 % 32));
+			mesh.ApplyBrush(center, 2.0f + b % 5, (b % 3 - 1)*1.5f);
+		}
+
+		double reference = TimeComputeNormals(mesh, scalar, NULL);
+		std::vector<MeshVertex> expected(mesh.GetVertices(), mesh.GetVertices() + mesh.GetNumVertices());
+
+		double single = TimeComputeNormals(mesh, simd, NULL);
+		double parallel = TimeComputeNormals(mesh, simd, &jobs);
+
+		// Reciprocal square root normalization is not bit exact
+		float maxError = 0.0f;
+		for(size_t i=0; i < expected.size(); i++)
+		{
+			float error = (expected[i].normal - mesh.GetVertices()[i].normal).GetLength();
+			if(error > maxError)
+				maxError = error;
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		mesh.ApplyBrush(VECTOR3D(0.0f, 0.0f, 0.0f), 1.0f, -1.0f);
+		mesh.UpdateMesh();
+		std::chrono::duration<double, std::milli> crater = std::chrono::steady_clock::now() - start;
+
+		printf("%10d %12d %12.3f %12.3f %12.3f %8.2fx %8.2fx %10.2e %10.3f\n", meshSize, mesh.GetNumVertices(),
+			reference, single, parallel, reference / single, single / parallel, maxError, crater.count());
+	}
+	printf("simd = %s, N = %d threads\n", simd->name, threads);
+
+	return 0;
+}
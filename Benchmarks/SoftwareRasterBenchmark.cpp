@@ -0,0 +1,288 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	SoftwareRasterBenchmark.cpp
+//	The single robot on the ground patch, as Robot3D draws it, through GL (an EGL
+//	surfaceless context, llvmpipe on machines without a GPU) and through
+//	SoftwareRenderer on 1 to N threads, with and without SSE. Both are timed to a
+//	frame in memory: GL includes glReadPixels. The robot turns a degree per frame.
+//
+//	diff is the mean absolute difference per channel from the GL frame, and the share
+//	of pixels where some channel differs by more than 16.
+//
+//	Build: cmake -S . -B build && cmake --build build --target SoftwareRasterBenchmark
+//
+//	Usage: SoftwareRasterBenchmark [--threads N] [--frames N] [--write prefix] [WxH ...]
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#define GL_SILENCE_DEPRECATION
+#include <GL/gl.h>
+#include <GL/glu.h>
+#include <GL/glut.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <map>
+#include <thread>
+#include <vector>
+#include "VECTOR3D.h"
+#include "QuadMesh.h"
+#include "GeometryCache.h"
+#include "RenderQueue.h"
+#include "TransformGraph.h"
+#include "AnimationClip.h"
+#include "RobotRig.h"
+#include "JobSystem.h"
+#include "Headless.h"
+#include "SoftwareRenderer.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double Milliseconds(Clock::time_point start)
+{
+	std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+	return elapsed.count();
+}
+
+// Same materials and lights as Robot3D
+static GLfloat bodyAmbient[] = { 0.0f, 0.05f, 0.05f, 1.0f };
+static GLfloat bodySpecular[] = { 0.4f, 0.5f, 0.5f, 1.0f };
+static GLfloat bodyDiffuse[] = { 0.04f, 0.7f, 0.7f, 1.0f };
+static GLfloat rubberAmbient[] = { 0.02f, 0.02f, 0.02f, 1.0f };
+static GLfloat rubberSpecular[] = { 0.4f, 0.4f, 0.4f, 1.0f };
+static GLfloat rubberDiffuse[] = { 0.01f, 0.01f, 0.01f, 1.0f };
+static GLfloat chromeAmbient[] = { 0.25f, 0.25f, 0.25f, 1.0f };
+static GLfloat chromeSpecular[] = { 0.774597f, 0.774597f, 0.774597f, 1.0f };
+static GLfloat chromeDiffuse[] = { 0.4f, 0.4f, 0.4f, 1.0f };
+static GLfloat rubberShininess[] = { 10.0f };
+static GLfloat chromeShininess[] = { 76.8f };
+static GLfloat lightPosition0[] = { -4.0f, 8.0f, 8.0f, 1.0f };
+static GLfloat lightPosition1[] = { 4.0f, 8.0f, 8.0f, 1.0f };
+static GLfloat lightAmbient[] = { 0.2f, 0.2f, 0.2f, 1.0f };
+static GLfloat white[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+struct Scene
+{
+	GeometryCache geometry;
+	RenderQueue queue;
+	RobotRig rig;
+	QuadMesh *ground;
+	float pose[numRobotJoints];
+	Matrix4 projection;
+	Matrix4 view;
+};
+
+static void SetupScene(Scene &scene, int width, int height)
+{
+	glLightfv(GL_LIGHT0, GL_AMBIENT, lightAmbient);
+	glLightfv(GL_LIGHT0, GL_DIFFUSE, white);
+	glLightfv(GL_LIGHT0, GL_SPECULAR, white);
+	glLightfv(GL_LIGHT1, GL_AMBIENT, lightAmbient);
+	glLightfv(GL_LIGHT1, GL_DIFFUSE, white);
+	glLightfv(GL_LIGHT1, GL_SPECULAR, white);
+	glLightfv(GL_LIGHT0, GL_POSITION, lightPosition0);
+	glLightfv(GL_LIGHT1, GL_POSITION, lightPosition1);
+	glEnable(GL_LIGHTING);
+	glEnable(GL_LIGHT0);
+	glEnable(GL_LIGHT1);
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_NORMALIZE);
+	glShadeModel(GL_SMOOTH);
+	glClearColor(0.4f, 0.4f, 0.4f, 0.0f);
+
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	gluPerspective(60.0, (GLdouble)width / height, 0.2, 40.0);
+	glGetFloatv(GL_PROJECTION_MATRIX, scene.projection.m);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	gluLookAt(0.0, 6.0, 26.0, 0.0, -3.0, 0.0, 0.0, 1.0, 0.0);
+	glGetFloatv(GL_MODELVIEW_MATRIX, scene.view.m);
+
+	scene.ground = new QuadMesh(16, 32.0);
+	scene.ground->InitMesh(16, VECTOR3D(-16.0f, 0.0f, 16.0f), 32.0, 32.0, VECTOR3D(1.0f, 0.0f, 0.0f), VECTOR3D(0.0f, 0.0f, -1.0f));
+	scene.ground->SetMaterial(VECTOR3D(0.0f, 0.05f, 0.0f), VECTOR3D(0.4f, 0.8f, 0.4f), VECTOR3D(0.04f, 0.04f, 0.04f), 0.2);
+
+	const int body = scene.queue.AddMaterial(bodyAmbient, bodySpecular, bodyDiffuse, rubberShininess);
+	const int rubber = scene.queue.AddMaterial(rubberAmbient, rubberSpecular, rubberDiffuse, rubberShininess);
+	const int chrome = scene.queue.AddMaterial(chromeAmbient, chromeSpecular, chromeDiffuse, chromeShininess);
+
+	const float pose[numRobotJoints] = { 30.0f, 0.0f, 20.0f, -30.0f, -40.0f, 0.0f };
+	memcpy(scene.pose, pose, sizeof(pose));
+	scene.rig.Build(&scene.geometry, body, rubber, chrome, scene.pose);
+}
+
+static void NextPose(Scene &scene)
+{
+	scene.pose[jointSpin] += 1.0f;
+	scene.rig.Pose(scene.pose);
+}
+
+static void DrawGL(Scene &scene, HeadlessContext &context)
+{
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glLoadMatrixf(scene.view.m);
+
+	const Matrix4 *worlds = scene.rig.GetGraph().GetWorlds();
+	for(int i=0; i < scene.rig.GetNumParts(); i++)
+	{
+		const RigPart &part = scene.rig.GetPart(i);
+		scene.queue.Submit(part.material, part.primitive, worlds[part.node].m);
+	}
+	scene.queue.Flush(&scene.geometry);
+
+	glPushMatrix();
+	glTranslatef(0.0f, -20.0f, 0.0f);
+	scene.ground->DrawMesh(16);
+	glPopMatrix();
+	context.ReadPixels();
+}
+
+static void DrawSoftware(Scene &scene, SoftwareRenderer &renderer, int groundMaterial)
+{
+	renderer.Begin(scene.projection, scene.view);
+	const Matrix4 *worlds = scene.rig.GetGraph().GetWorlds();
+	for(int i=0; i < scene.rig.GetNumParts(); i++)
+	{
+		const RigPart &part = scene.rig.GetPart(i);
+		renderer.DrawPrimitive(scene.geometry, part.primitive, worlds[part.node], part.material);
+	}
+
+	Matrix4 ground;
+	ground.Translate(0.0f, -20.0f, 0.0f);
+	renderer.DrawMesh(*scene.ground, ground, groundMaterial);
+	renderer.Render();
+}
+
+static void Difference(const std::vector<unsigned char> &a, const unsigned char *b, double &mean, double &share)
+{
+	double total = 0.0;
+	int differing = 0;
+	for(size_t p=0; p < a.size(); p += 3)
+	{
+		int largest = 0;
+		for(int c=0; c < 3; c++)
+		{
+			const int d = abs((int)a[p+c] - (int)b[p+c]);
+			total += d;
+			largest = largest > d ? largest : d;
+		}
+		differing += largest > 16;
+	}
+	mean = total / a.size();
+	share = 100.0 * differing / (a.size() / 3);
+}
+
+int main(int argc, char **argv)
+{
+	int maxThreads = (int)std::thread::hardware_concurrency();
+	int frames = 30;
+	const char *writePrefix = NULL;
+	std::vector<std::pair<int, int> > sizes;
+	for(int i=1; i < argc; i++)
+	{
+		int w, h;
+		if(strcmp(argv[i], "--threads") == 0 && i+1 < argc)
+			maxThreads = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--frames") == 0 && i+1 < argc)
+			frames = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--write") == 0 && i+1 < argc)
+			writePrefix = argv[++i];
+		else if(sscanf(argv[i], "%dx%d", &w, &h) == 2)
+			sizes.push_back(std::make_pair(w, h));
+	}
+	if(maxThreads < 1)
+		maxThreads = 1;
+	if(frames < 1)
+		frames = 1;
+	if(sizes.empty())
+	{
+		sizes.push_back(std::make_pair(650, 500));
+		sizes.push_back(std::make_pair(1920, 1080));
+	}
+
+	printf("%11s %10s %8s %6s %12s %10s %10s %10s\n", "size", "backend", "threads", "simd", "ms/frame", "frames/s", "diff", "diff %");
+	for(size_t s=0; s < sizes.size(); s++)
+	{
+		const int width = sizes[s].first, height = sizes[s].second;
+		char size[32];
+		snprintf(size, sizeof(size), "%dx%d", width, height);
+
+		HeadlessContext context;
+		if(!context.Create(width, height))
+			return 1;
+		Scene scene;
+		SetupScene(scene, width, height);
+
+		// Warm up: buffer upload
+		DrawGL(scene, context);
+		Clock::time_point start = Clock::now();
+		for(int f=0; f < frames; f++)
+		{
+			NextPose(scene);
+			DrawGL(scene, context);
+		}
+		const double glTime = Milliseconds(start) / frames;
+		printf("%11s %10s %8s %6s %12.2f %10.1f\n", size, "gl", "-", "-", glTime, 1000.0 / glTime);
+
+		// The GL frame of the last pose, to compare against
+		std::vector<unsigned char> reference(context.GetPixels(), context.GetPixels() + (size_t)3*width*height);
+		std::vector<unsigned char> pixels;
+
+		for(int pass=0; pass < 2; pass++)
+		{
+			const bool simd = pass == 0;
+			if(simd && !SoftwareRenderer::HasSIMD())
+				continue;
+
+			for(int threads=1; threads <= maxThreads; threads++)
+			{
+				// Scalar only once, at the most threads
+				if(!simd && threads != maxThreads)
+					continue;
+
+				JobSystem jobs(threads);
+				SoftwareRenderer renderer(width, height, &jobs);
+				renderer.SetSIMD(simd);
+				renderer.SetClearColor(0.4f, 0.4f, 0.4f);
+				renderer.SetLight(0, lightPosition0, lightAmbient, white, white);
+				renderer.SetLight(1, lightPosition1, lightAmbient, white, white);
+				renderer.AddMaterial(bodyAmbient, bodySpecular, bodyDiffuse, rubberShininess);
+				renderer.AddMaterial(rubberAmbient, rubberSpecular, rubberDiffuse, rubberShininess);
+				renderer.AddMaterial(chromeAmbient, chromeSpecular, chromeDiffuse, chromeShininess);
+				const int groundMaterial = renderer.AddMaterial(scene.ground->GetAmbient(), scene.ground->GetSpecular(),
+					scene.ground->GetDiffuse(), scene.ground->GetShininess());
+
+				// The same poses as the GL pass, ending on the reference pose
+				scene.pose[jointSpin] -= frames;
+				scene.rig.Pose(scene.pose);
+				DrawSoftware(scene, renderer, groundMaterial);
+				start = Clock::now();
+				for(int f=0; f < frames; f++)
+				{
+					NextPose(scene);
+					DrawSoftware(scene, renderer, groundMaterial);
+				}
+				const double elapsed = Milliseconds(start) / frames;
+
+				renderer.ReadPixels(pixels);
+				double mean, share;
+				Difference(reference, &pixels[0], mean, share);
+				printf("%11s %10s %8d %6s %12.2f %10.1f %10.3f %10.3f\n", size, "software", threads, simd ? "sse" : "no",
+					elapsed, 1000.0 / elapsed, mean, share);
+			}
+		}
+
+		if(writePrefix)
+		{
+			char fileName[1024];
+			snprintf(fileName, sizeof(fileName), "%s-gl-%s.ppm", writePrefix, size);
+			WritePPM(fileName, &reference[0], width, height);
+			snprintf(fileName, sizeof(fileName), "%s-software-%s.ppm", writePrefix, size);
+			WritePPM(fileName, &pixels[0], width, height);
+		}
+		delete scene.ground;
+	}
+
+	return 0;
+}
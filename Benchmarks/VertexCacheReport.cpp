@@ -0,0 +1,66 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	VertexCacheReport.cpp
+//	Reports ACMR (post-transform vertex cache misses per triangle, 0.5 is the best a
+//	grid can do) for the QuadMesh index orders: the row by row quads drawn before,
+//	and the column band triangle list and strips drawn now. Each order is scored
+//	against FIFO caches of a few sizes, with the band width QuadMesh picks for each.
+//
+//	Build: cmake -S . -B build && cmake --build build --target VertexCacheReport
+//
+//	Usage: VertexCacheReport [meshSize ...]
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#define GL_SILENCE_DEPRECATION
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <vector>
+#include "VertexCache.h"
+
+int main(int argc, char **argv)
+{
+	std::vector<int> sizes;
+	for(int i=1; i < argc; i++)
+		sizes.push_back(atoi(argv[i]));
+	if(sizes.empty())
+	{
+		sizes.push_back(16);
+		sizes.push_back(256);
+		sizes.push_back(1024);
+	}
+
+	const int cacheSizes[] = { 8, 16, 24, 32 };
+	const unsigned int restartIndex = 0xffffffff;
+
+	printf("%10s %8s %8s %12s %12s %12s %14s %14s\n", "meshSize", "cache", "band", "quads ACMR",
+		"tris ACMR", "strips ACMR", "tris indices", "strip indices");
+	for(size_t s=0; s < sizes.size(); s++)
+	{
+		const int meshSize = sizes[s];
+		std::vector<unsigned int> quads(4*meshSize*meshSize);
+		BuildGridQuads(&quads[0], meshSize);
+
+		for(size_t c=0; c < sizeof(cacheSizes)/sizeof(cacheSizes[0]); c++)
+		{
+			const int cacheSize = cacheSizes[c];
+			const int bandWidth = GridBandWidth(cacheSize);
+
+			std::vector<unsigned int> triangles(GridTriangleIndexCount(meshSize));
+			BuildGridTriangles(&triangles[0], meshSize, bandWidth);
+			std::vector<unsigned int> strips(GridStripIndexCount(meshSize, bandWidth));
+			BuildGridStrips(&strips[0], meshSize, bandWidth, restartIndex);
+
+			printf("%10d %8d %8d %12.3f %12.3f %12.3f %14d %14d%s\n", meshSize, cacheSize, bandWidth,
+				ComputeACMR(&quads[0], (int)quads.size(), GL_QUADS, restartIndex, cacheSize),
+				ComputeACMR(&triangles[0], (int)triangles.size(), GL_TRIANGLES, restartIndex, cacheSize),
+				ComputeACMR(&strips[0], (int)strips.size(), GL_TRIANGLE_STRIP, restartIndex, cacheSize),
+				(int)triangles.size(), (int)strips.size(), cacheSize == defaultVertexCacheSize ? "  (QuadMesh)" : "");
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,165 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	VertexFormatBenchmark.cpp
+//	Compares QuadMesh's full vertex layout (interleaved MeshVertex plus the SoA grid)
+//	with the 4 byte CompactVertex layout: resident memory, the time to encode, and the
+//	time and bandwidth of a sweep that reads every vertex position and normal. Also
+//	reports the quantization error and the memory of a chunked Terrain both ways.
+//	The ratio is CompactVertex against the 24 byte MeshVertex array alone, the
+//	interleaved layout before the SoA grid was added.
+//
+//	Build: cmake -S . -B build && cmake --build build --target VertexFormatBenchmark
+//
+//	Usage: VertexFormatBenchmark [meshSize ...]
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#define GL_SILENCE_DEPRECATION
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#include <GLUT/glut.h>
+#else
+#include <GL/gl.h>
+#include <GL/glut.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <utility>
+#include <vector>
+#include "VECTOR3D.h"
+#include "QuadMesh.h"
+#include "Terrain.h"
+
+static const int repetitions = 5;
+
+typedef std::chrono::steady_clock Clock;
+
+static double Milliseconds(Clock::time_point start)
+{
+	std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+	return elapsed.count();
+}
+
+// Sum of every position and normal, best of a few runs. The sum keeps the reads alive.
+static double TimeSweep(const QuadMesh &mesh, int meshSize, float &sum)
+{
+	double best = 1e30;
+	for(int r=0; r < repetitions; r++)
+	{
+		Clock::time_point start = Clock::now();
+		VECTOR3D total(0.0f, 0.0f, 0.0f);
+		const MeshVertex *vertices = mesh.GetVertices();
+		if(vertices)
+		{
+			for(int i=0; i < mesh.GetNumVertices(); i++)
+				total += vertices[i].position + vertices[i].normal;
+		}
+		else
+		{
+			for(int row=0; row <= meshSize; row++)
+			{
+				for(int col=0; col <= meshSize; col++)
+				{
+					MeshVertex v = mesh.GetVertex(row, col);
+					total += v.position + v.normal;
+				}
+			}
+		}
+		double elapsed = Milliseconds(start);
+		if(elapsed < best)
+			best = elapsed;
+		sum = total.x + total.y + total.z;
+	}
+	return best;
+}
+
+int main(int argc, char **argv)
+{
+	std::vector<int> sizes;
+	for(int i=1; i < argc; i++)
+		sizes.push_back(atoi(argv[i]));
+	if(sizes.empty())
+	{
+		sizes.push_back(256);
+		sizes.push_back(1024);
+		sizes.push_back(2048);
+	}
+
+	VECTOR3D origin(-16.0f, 0.0f, 16.0f);
+	VECTOR3D dir1v(1.0f, 0.0f, 0.0f);
+	VECTOR3D dir2v(0.0f, 0.0f, -1.0f);
+	float sink = 0.0f;
+
+	printf("%10s %12s %10s %10s %10s %8s %10s %10s %10s %10s %10s %10s %10s\n", "meshSize", "vertices", "vertex MB",
+		"full MB", "compact MB", "ratio", "encode ms", "full ms", "full GB/s", "compact ms", "comp GB/s", "height err", "normal deg");
+	for(size_t s=0; s < sizes.size(); s++)
+	{
+		int meshSize = sizes[s];
+		QuadMesh mesh(meshSize, 32.0f);
+		mesh.InitMesh(meshSize, origin, 32.0, 32.0, dir1v, dir2v);
+
+		// Bumpy ground so heights and normals vary
+		for(int b=0; b < 64; b++)
+		{
+			VECTOR3D center(-16.0f + (b*7 % 32), 0.0f, 16.0f - (b*13 % 32));
+			mesh.ApplyBrush(center, 2.0f + b % 5, (b % 3 - 1)*1.5f);
+		}
+		mesh.ComputeNormals();
+		std::vector<MeshVertex> expected(mesh.GetVertices(), mesh.GetVertices() + mesh.GetNumVertices());
+
+		const double vertexMB = mesh.GetNumVertices()*sizeof(MeshVertex) / (1024.0*1024.0);
+		const double fullMB = mesh.GetVertexMemory() / (1024.0*1024.0);
+		float sum;
+		const double fullMs = TimeSweep(mesh, meshSize, sum);
+		sink += sum;
+
+		Clock::time_point start = Clock::now();
+		mesh.SetCompact(true);
+		const double encodeMs = Milliseconds(start);
+
+		const double compactMB = mesh.GetVertexMemory() / (1024.0*1024.0);
+		const double compactMs = TimeSweep(mesh, meshSize, sum);
+		sink += sum;
+
+		float heightError = 0.0f, normalError = 0.0f;
+		for(int row=0; row <= meshSize; row++)
+		{
+			for(int col=0; col <= meshSize; col++)
+			{
+				MeshVertex v = mesh.GetVertex(row, col);
+				const MeshVertex &e = expected[row*(meshSize+1)+col];
+				float error = (v.position - e.position).GetLength();
+				if(error > heightError)
+					heightError = error;
+				float cosine = v.normal.DotProduct(e.normal);
+				error = acosf(cosine < 1.0f ? cosine : 1.0f) * 180.0f / M_PI;
+				if(error > normalError)
+					normalError = error;
+			}
+		}
+
+		// Bytes the sweep has to read in each layout
+		const double fullBytes = (double)mesh.GetNumVertices()*sizeof(MeshVertex);
+		const double compactBytes = (double)mesh.GetNumVertices()*sizeof(CompactVertex);
+		printf("%10d %12d %10.2f %10.2f %10.2f %7.2fx %10.3f %10.3f %10.2f %10.3f %10.2f %10.2e %10.3f\n", meshSize,
+			mesh.GetNumVertices(), vertexMB, fullMB, compactMB, vertexMB / compactMB, encodeMs, fullMs, fullBytes / fullMs * 1e-6,
+			compactMs, compactBytes / compactMs * 1e-6, heightError, normalError);
+	}
+
+	// Whole terrain, heightfield included
+	for(int compact=0; compact < 2; compact++)
+	{
+		Terrain terrain(1024, 64, 512.0f);
+		terrain.GenerateHills(2.0f, 60.0f);
+		terrain.SetCompactChunks(compact != 0);
+		Clock::time_point start = Clock::now();
+		terrain.Build(VECTOR3D(-256.0f, 0.0f, 256.0f));
+		const double buildMs = Milliseconds(start);
+		printf("terrain 1024, %s chunks: %.2f MB, build %.1f ms\n", compact ? "compact" : "full",
+			terrain.GetMemory() / (1024.0*1024.0), buildMs);
+	}
+	printf("(checksum %g)\n", sink);
+
+	return 0;
+}
@@ -0,0 +1,77 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//	QuadMeshCacheTest.cpp
+//	A mesh mapped from its cache file keeps its quad indices once the mapping is
+//	dropped: SetCompact(true) releases the cache, and the indices it then draws from
+//	must match those of a mesh generated without the cache.
+//
+//	Build: cmake -S . -B build && cmake --build build --target QuadMeshCacheTest
+//	Run: ctest --test-dir build
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#define GL_SILENCE_DEPRECATION
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#include <GLUT/glut.h>
+#else
+#include <GL/gl.h>
+#include <GL/glut.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <utility>
+#include <vector>
+#include "VECTOR3D.h"
+#include "QuadMesh.h"
+
+static const char *cachePath = "QuadMeshCacheTest.qmsh";
+static const int meshSize = 32;
+
+static void InitGround(QuadMesh &mesh)
+{
+	mesh.InitMesh(meshSize, VECTOR3D(-16.0f, 0.0f, 16.0f), 32.0, 32.0, VECTOR3D(1.0f, 0.0f, 0.0f), VECTOR3D(0.0f, 0.0f, -1.0f));
+}
+
+int main()
+{
+	remove(cachePath);
+
+	QuadMesh generated(meshSize, 32.0f);
+	InitGround(generated);
+
+	// The first mesh with the cache writes it, the second maps it
+	QuadMesh writer(meshSize, 32.0f);
+	writer.SetCacheFile(cachePath);
+	InitGround(writer);
+
+	QuadMesh mapped(meshSize, 32.0f);
+	mapped.SetCacheFile(cachePath);
+	InitGround(mapped);
+	if(!mapped.IsMappedFromCache())
+	{
+		fprintf(stderr, "FAIL: mesh was not mapped from %s\n", cachePath);
+		remove(cachePath);
+		return 1;
+	}
+
+	mapped.SetCompact(true);
+	remove(cachePath);
+	if(mapped.IsMappedFromCache() || mapped.GetNumIndices() != generated.GetNumIndices())
+	{
+		fprintf(stderr, "FAIL: compact mesh still mapped or has %d indices, expected %d\n",
+			mapped.GetNumIndices(), generated.GetNumIndices());
+		return 1;
+	}
+	for(int i=0; i < generated.GetNumIndices(); i++)
+	{
+		if(mapped.GetIndex(i) != generated.GetIndex(i))
+		{
+			fprintf(stderr, "FAIL: index %d is %u, expected %u\n", i, mapped.GetIndex(i), generated.GetIndex(i));
+			return 1;
+		}
+	}
+
+	printf("PASS: %d indices kept after releasing the cache\n", generated.GetNumIndices());
+	return 0;
+}